@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <string.h>
+#include "bitstream.h"
+
+/*
+ * Bits are read from a 64 bit window, left aligned in cache, with all
+ * bits below the cache_bits valid ones kept zero. Refills load as many
+ * whole bytes as fit, eight at a time where possible.
+ */
+
+void bs_init(bitstream_t *bs, const uint8_t *data, unsigned int length, int emulation_prevention)
+{
+	bs->data = data;
+	bs->length = length;
+	bs->pos = 0;
+	bs->bitpos = 0;
+	bs->emulation_prevention = emulation_prevention;
+	bs->zeros = 0;
+	bs->cache = 0;
+	bs->cache_bits = 0;
+	bs->overrun = 0;
+}
+
+void bs_seek(bitstream_t *bs, unsigned int bitpos)
+{
+	bs->pos = bitpos / 8;
+	bs->bitpos = bitpos & ~7;
+	bs->zeros = 0;
+	bs->cache = 0;
+	bs->cache_bits = 0;
+	bs->overrun = 0;
+
+	bs_get_u(bs, bitpos & 7);
+}
+
+static inline uint64_t load_be64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline int has_zero_byte(uint64_t v)
+{
+	return ((v - 0x0101010101010101ULL) & ~v & 0x8080808080808080ULL) != 0;
+}
+
+static void refill(bitstream_t *bs)
+{
+	// without a zero byte in the next eight there can't be an escape among them
+	if (bs->pos + 8 <= bs->length)
+	{
+		uint64_t v = load_be64(bs->data + bs->pos);
+
+		if (!bs->emulation_prevention || (bs->zeros < 2 && !has_zero_byte(v)))
+		{
+			int bytes = (64 - bs->cache_bits) / 8;
+
+			bs->cache |= v >> bs->cache_bits;
+			bs->cache_bits += bytes * 8;
+			if (bs->cache_bits < 64)
+				bs->cache &= ~0ULL << (64 - bs->cache_bits);
+
+			bs->pos += bytes;
+			if (bs->emulation_prevention)
+				bs->zeros = 0;
+
+			return;
+		}
+	}
+
+	while (bs->cache_bits <= 56)
+	{
+		if (bs->emulation_prevention && bs->zeros >= 2 && bs->pos < bs->length && bs->data[bs->pos] == 0x03)
+		{
+			bs->pos++;
+			bs->zeros = 0;
+		}
+
+		if (bs->pos >= bs->length)
+			return;
+
+		uint8_t byte = bs->data[bs->pos++];
+
+		bs->cache |= (uint64_t)byte << (56 - bs->cache_bits);
+		bs->cache_bits += 8;
+
+		if (byte == 0x00)
+			bs->zeros++;
+		else
+			bs->zeros = 0;
+	}
+}
+
+uint32_t bs_get_u(bitstream_t *bs, int num)
+{
+	uint32_t bits;
+
+	if (num <= 0)
+		return 0;
+
+	if (bs->cache_bits < num)
+	{
+		refill(bs);
+
+		// past the end, read as zeros
+		if (bs->cache_bits < num)
+		{
+			bits = bs->cache >> (64 - num);
+
+			bs->cache = 0;
+			bs->cache_bits = 0;
+			bs->bitpos += num;
+			bs->overrun = 1;
+
+			return bits;
+		}
+	}
+
+	bits = bs->cache >> (64 - num);
+
+	bs->cache <<= num;
+	bs->cache_bits -= num;
+	bs->bitpos += num;
+
+	return bits;
+}
+
+void bs_skip_bits(bitstream_t *bs, unsigned int num)
+{
+	for (; num > 32; num -= 32)
+		bs_get_u(bs, 32);
+
+	bs_get_u(bs, num);
+}
+
+uint32_t bs_get_ue(bitstream_t *bs)
+{
+	if (bs->cache_bits < 32)
+		refill(bs);
+
+	int leading_zeros = bs->cache ? __builtin_clzll(bs->cache) : 64;
+
+	if (leading_zeros > 31 || leading_zeros >= bs->cache_bits)
+	{
+		bs->overrun = 1;
+		return 0;
+	}
+
+	bs_get_u(bs, leading_zeros + 1);
+
+	if (leading_zeros == 0)
+		return 0;
+
+	return ((1u << leading_zeros) - 1) + bs_get_u(bs, leading_zeros);
+}
+
+int32_t bs_get_se(bitstream_t *bs)
+{
+	uint32_t k = bs_get_ue(bs);
+
+	if (k & 1)
+		return (k + 1) / 2;
+	else
+		return -(int32_t)(k / 2);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __BITSTREAM_H__
+#define __BITSTREAM_H__
+
+#include <stdint.h>
+
+typedef struct
+{
+	const uint8_t *data;
+	unsigned int length;
+	unsigned int pos;
+	unsigned int bitpos;
+	unsigned int emulation_prevention;
+	unsigned int zeros;
+	uint64_t cache;
+	int cache_bits;
+	int overrun;
+} bitstream_t;
+
+/*
+ * If emulation_prevention is set, 0x000003 sequences are unescaped
+ * on the fly, as needed for H.264/HEVC NAL units.
+ */
+void bs_init(bitstream_t *bs, const uint8_t *data, unsigned int length, int emulation_prevention);
+
+/* continue reading at bit position bitpos, only for unescaped streams */
+void bs_seek(bitstream_t *bs, unsigned int bitpos);
+
+uint32_t bs_get_u(bitstream_t *bs, int num);
+uint32_t bs_get_ue(bitstream_t *bs);
+int32_t bs_get_se(bitstream_t *bs);
+void bs_skip_bits(bitstream_t *bs, unsigned int num);
+
+/* bits consumed so far, emulation prevention bytes excluded */
+static inline unsigned int bs_bits_read(const bitstream_t *bs)
+{
+	return bs->bitpos;
+}
+
+static inline int bs_overrun(const bitstream_t *bs)
+{
+	return bs->overrun;
+}
+
+#endif
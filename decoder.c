@@ -18,8 +18,20 @@
  */
 
 #include <string.h>
+#include <time.h>
 #include <cedrus/cedrus.h>
 #include "vdpau_private.h"
+#include "vdpau_sunxi.h"
+
+static uint64_t get_time(void)
+{
+	struct timespec tp;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tp) == -1)
+		return 0;
+
+	return (uint64_t)tp.tv_sec * 1000000000ULL + (uint64_t)tp.tv_nsec;
+}
 
 static void cleanup_decoder(void *ptr, void *meta)
 {
@@ -28,11 +40,182 @@ static void cleanup_decoder(void *ptr, void *meta)
 	if (decoder->private_free)
 		decoder->private_free(decoder);
 
-	cedrus_mem_free(decoder->data);
+	__sync_bool_compare_and_swap(&decoder->device->ve_owner, decoder, NULL);
+
+	VDPAU_DBG("%lu of %lu register writes elided", decoder->shadow.elided, decoder->shadow.writes);
+	if (decoder->ve_wait.timeouts)
+		VDPAU_DBG("VE timed out %u times", decoder->ve_wait.timeouts);
+	if (decoder->pictures_skipped)
+		VDPAU_DBG("%u of %u pictures skipped", decoder->pictures_skipped, decoder->pictures_skipped + decoder->pictures_decoded);
+
+	device_mem_free(decoder->device, decoder->data);
 
 	sfree(decoder->device);
 }
 
+void *decoder_ve_get(decoder_ctx_t *decoder, enum cedrus_engine engine, uint32_t flags)
+{
+	ve_sched_get(&decoder->device->ve_sched, &decoder->sched);
+
+	decoder->ve_start = get_time();
+	decoder->ve_engine = engine;
+	decoder->ve_flags = flags;
+	void *regs = cedrus_ve_get(decoder->device->cedrus, engine, flags);
+
+	// other processes or decoders may have used the VE in between
+	ve_shadow_acquire(&decoder->shadow, regs, decoder->device->ve_exclusive && decoder->device->ve_owner == decoder);
+	decoder->device->ve_owner = decoder;
+
+	return regs;
+}
+
+void decoder_ve_put(decoder_ctx_t *decoder)
+{
+	cedrus_ve_put(decoder->device->cedrus);
+
+	uint64_t ve_time = get_time() - decoder->ve_start;
+	decoder->ve_time += ve_time;
+
+	ve_sched_put(&decoder->device->ve_sched, &decoder->sched, ve_time);
+}
+
+/*
+ * Wait until the VE finished a job of mbs macroblocks, i.e. one of the
+ * status_mask bits in status_reg got set. A job that hangs is stopped by
+ * reselecting the engine, which leaves the registers undefined.
+ */
+VdpStatus decoder_ve_wait(decoder_ctx_t *decoder, void *status_reg, uint32_t status_mask, uint32_t mbs)
+{
+	if (ve_wait(&decoder->ve_wait, decoder->device->cedrus, status_reg, status_mask, mbs))
+		return VDP_STATUS_OK;
+
+	VDPAU_DBG("VE timed out on %u macroblocks, status 0x%08x, resetting", mbs, readl(status_reg));
+
+	cedrus_ve_put(decoder->device->cedrus);
+	ve_shadow_acquire(&decoder->shadow, cedrus_ve_get(decoder->device->cedrus, decoder->ve_engine, decoder->ve_flags), 0);
+
+	return VDP_STATUS_ERROR;
+}
+
+/*
+ * Decide whether the current picture is skipped according to the
+ * decoder's skip policy. In automatic mode non-reference pictures are
+ * skipped while the average VE time per submitted picture exceeds the
+ * frame period, until it dropped below 3/4 of it again.
+ */
+int decoder_skip_picture(decoder_ctx_t *decoder, int is_reference)
+{
+	int skip = 0;
+
+	if (decoder->skip_policy == VDP_DECODER_SKIP_POLICY_AUTO_SUNXI && decoder->frame_period)
+	{
+		if (decoder->ve_load > decoder->frame_period)
+			decoder->shedding = 1;
+		else if (decoder->ve_load < decoder->frame_period * 3 / 4)
+			decoder->shedding = 0;
+	}
+
+	if (!is_reference)
+	{
+		if (decoder->skip_policy == VDP_DECODER_SKIP_POLICY_NON_REFERENCE_SUNXI)
+			skip = 1;
+		else if (decoder->skip_policy == VDP_DECODER_SKIP_POLICY_AUTO_SUNXI)
+			skip = decoder->shedding;
+	}
+
+	if (skip)
+		decoder->pictures_skipped++;
+	else
+		decoder->pictures_decoded++;
+
+	return skip;
+}
+
+/*
+ * Decide whether the deblocking filter is bypassed for the current
+ * picture. In automatic mode the decoder climbs one step of the
+ * ladder (full, non-reference off, all off) after 8 pictures over the
+ * frame period, and steps back after 32 pictures below 3/4 of it.
+ */
+int decoder_bypass_deblocking(decoder_ctx_t *decoder, int is_reference)
+{
+	if (decoder->deblocking_mode == VDP_DECODER_DEBLOCKING_MODE_AUTO_SUNXI)
+	{
+		if (decoder->deblocking_frame_period && decoder->ve_load > decoder->deblocking_frame_period)
+			decoder->deblocking_trend = max(decoder->deblocking_trend, 0) + 1;
+		else if (decoder->ve_load < decoder->deblocking_frame_period * 3 / 4)
+			decoder->deblocking_trend = min(decoder->deblocking_trend, 0) - 1;
+		else
+			decoder->deblocking_trend = 0;
+
+		if (decoder->deblocking_trend >= 8 && decoder->deblocking_level < VDP_DECODER_DEBLOCKING_MODE_NONE_SUNXI)
+		{
+			decoder->deblocking_level++;
+			decoder->deblocking_trend = 0;
+		}
+		else if (decoder->deblocking_trend <= -32 && decoder->deblocking_level > VDP_DECODER_DEBLOCKING_MODE_FULL_SUNXI)
+		{
+			decoder->deblocking_level--;
+			decoder->deblocking_trend = 0;
+		}
+	}
+	else
+		decoder->deblocking_level = decoder->deblocking_mode;
+
+	decoder->deblocking_in_effect = decoder->deblocking_level;
+
+	if (decoder->deblocking_level == VDP_DECODER_DEBLOCKING_MODE_NONE_SUNXI)
+		return 1;
+
+	return decoder->deblocking_level == VDP_DECODER_DEBLOCKING_MODE_NON_REFERENCE_SUNXI && !is_reference;
+}
+
+VdpStatus vdp_decoder_set_rotation_sunxi(VdpDecoder decoder,
+                                         uint32_t degrees)
+{
+	smart decoder_ctx_t *dec = handle_get(decoder);
+	if (!dec)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (degrees % 90 || degrees > 270)
+		return VDP_STATUS_INVALID_VALUE;
+
+	dec->rotation = degrees / 90;
+
+	return VDP_STATUS_OK;
+}
+
+VdpStatus vdp_decoder_set_nal_length_size_sunxi(VdpDecoder decoder,
+                                                uint32_t nal_length_size)
+{
+	smart decoder_ctx_t *dec = handle_get(decoder);
+	if (!dec)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (nal_length_size != 0 && nal_length_size != 1 && nal_length_size != 2 && nal_length_size != 4)
+		return VDP_STATUS_INVALID_VALUE;
+
+	dec->nal_length_size = nal_length_size;
+
+	return VDP_STATUS_OK;
+}
+
+VdpStatus vdp_decoder_set_scheduling_sunxi(VdpDecoder decoder,
+                                           uint32_t priority,
+                                           uint32_t deadline_us)
+{
+	smart decoder_ctx_t *dec = handle_get(decoder);
+	if (!dec)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (priority > 15)
+		return VDP_STATUS_INVALID_VALUE;
+
+	ve_sched_set(&dec->device->ve_sched, &dec->sched, priority, deadline_us);
+
+	return VDP_STATUS_OK;
+}
+
 VdpStatus vdp_decoder_create(VdpDevice device,
                              VdpDecoderProfile profile,
                              uint32_t width,
@@ -55,8 +238,12 @@ VdpStatus vdp_decoder_create(VdpDevice device,
 	dec->profile = profile;
 	dec->width = width;
 	dec->height = height;
+	dec->rotation = dev->rotation;
+	ve_wait_init(&dec->ve_wait);
+	if (dev->prewarm_enabled)
+		dec->prewarm_frames = max_references + 2;
 
-	dec->data = cedrus_mem_alloc(dec->device->cedrus, VBV_SIZE);
+	dec->data = device_mem_alloc(dec->device, VBV_SIZE, MEM_VBV, dec);
 	if (!(dec->data))
 		return VDP_STATUS_RESOURCES;
 
@@ -89,13 +276,37 @@ VdpStatus vdp_decoder_create(VdpDevice device,
 			ret = VDP_STATUS_INVALID_DECODER_PROFILE;
 		break;
 
+	case VDP_DECODER_PROFILE_VC1_SIMPLE:
+	case VDP_DECODER_PROFILE_VC1_MAIN:
+	case VDP_DECODER_PROFILE_VC1_ADVANCED:
+		// the VE has a VC-1 engine, but libcedrus can't select it and its registers are unknown
+		VDPAU_DBG("VC-1 decoding is not supported");
+		ret = VDP_STATUS_INVALID_DECODER_PROFILE;
+		break;
+
 	default:
 		ret = VDP_STATUS_INVALID_DECODER_PROFILE;
 		break;
 	}
 
 	if (ret != VDP_STATUS_OK)
-		return VDP_STATUS_ERROR;
+		return ret == VDP_STATUS_INVALID_DECODER_PROFILE ? ret : VDP_STATUS_ERROR;
+
+	if (dec->prewarm_frames)
+	{
+		/*
+		 * Output copies, plus reconstruction buffers on newer engines or
+		 * with rotation. The H.264 decoder prewarms its motion vector
+		 * buffers itself, the HEVC ones depend on the stream's CTB size.
+		 */
+		int luma_size, chroma_size;
+		video_surface_size(width, height, VDP_CHROMA_TYPE_420, dec->rotation, &luma_size, &chroma_size);
+		int size = luma_size + chroma_size;
+		int count = dec->prewarm_frames * (cedrus_get_ve_version(dec->device->cedrus) >= 0x1680 || dec->rotation ? 2 : 1);
+
+		count = yuv_pool_prewarm(dec->device, size, count);
+		VDPAU_DBG("Prewarmed %d frame buffers of %d bytes", count, size);
+	}
 
 	return handle_create(decoder, dec);
 }
@@ -145,7 +356,82 @@ VdpStatus vdp_decoder_render(VdpDecoder decoder,
 	}
 	cedrus_mem_flush_cache(dec->data);
 
-	return dec->decode(dec, picture_info, pos, vid);
+	dec->ve_time = 0;
+	VdpStatus ret = dec->decode(dec, picture_info, pos, vid);
+
+	// average VE time per submitted picture, skipped ones count as 0
+	dec->ve_load = (dec->ve_load * 7 + dec->ve_time) / 8;
+
+	return ret;
+}
+
+VdpStatus vdp_decoder_set_skip_policy_sunxi(VdpDecoder decoder,
+                                            uint32_t policy,
+                                            uint32_t frame_period_us)
+{
+	smart decoder_ctx_t *dec = handle_get(decoder);
+	if (!dec)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (policy > VDP_DECODER_SKIP_POLICY_AUTO_SUNXI)
+		return VDP_STATUS_INVALID_VALUE;
+
+	dec->skip_policy = policy;
+	dec->frame_period = frame_period_us * 1000ULL;
+	dec->shedding = 0;
+
+	return VDP_STATUS_OK;
+}
+
+VdpStatus vdp_decoder_set_deblocking_mode_sunxi(VdpDecoder decoder,
+                                               uint32_t mode,
+                                               uint32_t frame_period_us)
+{
+	smart decoder_ctx_t *dec = handle_get(decoder);
+	if (!dec)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (mode > VDP_DECODER_DEBLOCKING_MODE_AUTO_SUNXI)
+		return VDP_STATUS_INVALID_VALUE;
+
+	dec->deblocking_mode = mode;
+	dec->deblocking_level = mode == VDP_DECODER_DEBLOCKING_MODE_AUTO_SUNXI ? VDP_DECODER_DEBLOCKING_MODE_FULL_SUNXI : mode;
+	dec->deblocking_trend = 0;
+	dec->deblocking_frame_period = frame_period_us * 1000ULL;
+
+	return VDP_STATUS_OK;
+}
+
+VdpStatus vdp_decoder_get_deblocking_mode_sunxi(VdpDecoder decoder,
+                                               uint32_t *mode)
+{
+	if (!mode)
+		return VDP_STATUS_INVALID_POINTER;
+
+	smart decoder_ctx_t *dec = handle_get(decoder);
+	if (!dec)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	*mode = dec->deblocking_in_effect;
+
+	return VDP_STATUS_OK;
+}
+
+VdpStatus vdp_decoder_get_skip_count_sunxi(VdpDecoder decoder,
+                                           uint32_t *skipped,
+                                           uint32_t *decoded)
+{
+	smart decoder_ctx_t *dec = handle_get(decoder);
+	if (!dec)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (skipped)
+		*skipped = dec->pictures_skipped;
+
+	if (decoded)
+		*decoded = dec->pictures_decoded;
+
+	return VDP_STATUS_OK;
 }
 
 VdpStatus vdp_decoder_query_capabilities(VdpDevice device,
@@ -22,12 +22,16 @@
 #include <fcntl.h>
 #include <cedrus/cedrus.h>
 #include "vdpau_private.h"
+#include "vdpau_sunxi.h"
 #include "sunxi_disp.h"
 
 static void cleanup_device(void *ptr, void *meta)
 {
 	device_ctx_t *device = ptr;
 
+	yuv_pool_release(device);
+	mem_account_release(&device->mem);
+	ve_sched_release(&device->ve_sched);
 	if (device->g2d_enabled)
 		close(device->g2d_fd);
 	cedrus_close(device->cedrus);
@@ -55,10 +59,44 @@ VdpStatus vdp_imp_device_create_x11(Display *display,
 		return VDP_STATUS_ERROR;
 
 	VDPAU_DBG("VE version 0x%04x opened", cedrus_get_ve_version(dev->cedrus));
+
+	size_t cma_budget = 0;
+	char *env_vdpau_cma_budget = getenv("VDPAU_CMA_BUDGET");
+	if (env_vdpau_cma_budget)
+		cma_budget = (size_t)atoi(env_vdpau_cma_budget) * 1024 * 1024;
+
+	mem_account_init(&dev->mem, dev->cedrus, cma_budget);
+	ve_sched_init(&dev->ve_sched);
+	yuv_pool_init(dev);
 	*get_proc_address = vdp_get_proc_address;
 
 	char *env_vdpau_osd = getenv("VDPAU_OSD");
 	char *env_vdpau_g2d = getenv("VDPAU_DISABLE_G2D");
+	char *env_vdpau_prewarm = getenv("VDPAU_PREWARM");
+	char *env_vdpau_rotation = getenv("VDPAU_ROTATION");
+	char *env_vdpau_ve_exclusive = getenv("VDPAU_VE_EXCLUSIVE");
+
+	if (env_vdpau_prewarm && strncmp(env_vdpau_prewarm, "1", 1) == 0)
+	{
+		dev->prewarm_enabled = 1;
+		VDPAU_DBG("Decoder buffer prewarming enabled");
+	}
+
+	if (env_vdpau_ve_exclusive && strncmp(env_vdpau_ve_exclusive, "1", 1) == 0)
+	{
+		dev->ve_exclusive = 1;
+		VDPAU_DBG("Assuming exclusive use of the VE");
+	}
+
+	if (env_vdpau_rotation)
+	{
+		int degrees = atoi(env_vdpau_rotation);
+		if (degrees == 90 || degrees == 180 || degrees == 270)
+		{
+			dev->rotation = degrees / 90;
+			VDPAU_DBG("Rotating decoded video by %d degrees", degrees);
+		}
+	}
 
 	if (env_vdpau_osd && strncmp(env_vdpau_osd, "1", 1) == 0)
 	{
@@ -105,6 +143,46 @@ VdpStatus vdp_imp_device_create_x11(Display *display,
 	return handle_create(device, dev);
 }
 
+cedrus_mem_t *device_mem_alloc(device_ctx_t *device, size_t size, enum mem_category category, const void *owner)
+{
+	return mem_account_alloc(&device->mem, size, category, owner);
+}
+
+void device_mem_free(device_ctx_t *device, cedrus_mem_t *mem)
+{
+	mem_account_free(&device->mem, mem);
+}
+
+void device_mem_retag(device_ctx_t *device, cedrus_mem_t *mem, enum mem_category category, const void *owner)
+{
+	mem_account_retag(&device->mem, mem, category, owner);
+}
+
+VdpStatus vdp_device_get_memory_usage_sunxi(VdpDevice device,
+                                            uint32_t category,
+                                            uint64_t *current,
+                                            uint64_t *peak)
+{
+	if (!current || !peak)
+		return VDP_STATUS_INVALID_POINTER;
+
+	if (category >= MEM_CATEGORIES && category != VDP_MEMORY_CATEGORY_TOTAL_SUNXI)
+		return VDP_STATUS_INVALID_VALUE;
+
+	smart device_ctx_t *dev = handle_get(device);
+	if (!dev)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	size_t c, p;
+	if (category == VDP_MEMORY_CATEGORY_TOTAL_SUNXI)
+		category = MEM_CATEGORIES;
+	mem_account_usage(&dev->mem, category, &c, &p);
+	*current = c;
+	*peak = p;
+
+	return VDP_STATUS_OK;
+}
+
 VdpStatus vdp_preemption_callback_register(VdpDevice device,
                                            VdpPreemptionCallback callback,
                                            void *context)
@@ -133,7 +211,7 @@ static void *const functions[] =
 	[VDP_FUNC_ID_VIDEO_SURFACE_QUERY_CAPABILITIES]                      = vdp_video_surface_query_capabilities,
 	[VDP_FUNC_ID_VIDEO_SURFACE_QUERY_GET_PUT_BITS_Y_CB_CR_CAPABILITIES] = vdp_video_surface_query_get_put_bits_y_cb_cr_capabilities,
 	[VDP_FUNC_ID_VIDEO_SURFACE_CREATE]                                  = vdp_video_surface_create,
-	[VDP_FUNC_ID_VIDEO_SURFACE_DESTROY]                                 = handle_destroy,
+	[VDP_FUNC_ID_VIDEO_SURFACE_DESTROY]                                 = vdp_video_surface_destroy,
 	[VDP_FUNC_ID_VIDEO_SURFACE_GET_PARAMETERS]                          = vdp_video_surface_get_parameters,
 	[VDP_FUNC_ID_VIDEO_SURFACE_GET_BITS_Y_CB_CR]                        = vdp_video_surface_get_bits_y_cb_cr,
 	[VDP_FUNC_ID_VIDEO_SURFACE_PUT_BITS_Y_CB_CR]                        = vdp_video_surface_put_bits_y_cb_cr,
@@ -199,6 +277,19 @@ static void *const functions[] =
 #endif
 };
 
+static void *const driver_functions[] =
+{
+	[VDP_FUNC_ID_DECODER_SET_SCHEDULING_SUNXI - VDP_FUNC_ID_BASE_DRIVER] = vdp_decoder_set_scheduling_sunxi,
+	[VDP_FUNC_ID_DECODER_SET_SKIP_POLICY_SUNXI - VDP_FUNC_ID_BASE_DRIVER] = vdp_decoder_set_skip_policy_sunxi,
+	[VDP_FUNC_ID_DECODER_GET_SKIP_COUNT_SUNXI - VDP_FUNC_ID_BASE_DRIVER] = vdp_decoder_get_skip_count_sunxi,
+	[VDP_FUNC_ID_DECODER_SET_DEBLOCKING_MODE_SUNXI - VDP_FUNC_ID_BASE_DRIVER] = vdp_decoder_set_deblocking_mode_sunxi,
+	[VDP_FUNC_ID_DECODER_GET_DEBLOCKING_MODE_SUNXI - VDP_FUNC_ID_BASE_DRIVER] = vdp_decoder_get_deblocking_mode_sunxi,
+	[VDP_FUNC_ID_VIDEO_SURFACE_SET_SCALED_OUTPUT_SUNXI - VDP_FUNC_ID_BASE_DRIVER] = vdp_video_surface_set_scaled_output_sunxi,
+	[VDP_FUNC_ID_DECODER_SET_ROTATION_SUNXI - VDP_FUNC_ID_BASE_DRIVER] = vdp_decoder_set_rotation_sunxi,
+	[VDP_FUNC_ID_DECODER_SET_NAL_LENGTH_SIZE_SUNXI - VDP_FUNC_ID_BASE_DRIVER] = vdp_decoder_set_nal_length_size_sunxi,
+	[VDP_FUNC_ID_DEVICE_GET_MEMORY_USAGE_SUNXI - VDP_FUNC_ID_BASE_DRIVER] = vdp_device_get_memory_usage_sunxi,
+};
+
 VdpStatus vdp_get_proc_address(VdpDevice device_handle,
                                VdpFuncId function_id,
                                void **function_pointer)
@@ -224,6 +315,12 @@ VdpStatus vdp_get_proc_address(VdpDevice device_handle,
 
 		return VDP_STATUS_OK;
 	}
+	else if (function_id >= VDP_FUNC_ID_BASE_DRIVER && function_id - VDP_FUNC_ID_BASE_DRIVER < ARRAY_SIZE(driver_functions))
+	{
+		*function_pointer = driver_functions[function_id - VDP_FUNC_ID_BASE_DRIVER];
+
+		return VDP_STATUS_OK;
+	}
 
 	return VDP_STATUS_INVALID_FUNC_ID;
 }
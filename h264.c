@@ -17,28 +17,15 @@
  *
  */
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <cedrus/cedrus.h>
 #include <cedrus/cedrus_regs.h>
 #include "vdpau_private.h"
-
-static int find_startcode(const uint8_t *data, int len, int start)
-{
-	int pos, zeros = 0;
-	for (pos = start; pos < len; pos++)
-	{
-		if (data[pos] == 0x00)
-			zeros++;
-		else if (data[pos] == 0x01 && zeros >= 2)
-			return pos - 2;
-		else
-			zeros = 0;
-	}
-
-	return -1;
-}
+#include "startcode.h"
+#include "bitstream.h"
 
 static uint32_t get_u(void *regs, int num)
 {
@@ -130,46 +117,271 @@ typedef struct
 
 typedef struct
 {
+	// stream invariant, set up once at decoder creation
+	int ve_version;
+	uint8_t picture_width_in_mbs_minus1;
+	uint8_t frame_height_in_mbs_minus1;
+	uint8_t field_height_in_mbs_minus1;
+	int video_extra_data_len;
+	int extra_buffer_size;
+	struct h264_mv_pool *mv_pool;
+
+	// per picture, reset by h264_decode()
 	void *regs;
 	h264_header_t header;
 	VdpPictureInfoH264 const *info;
 	video_surface_ctx_t *output;
-	uint8_t picture_width_in_mbs_minus1;
 	uint8_t picture_height_in_mbs_minus1;
 	uint8_t default_scaling_lists;
-	int video_extra_data_len;
+	uint8_t bypass_deblocking;
 
 	int ref_count;
 	h264_picture_t ref_pic[16];
+	uint8_t default_lists_built;
+	uint8_t default_lists_field;
+	h264_picture_t default_list_p[32];
+	h264_picture_t default_list_b[2][32];
+
+	// SRAM frame buffer list as last written, see write_frame_list()
+	unsigned int frame_list_generation;
+	uint32_t frame_list[18][8];
+	unsigned long frame_list_slots_written;
+	unsigned long frame_list_slots_reused;
 } h264_context_t;
 
 typedef struct
 {
 	cedrus_mem_t *extra_data;
-} h264_private_t;
+	h264_context_t context;
 
-static void h264_private_free(decoder_ctx_t *decoder)
-{
-	h264_private_t *decoder_p = (h264_private_t *)decoder->private;
-	cedrus_mem_free(decoder_p->extra_data);
-	free(decoder_p);
-}
+	unsigned int scaling_lists_generation;
+	uint8_t scaling_lists_4x4[6][16];
+	uint8_t scaling_lists_8x8[2][64];
+	unsigned long scaling_lists_uploaded;
+	unsigned long scaling_lists_reused;
+} h264_private_t;
 
 #define PIC_TYPE_FRAME	0x0
 #define PIC_TYPE_FIELD	0x1
 #define PIC_TYPE_MBAFF	0x2
 
+#define MAX_MV_BUFFERS	32
+
 typedef struct
 {
 	cedrus_mem_t *extra_data;
+	struct h264_mv_pool *pool;
 	uint8_t pos;
 	uint8_t pic_type;
 } h264_video_private_t;
 
+/*
+ * Motion vector buffers are only needed while a surface is output or
+ * reference, so they are borrowed from a per-decoder pool instead of
+ * being owned by the surface. The pool is reference counted, since
+ * surfaces can outlive the decoder.
+ */
+typedef struct h264_mv_pool
+{
+	mem_shrinker_t shrinker;
+	pthread_mutex_t mutex;
+	device_ctx_t *device;
+	int size;
+	cedrus_mem_t *free[MAX_MV_BUFFERS];
+	int free_count;
+	h264_video_private_t *holders[MAX_MV_BUFFERS];
+	int holder_count;
+	int allocated;
+	int high_water;
+} h264_mv_pool_t;
+
+// free the buffers no surface holds, skipped if the pool is busy
+static size_t mv_pool_shrink(mem_shrinker_t *shrinker)
+{
+	h264_mv_pool_t *pool = (h264_mv_pool_t *)shrinker;
+	cedrus_mem_t *free[MAX_MV_BUFFERS];
+	int i, count;
+
+	if (pthread_mutex_trylock(&pool->mutex) != 0)
+		return 0;
+
+	count = pool->free_count;
+	memcpy(free, pool->free, count * sizeof(free[0]));
+	pool->free_count = 0;
+	pool->allocated -= count;
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < count; i++)
+		device_mem_free(pool->device, free[i]);
+
+	return (size_t)pool->size * count;
+}
+
+static void cleanup_mv_pool(void *ptr, void *meta)
+{
+	h264_mv_pool_t *pool = ptr;
+
+	mem_shrinker_unregister(&pool->device->mem, &pool->shrinker);
+
+	VDPAU_DBG("H264 MV buffer pool: %d buffers of %d bytes, %d in use at most", pool->allocated, pool->size, pool->high_water);
+
+	while (pool->free_count > 0)
+		device_mem_free(pool->device, pool->free[--pool->free_count]);
+
+	pthread_mutex_destroy(&pool->mutex);
+	sfree(pool->device);
+}
+
+static h264_mv_pool_t *mv_pool_create(device_ctx_t *device, int size)
+{
+	h264_mv_pool_t *pool = handle_alloc(sizeof(*pool), cleanup_mv_pool);
+	if (!pool)
+		return NULL;
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pool->device = sref(device);
+	pool->size = size;
+
+	pool->shrinker.shrink = mv_pool_shrink;
+	mem_shrinker_register(&device->mem, &pool->shrinker);
+
+	return pool;
+}
+
+/*
+ * New buffers are allocated without holding the pool mutex, since the
+ * allocation may run the shrinkers, including this pool's.
+ */
+static int mv_pool_borrow(h264_mv_pool_t *pool, h264_video_private_t *surface_p)
+{
+	cedrus_mem_t *mem = NULL;
+	int fresh = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->holder_count < MAX_MV_BUFFERS && pool->free_count > 0)
+		mem = pool->free[--pool->free_count];
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!mem)
+	{
+		mem = device_mem_alloc(pool->device, pool->size, MEM_MV, pool);
+		if (!mem)
+			return 0;
+		fresh = 1;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->holder_count < MAX_MV_BUFFERS)
+	{
+		surface_p->extra_data = mem;
+		pool->holders[pool->holder_count++] = surface_p;
+		pool->high_water = max(pool->high_water, pool->holder_count);
+		pool->allocated += fresh;
+		mem = NULL;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (mem)
+	{
+		device_mem_free(pool->device, mem);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void mv_pool_prewarm(h264_mv_pool_t *pool, int count)
+{
+	cedrus_mem_t *mem = NULL;
+
+	count = min(count, MAX_MV_BUFFERS);
+	do
+	{
+		pthread_mutex_lock(&pool->mutex);
+		if (mem && pool->free_count < count)
+		{
+			pool->free[pool->free_count++] = mem;
+			pool->allocated++;
+			mem = NULL;
+		}
+		int missing = !mem && pool->free_count < count;
+		pthread_mutex_unlock(&pool->mutex);
+
+		if (!missing)
+			break;
+
+		mem = device_mem_alloc(pool->device, pool->size, MEM_MV, pool);
+	} while (mem);
+
+	device_mem_free(pool->device, mem);
+}
+
+static void mv_pool_return_locked(h264_mv_pool_t *pool, int holder)
+{
+	h264_video_private_t *surface_p = pool->holders[holder];
+
+	pool->free[pool->free_count++] = surface_p->extra_data;
+	surface_p->extra_data = NULL;
+	pool->holders[holder] = pool->holders[--pool->holder_count];
+}
+
+static void mv_pool_return(h264_video_private_t *surface_p)
+{
+	h264_mv_pool_t *pool = surface_p->pool;
+	int i;
+
+	if (!pool || !surface_p->extra_data)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (i = 0; i < pool->holder_count; i++)
+		if (pool->holders[i] == surface_p)
+		{
+			mv_pool_return_locked(pool, i);
+			break;
+		}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+// return buffers of all surfaces that are neither output nor in the DPB anymore
+static void mv_pool_return_unused(h264_context_t *c)
+{
+	h264_mv_pool_t *pool = c->mv_pool;
+	int i, j;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (i = pool->holder_count - 1; i >= 0; i--)
+	{
+		h264_video_private_t *surface_p = pool->holders[i];
+
+		if (surface_p == c->output->decoder_private)
+			continue;
+
+		for (j = 0; j < c->ref_count; j++)
+			if (surface_p == c->ref_pic[j].surface->decoder_private)
+				break;
+
+		if (j == c->ref_count)
+			mv_pool_return_locked(pool, i);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+static void h264_private_free(decoder_ctx_t *decoder)
+{
+	h264_private_t *decoder_p = (h264_private_t *)decoder->private;
+	VDPAU_DBG("H264 scaling lists uploaded %lu times, reused %lu times", decoder_p->scaling_lists_uploaded, decoder_p->scaling_lists_reused);
+	VDPAU_DBG("H264 frame list slots written %lu times, reused %lu times", decoder_p->context.frame_list_slots_written, decoder_p->context.frame_list_slots_reused);
+	sfree(decoder_p->context.mv_pool);
+	device_mem_free(decoder->device, decoder_p->extra_data);
+	free(decoder_p);
+}
+
 static void h264_video_private_free(video_surface_ctx_t *surface)
 {
 	h264_video_private_t *surface_p = (h264_video_private_t *)surface->decoder_private;
-	cedrus_mem_free(surface_p->extra_data);
+	mv_pool_return(surface_p);
+	sfree(surface_p->pool);
 	free(surface_p);
 }
 
@@ -177,23 +389,33 @@ static h264_video_private_t *get_surface_priv(h264_context_t *c, video_surface_c
 {
 	h264_video_private_t *surface_p = surface->decoder_private;
 
+	if (surface_p && surface->decoder_private_free != h264_video_private_free)
+	{
+		// surface was used by another decoder type before
+		surface->decoder_private_free(surface);
+		surface_p = NULL;
+	}
+
 	if (!surface_p)
 	{
 		surface_p = calloc(1, sizeof(h264_video_private_t));
 		if (!surface_p)
 			return NULL;
 
-		surface_p->extra_data = cedrus_mem_alloc(surface->device->cedrus, c->video_extra_data_len * 2);
-		if (!surface_p->extra_data)
-		{
-			free(surface_p);
-			return NULL;
-		}
-
 		surface->decoder_private = surface_p;
 		surface->decoder_private_free = h264_video_private_free;
 	}
 
+	if (surface_p->pool != c->mv_pool)
+	{
+		mv_pool_return(surface_p);
+		sfree(surface_p->pool);
+		surface_p->pool = sref(c->mv_pool);
+	}
+
+	if (!surface_p->extra_data && !mv_pool_borrow(c->mv_pool, surface_p))
+		return NULL;
+
 	return surface_p;
 }
 
@@ -420,20 +642,25 @@ static int pic_order_cnt(const h264_picture_t *pic)
 		return pic->bottom_pic_order_cnt;
 }
 
-static int sort_ref_pics_by_poc(const void *p1, const void *p2)
+// insertion sort, there are at most 16 reference pictures
+static void sort_ref_pics(h264_picture_t **sorted, h264_picture_t *ref_pic, int count, int by_poc)
 {
-	const h264_picture_t *r1 = p1;
-	const h264_picture_t *r2 = p2;
+	int keys[16];
+	int i, j;
 
-	return pic_order_cnt(r1) - pic_order_cnt(r2);
-}
+	for (i = 0; i < count; i++)
+	{
+		int key = by_poc ? pic_order_cnt(&ref_pic[i]) : ref_pic[i].frame_idx;
 
-static int sort_ref_pics_by_frame_num(const void *p1, const void *p2)
-{
-	const h264_picture_t *r1 = p1;
-	const h264_picture_t *r2 = p2;
+		for (j = i; j > 0 && keys[j - 1] > key; j--)
+		{
+			keys[j] = keys[j - 1];
+			sorted[j] = sorted[j - 1];
+		}
 
-	return r1->frame_idx - r2->frame_idx;
+		keys[j] = key;
+		sorted[j] = &ref_pic[i];
+	}
 }
 
 static void split_ref_fields(h264_picture_t *out, h264_picture_t **in, int len, int cur_field)
@@ -463,64 +690,98 @@ static void split_ref_fields(h264_picture_t *out, h264_picture_t **in, int len,
 	}
 }
 
-static void fill_default_ref_pic_list(h264_context_t *c)
+/*
+ * The default lists only depend on the reference pictures and the
+ * current picture, so they are built once per picture and slice type
+ * and copied for each slice, ref_pic_list_modification() then works on
+ * the copy.
+ */
+static void build_default_ref_pic_lists(h264_context_t *c, int slice_type, int cur_field)
 {
-	h264_header_t *h = &c->header;
 	VdpPictureInfoH264 const *info = c->info;
-	int cur_field = h->field_pic_flag ? (h->bottom_field_flag ? PIC_BOTTOM_FIELD : PIC_TOP_FIELD) : PIC_FRAME;
+	h264_picture_t *sorted[16];
+	int i;
 
-	if (h->slice_type == SLICE_TYPE_P)
+	if (slice_type == SLICE_TYPE_P)
 	{
-		qsort(c->ref_pic, c->ref_count, sizeof(c->ref_pic[0]), &sort_ref_pics_by_frame_num);
+		sort_ref_pics(sorted, c->ref_pic, c->ref_count, 0);
 
-		int i;
 		int ptr0 = 0;
-		h264_picture_t *sorted[16];
+		h264_picture_t *list0[16];
 		for (i = 0; i < c->ref_count; i++)
 		{
-			if (c->ref_pic[c->ref_count - 1 - i].frame_idx <= info->frame_num)
-				sorted[ptr0++] = &c->ref_pic[c->ref_count - 1 - i];
+			if (sorted[c->ref_count - 1 - i]->frame_idx <= info->frame_num)
+				list0[ptr0++] = sorted[c->ref_count - 1 - i];
 		}
 		for (i = 0; i < c->ref_count; i++)
 		{
-			if (c->ref_pic[c->ref_count - 1 - i].frame_idx > info->frame_num)
-				sorted[ptr0++] = &c->ref_pic[c->ref_count - 1 - i];
+			if (sorted[c->ref_count - 1 - i]->frame_idx > info->frame_num)
+				list0[ptr0++] = sorted[c->ref_count - 1 - i];
 		}
 
-		split_ref_fields(h->RefPicList0, sorted, c->ref_count, cur_field);
+		memset(c->default_list_p, 0, sizeof(c->default_list_p));
+		split_ref_fields(c->default_list_p, list0, c->ref_count, cur_field);
 	}
-	else if (h->slice_type == SLICE_TYPE_B)
+	else
 	{
-		qsort(c->ref_pic, c->ref_count, sizeof(c->ref_pic[0]), &sort_ref_pics_by_poc);
+		sort_ref_pics(sorted, c->ref_pic, c->ref_count, 1);
 
 		int cur_poc;
-		if (h->field_pic_flag)
+		if (cur_field != PIC_FRAME)
 			cur_poc = (uint16_t)info->field_order_cnt[cur_field == PIC_BOTTOM_FIELD];
 		else
 			cur_poc = min((uint16_t)info->field_order_cnt[0], (uint16_t)info->field_order_cnt[1]);
 
-		int i;
 		int ptr0 = 0, ptr1 = 0;
-		h264_picture_t *sorted[2][16];
+		h264_picture_t *list[2][16];
 		for (i = 0; i < c->ref_count; i++)
 		{
-			if (pic_order_cnt(&c->ref_pic[c->ref_count - 1 - i]) <= cur_poc)
-				sorted[0][ptr0++] = &c->ref_pic[c->ref_count - 1  - i];
+			if (pic_order_cnt(sorted[c->ref_count - 1 - i]) <= cur_poc)
+				list[0][ptr0++] = sorted[c->ref_count - 1 - i];
 
-			if (pic_order_cnt(&c->ref_pic[i]) > cur_poc)
-				sorted[1][ptr1++] = &c->ref_pic[i];
+			if (pic_order_cnt(sorted[i]) > cur_poc)
+				list[1][ptr1++] = sorted[i];
 		}
 		for (i = 0; i < c->ref_count; i++)
 		{
-			if (pic_order_cnt(&c->ref_pic[i]) > cur_poc)
-				sorted[0][ptr0++] = &c->ref_pic[i];
+			if (pic_order_cnt(sorted[i]) > cur_poc)
+				list[0][ptr0++] = sorted[i];
 
-			if (pic_order_cnt(&c->ref_pic[c->ref_count - 1 - i]) <= cur_poc)
-				sorted[1][ptr1++] = &c->ref_pic[c->ref_count - 1 - i];
+			if (pic_order_cnt(sorted[c->ref_count - 1 - i]) <= cur_poc)
+				list[1][ptr1++] = sorted[c->ref_count - 1 - i];
 		}
 
-		split_ref_fields(h->RefPicList0, sorted[0], c->ref_count, cur_field);
-		split_ref_fields(h->RefPicList1, sorted[1], c->ref_count, cur_field);
+		memset(c->default_list_b, 0, sizeof(c->default_list_b));
+		split_ref_fields(c->default_list_b[0], list[0], c->ref_count, cur_field);
+		split_ref_fields(c->default_list_b[1], list[1], c->ref_count, cur_field);
+	}
+
+	c->default_lists_built |= 1 << slice_type;
+	c->default_lists_field = cur_field;
+}
+
+static void fill_default_ref_pic_list(h264_context_t *c)
+{
+	h264_header_t *h = &c->header;
+	int cur_field = h->field_pic_flag ? (h->bottom_field_flag ? PIC_BOTTOM_FIELD : PIC_TOP_FIELD) : PIC_FRAME;
+
+	if (h->slice_type != SLICE_TYPE_P && h->slice_type != SLICE_TYPE_B)
+		return;
+
+	if (c->default_lists_field != cur_field)
+		c->default_lists_built = 0;
+
+	if (!(c->default_lists_built & (1 << h->slice_type)))
+		build_default_ref_pic_lists(c, h->slice_type, cur_field);
+
+	if (h->slice_type == SLICE_TYPE_P)
+	{
+		memcpy(h->RefPicList0, c->default_list_p, sizeof(h->RefPicList0));
+	}
+	else
+	{
+		memcpy(h->RefPicList0, c->default_list_b[0], sizeof(h->RefPicList0));
+		memcpy(h->RefPicList1, c->default_list_b[1], sizeof(h->RefPicList1));
 	}
 }
 
@@ -625,7 +886,43 @@ static void decode_slice_header(h264_context_t *c)
 }
 
 
-static int fill_frame_lists(h264_context_t *c)
+/*
+ * Only rewrite the slots of the SRAM frame buffer list that differ from
+ * what was written for the previous picture. Usually that is just the
+ * slot of the new output picture.
+ */
+static void write_frame_list(h264_context_t *c, uint32_t list[18][8], unsigned int generation)
+{
+	int i, j, next = -1;
+
+	if (c->frame_list_generation != generation)
+	{
+		memset(c->frame_list, 0xff, sizeof(c->frame_list));
+		c->frame_list_generation = generation;
+	}
+
+	for (i = 0; i < 18; i++)
+	{
+		if (memcmp(c->frame_list[i], list[i], sizeof(c->frame_list[i])) == 0)
+		{
+			c->frame_list_slots_reused++;
+			continue;
+		}
+
+		// the write pointer auto-increments, only set it after a gap
+		if (i != next)
+			writel(VE_SRAM_H264_FRAMEBUFFER_LIST + i * 0x20, c->regs + VE_H264_RAM_WRITE_PTR);
+
+		for (j = 0; j < 8; j++)
+			writel(list[i][j], c->regs + VE_H264_RAM_WRITE_DATA);
+
+		memcpy(c->frame_list[i], list[i], sizeof(c->frame_list[i]));
+		c->frame_list_slots_written++;
+		next = i + 1;
+	}
+}
+
+static int fill_frame_lists(h264_context_t *c, unsigned int generation)
 {
 	int i;
 	h264_video_private_t *output_p = (h264_video_private_t *)c->output->decoder_private;
@@ -665,47 +962,42 @@ static int fill_frame_lists(h264_context_t *c)
 		}
 	}
 
-	// write picture buffer list
-	writel(VE_SRAM_H264_FRAMEBUFFER_LIST, c->regs + VE_H264_RAM_WRITE_PTR);
+	// build picture buffer list
+	uint32_t list[18][8];
+	memset(list, 0, sizeof(list));
 
 	for (i = 0; i < 18; i++)
 	{
 		if (!output_placed && !frame_list[i])
 		{
-			writel((uint16_t)c->info->field_order_cnt[0], c->regs + VE_H264_RAM_WRITE_DATA);
-			writel((uint16_t)c->info->field_order_cnt[1], c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(output_p->pic_type << 8, c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(cedrus_mem_get_bus_addr(c->output->rec), c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(cedrus_mem_get_bus_addr(c->output->rec) + c->output->luma_size, c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(cedrus_mem_get_bus_addr(output_p->extra_data), c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(cedrus_mem_get_bus_addr(output_p->extra_data) + c->video_extra_data_len, c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(0, c->regs + VE_H264_RAM_WRITE_DATA);
+			list[i][0] = (uint16_t)c->info->field_order_cnt[0];
+			list[i][1] = (uint16_t)c->info->field_order_cnt[1];
+			list[i][2] = output_p->pic_type << 8;
+			list[i][3] = cedrus_mem_get_bus_addr(c->output->rec);
+			list[i][4] = cedrus_mem_get_bus_addr(c->output->rec) + c->output->luma_size;
+			list[i][5] = cedrus_mem_get_bus_addr(output_p->extra_data);
+			list[i][6] = cedrus_mem_get_bus_addr(output_p->extra_data) + c->video_extra_data_len;
 
 			output_p->pos = i;
 			output_placed = 1;
 		}
-		else if (!frame_list[i])
-		{
-			int j;
-			for (j = 0; j < 8; j++)
-				writel(0x0, c->regs + VE_H264_RAM_WRITE_DATA);
-		}
-		else
+		else if (frame_list[i])
 		{
 			video_surface_ctx_t *surface = frame_list[i]->surface;
 			h264_video_private_t *surface_p = (h264_video_private_t *)surface->decoder_private;
 
-			writel(frame_list[i]->top_pic_order_cnt, c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(frame_list[i]->bottom_pic_order_cnt, c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(surface_p->pic_type << 8, c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(cedrus_mem_get_bus_addr(surface->rec), c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(cedrus_mem_get_bus_addr(surface->rec) + surface->luma_size, c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(cedrus_mem_get_bus_addr(surface_p->extra_data), c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(cedrus_mem_get_bus_addr(surface_p->extra_data) + c->video_extra_data_len, c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(0, c->regs + VE_H264_RAM_WRITE_DATA);
+			list[i][0] = frame_list[i]->top_pic_order_cnt;
+			list[i][1] = frame_list[i]->bottom_pic_order_cnt;
+			list[i][2] = surface_p->pic_type << 8;
+			list[i][3] = cedrus_mem_get_bus_addr(surface->rec);
+			list[i][4] = cedrus_mem_get_bus_addr(surface->rec) + surface->luma_size;
+			list[i][5] = cedrus_mem_get_bus_addr(surface_p->extra_data);
+			list[i][6] = cedrus_mem_get_bus_addr(surface_p->extra_data) + c->video_extra_data_len;
 		}
 	}
 
+	write_frame_list(c, list, generation);
+
 	// output index
 	writel(output_p->pos, c->regs + VE_H264_OUTPUT_FRAME_IDX);
 
@@ -730,6 +1022,34 @@ static int check_scaling_lists(h264_context_t *c)
 	return 1;
 }
 
+/*
+ * Number of macroblocks of the slice starting at first_mb_in_slice,
+ * up to the first macroblock of the slice in the NAL unit at next, or
+ * to the end of the picture if there is none.
+ */
+static uint32_t slice_mbs(h264_context_t *c, decoder_ctx_t *decoder, int len, int next, uint32_t first_mb_in_slice)
+{
+	const uint8_t *data = cedrus_mem_get_pointer(decoder->data);
+	h264_video_private_t *output_p = (h264_video_private_t *)c->output->decoder_private;
+	uint32_t mb_scale = output_p->pic_type == PIC_TYPE_MBAFF ? 2 : 1;
+	uint32_t end = (c->picture_width_in_mbs_minus1 + 1) * (c->picture_height_in_mbs_minus1 + 1);
+	bitstream_t bs;
+
+	if (!c->info->frame_mbs_only_flag && !c->info->field_pic_flag)
+		end *= 2;
+
+	int pos = find_nal_unit(data, len, &next, decoder->nal_length_size);
+	if (pos != -1)
+	{
+		bs_init(&bs, data + pos + 1, len - pos - 1, 1);
+		uint32_t next_mb = bs_get_ue(&bs) * mb_scale;
+		if (!bs_overrun(&bs) && next_mb > first_mb_in_slice * mb_scale && next_mb < end)
+			end = next_mb;
+	}
+
+	return end - min(first_mb_in_slice * mb_scale, end);
+}
+
 static VdpStatus h264_decode(decoder_ctx_t *decoder,
                              VdpPictureInfo const *_info,
                              const int len,
@@ -738,30 +1058,34 @@ static VdpStatus h264_decode(decoder_ctx_t *decoder,
 	h264_private_t *decoder_p = (h264_private_t *)decoder->private;
 	VdpPictureInfoH264 const *info = (VdpPictureInfoH264 const *)_info;
 
+	if (decoder_skip_picture(decoder, info->is_reference))
+		return VDP_STATUS_OK;
+
 	VdpStatus ret = yuv_prepare(output);
 	if (ret != VDP_STATUS_OK)
 		return ret;
 
+	video_surface_ctx_t *sdrot;
+	uint32_t sdrot_ctrl;
+	ret = sdrot_prepare(decoder, output, &sdrot, &sdrot_ctrl);
+	if (ret != VDP_STATUS_OK)
+		return ret;
+
 	ret = rec_prepare(output);
 	if (ret != VDP_STATUS_OK)
 		return ret;
 
-	h264_context_t *c = calloc(1, sizeof(h264_context_t));
-	c->picture_width_in_mbs_minus1 = (decoder->width - 1) / 16;
-	if (!info->frame_mbs_only_flag)
-		c->picture_height_in_mbs_minus1 = ((decoder->height / 2) - 1) / 16;
-	else
-		c->picture_height_in_mbs_minus1 = (decoder->height - 1) / 16;
+	h264_context_t *c = &decoder_p->context;
+	c->picture_height_in_mbs_minus1 = info->frame_mbs_only_flag ? c->frame_height_in_mbs_minus1 : c->field_height_in_mbs_minus1;
 	c->info = info;
 	c->output = output;
-	c->video_extra_data_len = ((decoder->width + 15) / 16) * ((decoder->height + 15) / 16) * 32;
+	c->ref_count = 0;
+	c->default_lists_built = 0;
+	c->bypass_deblocking = decoder_bypass_deblocking(decoder, info->is_reference);
 
 	h264_video_private_t *output_p = get_surface_priv(c, output);
 	if (!output_p)
-	{
-		ret = VDP_STATUS_RESOURCES;
-		goto err_free;
-	}
+		return VDP_STATUS_RESOURCES;
 
 	if (info->field_pic_flag)
 		output_p->pic_type = PIC_TYPE_FIELD;
@@ -771,59 +1095,78 @@ static VdpStatus h264_decode(decoder_ctx_t *decoder,
 		output_p->pic_type = PIC_TYPE_FRAME;
 
 	// activate H264 engine
-	c->regs = cedrus_ve_get(decoder->device->cedrus, CEDRUS_ENGINE_H264, (decoder->width >= 2048 ? 0x1 : 0x0) << 21);
+	c->regs = decoder_ve_get(decoder, CEDRUS_ENGINE_H264, (decoder->width >= 2048 ? 0x1 : 0x0) << 21);
 
 	// some buffers
 	uint32_t extra_buffers = cedrus_mem_get_bus_addr(decoder_p->extra_data);
-	writel(extra_buffers, c->regs + VE_H264_EXTRA_BUFFER1);
-	writel(extra_buffers + 0x48000, c->regs + VE_H264_EXTRA_BUFFER2);
-	if (cedrus_get_ve_version(decoder->device->cedrus) == 0x1625 || decoder->width >= 2048)
+	shadow_writel(&decoder->shadow, extra_buffers, VE_H264_EXTRA_BUFFER1);
+	shadow_writel(&decoder->shadow, extra_buffers + 0x48000, VE_H264_EXTRA_BUFFER2);
+	if (c->ve_version == 0x1625 || decoder->width >= 2048)
 	{
-		int size = (c->picture_width_in_mbs_minus1 + 32) * 192;
-		size = (size + 4095) & ~4095;
-		writel(decoder->width >= 2048 ? 0x5 : 0xa, c->regs + 0x50);
-		writel(extra_buffers + 0x50000, c->regs + 0x54);
-		writel(extra_buffers + 0x50000 + size, c->regs + 0x58);
+		shadow_writel(&decoder->shadow, decoder->width >= 2048 ? 0x5 : 0xa, 0x50);
+		shadow_writel(&decoder->shadow, extra_buffers + 0x50000, 0x54);
+		shadow_writel(&decoder->shadow, extra_buffers + 0x50000 + c->extra_buffer_size, 0x58);
 	}
 
-	// write custom scaling lists
+	// write custom scaling lists, unless the SRAM still holds them
 	if (!(c->default_scaling_lists = check_scaling_lists(c)))
 	{
-		const uint32_t *sl4 = (uint32_t *)&c->info->scaling_lists_4x4[0][0];
-		const uint32_t *sl8 = (uint32_t *)&c->info->scaling_lists_8x8[0][0];
+		if (decoder_p->scaling_lists_generation != decoder->shadow.generation
+			|| memcmp(decoder_p->scaling_lists_4x4, info->scaling_lists_4x4, sizeof(decoder_p->scaling_lists_4x4)) != 0
+			|| memcmp(decoder_p->scaling_lists_8x8, info->scaling_lists_8x8, sizeof(decoder_p->scaling_lists_8x8)) != 0)
+		{
+			const uint32_t *sl4 = (uint32_t *)&c->info->scaling_lists_4x4[0][0];
+			const uint32_t *sl8 = (uint32_t *)&c->info->scaling_lists_8x8[0][0];
 
-		writel(VE_SRAM_H264_SCALING_LISTS, c->regs + VE_H264_RAM_WRITE_PTR);
+			writel(VE_SRAM_H264_SCALING_LISTS, c->regs + VE_H264_RAM_WRITE_PTR);
 
-		int i;
-		for (i = 0; i < 2 * 64 / 4; i++)
-			writel(sl8[i], c->regs + VE_H264_RAM_WRITE_DATA);
+			int i;
+			for (i = 0; i < 2 * 64 / 4; i++)
+				writel(sl8[i], c->regs + VE_H264_RAM_WRITE_DATA);
+
+			for (i = 0; i < 6 * 16 / 4; i++)
+				writel(sl4[i], c->regs + VE_H264_RAM_WRITE_DATA);
 
-		for (i = 0; i < 6 * 16 / 4; i++)
-			writel(sl4[i], c->regs + VE_H264_RAM_WRITE_DATA);
+			memcpy(decoder_p->scaling_lists_4x4, info->scaling_lists_4x4, sizeof(decoder_p->scaling_lists_4x4));
+			memcpy(decoder_p->scaling_lists_8x8, info->scaling_lists_8x8, sizeof(decoder_p->scaling_lists_8x8));
+			decoder_p->scaling_lists_generation = decoder->shadow.generation;
+			decoder_p->scaling_lists_uploaded++;
+		}
+		else
+			decoder_p->scaling_lists_reused++;
 	}
 
 	// sdctrl
-	writel(0x00000000, c->regs + VE_H264_SDROT_CTRL);
-	if (cedrus_get_ve_version(decoder->device->cedrus) >= 0x1680)
+	shadow_writel(&decoder->shadow, sdrot_ctrl, VE_H264_SDROT_CTRL);
+	if (c->ve_version >= 0x1680 || sdrot_ctrl)
 	{
-		writel(cedrus_mem_get_bus_addr(c->output->yuv->data), c->regs + VE_H264_SDROT_LUMA);
-		writel(cedrus_mem_get_bus_addr(c->output->yuv->data) + c->output->luma_size, c->regs + VE_H264_SDROT_CHROMA);
-		writel((0x2 << 30) | (0x1 << 28) | (c->output->chroma_size / 2), c->regs + VE_EXTRA_OUT_FMT_OFFSET);
+		shadow_writel(&decoder->shadow, cedrus_mem_get_bus_addr(sdrot->yuv->data), VE_H264_SDROT_LUMA);
+		shadow_writel(&decoder->shadow, cedrus_mem_get_bus_addr(sdrot->yuv->data) + sdrot->luma_size, VE_H264_SDROT_CHROMA);
 	}
+	if (c->ve_version >= 0x1680)
+		shadow_writel(&decoder->shadow, (0x2 << 30) | (0x1 << 28) | (sdrot->chroma_size / 2), VE_EXTRA_OUT_FMT_OFFSET);
 
-	if (!fill_frame_lists(c))
+	if (!fill_frame_lists(c, decoder->shadow.generation))
 	{
 		ret = VDP_STATUS_ERROR;
 		goto err_ve_put;
 	}
 
-	unsigned int slice, pos = 0;
+	mv_pool_return_unused(c);
+
+	unsigned int slice;
+	int pos, next = 0;
 	for (slice = 0; slice < info->slice_count; slice++)
 	{
 		h264_header_t *h = &c->header;
 		memset(h, 0, sizeof(h264_header_t));
 
-		pos = find_startcode(cedrus_mem_get_pointer(decoder->data), len, pos) + 3;
+		pos = find_nal_unit(cedrus_mem_get_pointer(decoder->data), len, &next, decoder->nal_length_size);
+		if (pos == -1)
+		{
+			ret = VDP_STATUS_ERROR;
+			goto err_ve_put;
+		}
 
 		h->nal_unit_type = ((uint8_t *)cedrus_mem_get_pointer(decoder->data))[pos++] & 0x1f;
 
@@ -834,13 +1177,13 @@ static VdpStatus h264_decode(decoder_ctx_t *decoder,
 		}
 
 		// Enable startcode detect and ??
-		writel((0x1 << 25) | (0x1 << 10) | ((cedrus_get_ve_version(decoder->device->cedrus) >= 0x1680) << 9), c->regs + VE_H264_CTRL);
+		writel((0x1 << 25) | (0x1 << 10) | ((c->ve_version >= 0x1680) << 9), c->regs + VE_H264_CTRL);
 
 		// input buffer
 		writel((len - pos) * 8, c->regs + VE_H264_VLD_LEN);
 		writel(pos * 8, c->regs + VE_H264_VLD_OFFSET);
 		uint32_t input_addr = cedrus_mem_get_bus_addr(decoder->data);
-		writel(input_addr + VBV_SIZE - 1, c->regs + VE_H264_VLD_END);
+		shadow_writel(&decoder->shadow, input_addr + VBV_SIZE - 1, VE_H264_VLD_END);
 		writel((input_addr & 0x0ffffff0) | (input_addr >> 28) | (0x7 << 28), c->regs + VE_H264_VLD_ADDR);
 
 		// ?? some sort of reset maybe
@@ -919,7 +1262,7 @@ static VdpStatus h264_decode(decoder_ctx_t *decoder,
 		writel(((h->num_ref_idx_l0_active_minus1 & 0x1f) << 24)
 			| ((h->num_ref_idx_l1_active_minus1 & 0x1f) << 16)
 			| ((h->num_ref_idx_active_override_flag & 0x1) << 12)
-			| ((h->disable_deblocking_filter_idc & 0x3) << 8)
+			| (((c->bypass_deblocking ? 1 : h->disable_deblocking_filter_idc) & 0x3) << 8)
 			| ((h->slice_alpha_c0_offset_div2 & 0xf) << 4)
 			| ((h->slice_beta_offset_div2 & 0xf) << 0)
 			, c->regs + VE_H264_SLICE_HDR2);
@@ -939,21 +1282,20 @@ static VdpStatus h264_decode(decoder_ctx_t *decoder,
 		// SHOWTIME
 		writel(0x8, c->regs + VE_H264_TRIGGER);
 
-		cedrus_ve_wait(decoder->device->cedrus, 1);
+		ret = decoder_ve_wait(decoder, c->regs + VE_H264_STATUS, 0x7, slice_mbs(c, decoder, len, next, h->first_mb_in_slice));
 
 		// clear status flags
 		writel(readl(c->regs + VE_H264_STATUS), c->regs + VE_H264_STATUS);
 
-		pos = (readl(c->regs + VE_H264_VLD_OFFSET) / 8) - 3;
+		if (ret != VDP_STATUS_OK)
+			goto err_ve_put;
 	}
 
 	ret = VDP_STATUS_OK;
 
 err_ve_put:
 	// stop H264 engine
-	cedrus_ve_put(decoder->device->cedrus);
-err_free:
-	free(c);
+	decoder_ve_put(decoder);
 	return ret;
 }
 
@@ -972,13 +1314,31 @@ VdpStatus new_decoder_h264(decoder_ctx_t *decoder)
 		extra_data_size += ((decoder->width - 1) / 16 + 64) * 80;
 	}
 
-	decoder_p->extra_data = cedrus_mem_alloc(decoder->device->cedrus, extra_data_size);
+	decoder_p->extra_data = device_mem_alloc(decoder->device, extra_data_size, MEM_CODEC, decoder);
 	if (!decoder_p->extra_data)
 	{
 		free(decoder_p);
 		return VDP_STATUS_RESOURCES;
 	}
 
+	h264_context_t *c = &decoder_p->context;
+	c->ve_version = cedrus_get_ve_version(decoder->device->cedrus);
+	c->picture_width_in_mbs_minus1 = (decoder->width - 1) / 16;
+	c->frame_height_in_mbs_minus1 = (decoder->height - 1) / 16;
+	c->field_height_in_mbs_minus1 = ((decoder->height / 2) - 1) / 16;
+	c->video_extra_data_len = ((decoder->width + 15) / 16) * ((decoder->height + 15) / 16) * 32;
+	c->extra_buffer_size = ALIGN((c->picture_width_in_mbs_minus1 + 32) * 192, 4096);
+	c->mv_pool = mv_pool_create(decoder->device, c->video_extra_data_len * 2);
+	if (!c->mv_pool)
+	{
+		device_mem_free(decoder->device, decoder_p->extra_data);
+		free(decoder_p);
+		return VDP_STATUS_RESOURCES;
+	}
+
+	if (decoder->prewarm_frames)
+		mv_pool_prewarm(c->mv_pool, decoder->prewarm_frames);
+
 	decoder->decode = h264_decode;
 	decoder->private = decoder_p;
 	decoder->private_free = h264_private_free;
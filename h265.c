@@ -23,22 +23,9 @@
 #include <cedrus/cedrus.h>
 #include <cedrus/cedrus_regs.h>
 #include "vdpau_private.h"
-
-static int find_startcode(const uint8_t *data, int len, int start)
-{
-	int pos, zeros = 0;
-	for (pos = start; pos < len; pos++)
-	{
-		if (data[pos] == 0x00)
-			zeros++;
-		else if (data[pos] == 0x01 && zeros >= 2)
-			return pos + 1;
-		else
-			zeros = 0;
-	}
-
-	return -1;
-}
+#include "startcode.h"
+#include "bitstream.h"
+#include "h265_slice.h"
 
 static void skip_bits(void *regs, int num)
 {
@@ -51,37 +38,6 @@ static void skip_bits(void *regs, int num)
 	while (readl(regs + VE_HEVC_STATUS) & (1 << 8));
 }
 
-static uint32_t get_u(void *regs, int num)
-{
-	writel(0x2 | (num << 8), regs + VE_HEVC_TRIG);
-
-	while (readl(regs + VE_HEVC_STATUS) & (1 << 8));
-
-	return readl(regs + VE_HEVC_BITS_DATA);
-}
-
-static uint32_t get_ue(void *regs)
-{
-	writel(0x5, regs + VE_HEVC_TRIG);
-
-	while (readl(regs + VE_HEVC_STATUS) & (1 << 8));
-
-	return readl(regs + VE_HEVC_BITS_DATA);
-}
-
-static int32_t get_se(void *regs)
-{
-	writel(0x4, regs + VE_HEVC_TRIG);
-
-	while (readl(regs + VE_HEVC_STATUS) & (1 << 8));
-
-	return readl(regs + VE_HEVC_BITS_DATA);
-}
-
-#define SLICE_B	0
-#define SLICE_P	1
-#define SLICE_I	2
-
 #define MinCbLog2SizeY (p->info->log2_min_luma_coding_block_size_minus3 + 3)
 #define CtbLog2SizeY (MinCbLog2SizeY + p->info->log2_diff_max_min_luma_coding_block_size)
 #define CtbSizeY (1 << CtbLog2SizeY)
@@ -95,60 +51,13 @@ static int32_t get_se(void *regs)
 #define ChromaOffsetL0(i, j) (clamp(-128, 127, p->slice.delta_chroma_offset_l0[i][j] - ((128 * ChromaWeightL0(i, j)) >> ChromaLog2WeightDenom) + 128))
 #define ChromaOffsetL1(i, j) (clamp(-128, 127, p->slice.delta_chroma_offset_l1[i][j] - ((128 * ChromaWeightL1(i, j)) >> ChromaLog2WeightDenom) + 128))
 
-struct h265_slice_header {
-	uint8_t first_slice_segment_in_pic_flag;
-	uint8_t no_output_of_prior_pics_flag;
-	uint8_t slice_pic_parameter_set_id;
-	uint8_t dependent_slice_segment_flag;
-	uint16_t slice_segment_address;
-	uint8_t slice_type;
-	uint8_t pic_output_flag;
-	uint8_t colour_plane_id;
-	uint16_t slice_pic_order_cnt_lsb;
-	uint8_t short_term_ref_pic_set_sps_flag;
-
-	uint8_t slice_temporal_mvp_enabled_flag;
-	uint8_t	slice_sao_luma_flag;
-	uint8_t slice_sao_chroma_flag;
-	uint8_t num_ref_idx_active_override_flag;
-	uint8_t num_ref_idx_l0_active_minus1;
-	uint8_t num_ref_idx_l1_active_minus1;
-	uint8_t mvd_l1_zero_flag;
-	uint8_t cabac_init_flag;
-	uint8_t collocated_from_l0_flag;
-	uint8_t collocated_ref_idx;
-	uint8_t five_minus_max_num_merge_cand;
-	int8_t slice_qp_delta;
-	int8_t slice_cb_qp_offset;
-	int8_t slice_cr_qp_offset;
-	uint8_t deblocking_filter_override_flag;
-	uint8_t slice_deblocking_filter_disabled_flag;
-	int8_t slice_beta_offset_div2;
-	int8_t slice_tc_offset_div2;
-	uint8_t slice_loop_filter_across_slices_enabled_flag;
-	uint16_t num_entry_point_offsets;
-	uint8_t offset_len_minus1;
-	uint32_t entry_point_offset_minus1[256];
-
-	uint8_t ref_pic_list_modification_flag_l0;
-	uint8_t ref_pic_list_modification_flag_l1;
-	uint8_t list_entry_l0[16];
-	uint8_t list_entry_l1[16];
-
-	uint8_t luma_log2_weight_denom;
-	int8_t delta_chroma_log2_weight_denom;
-	uint8_t luma_weight_l0_flag[16];
-	uint8_t chroma_weight_l0_flag[16];
-	int8_t delta_luma_weight_l0[16];
-	int8_t luma_offset_l0[16];
-	int8_t delta_chroma_weight_l0[16][2];
-	int16_t delta_chroma_offset_l0[16][2];
-	uint8_t luma_weight_l1_flag[16];
-	uint8_t chroma_weight_l1_flag[16];
-	int8_t delta_luma_weight_l1[16];
-	int8_t luma_offset_l1[16];
-	int8_t delta_chroma_weight_l1[16][2];
-	int16_t delta_chroma_offset_l1[16][2];
+struct h265_ref_cache_entry
+{
+	VdpVideoSurface handle;
+	video_surface_ctx_t *surface;
+	uint32_t yuv_generation;
+	uint32_t extra_addr;
+	uint32_t luma_addr, chroma_addr;
 };
 
 struct h265_private
@@ -158,9 +67,35 @@ struct h265_private
 	decoder_ctx_t *decoder;
 	video_surface_ctx_t *output;
 	uint8_t nal_unit_type;
+	uint8_t bypass_deblocking;
+	bitstream_t bs;
+	int *nal_offsets;
+	int nal_offsets_size;
 
 	cedrus_mem_t *neighbor_info;
 	cedrus_mem_t *entry_points;
+	int entry_points_size;
+
+	struct
+	{
+		int valid;
+		uint64_t hash;
+		uint32_t dc_coef0, dc_coef1;
+		uint32_t sram[(6 * 64 + 2 * 64 + 6 * 64 + 6 * 16) / 4];
+
+		unsigned int uploaded_generation;
+		uint64_t uploaded_hash;
+		unsigned long uploaded, reused;
+	} scaling_lists;
+
+	struct
+	{
+		uint32_t surface_generation;
+		struct h265_ref_cache_entry entry[16];
+		uint32_t extra_addr;
+
+		unsigned long lookups, hits;
+	} ref_cache;
 
 	struct h265_slice_header slice;
 };
@@ -173,10 +108,14 @@ struct h265_video_private
 static void h265_video_private_free(video_surface_ctx_t *surface)
 {
 	struct h265_video_private *vp = surface->decoder_private;
-	cedrus_mem_free(vp->extra_data);
+	device_mem_free(surface->device, vp->extra_data);
 	free(vp);
 }
 
+/*
+ * The motion vector buffer is sized by the CTB count of the picture, so
+ * unlike the H.264 ones it can't be prewarmed at vdp_decoder_create().
+ */
 static struct h265_video_private *get_surface_priv(struct h265_private *p, video_surface_ctx_t *surface)
 {
 	struct h265_video_private *vp = surface->decoder_private;
@@ -187,7 +126,7 @@ static struct h265_video_private *get_surface_priv(struct h265_private *p, video
 		if (!vp)
 			return NULL;
 
-		vp->extra_data = cedrus_mem_alloc(surface->device->cedrus, PicSizeInCtbsY * 160);
+		vp->extra_data = device_mem_alloc(surface->device, PicSizeInCtbsY * 160, MEM_MV, surface);
 		if (!vp->extra_data)
 		{
 			free(vp);
@@ -201,226 +140,104 @@ static struct h265_video_private *get_surface_priv(struct h265_private *p, video
 	return vp;
 }
 
-static void pred_weight_table(struct h265_private *p)
+static void release_ref_cache_entry(struct h265_ref_cache_entry *e)
 {
-	int i, j;
-
-	p->slice.luma_log2_weight_denom = get_ue(p->regs);
-	if (p->info->chroma_format_idc != 0)
-		p->slice.delta_chroma_log2_weight_denom = get_se(p->regs);
-
-	for (i = 0; i <= p->slice.num_ref_idx_l0_active_minus1; i++)
-		p->slice.luma_weight_l0_flag[i] = get_u(p->regs, 1);
-
-	if (p->info->chroma_format_idc != 0)
-		for (i = 0; i <= p->slice.num_ref_idx_l0_active_minus1; i++)
-			p->slice.chroma_weight_l0_flag[i] = get_u(p->regs, 1);
-
-	for (i = 0; i <= p->slice.num_ref_idx_l0_active_minus1; i++)
-	{
-		if (p->slice.luma_weight_l0_flag[i])
-		{
-			p->slice.delta_luma_weight_l0[i] = get_se(p->regs);
-			p->slice.luma_offset_l0[i] = get_se(p->regs);
-		}
-
-		if (p->slice.chroma_weight_l0_flag[i])
-		{
-			for (j = 0; j < 2; j++)
-			{
-				p->slice.delta_chroma_weight_l0[i][j] = get_se(p->regs);
-				p->slice.delta_chroma_offset_l0[i][j] = get_se(p->regs);
-			}
-		}
-	}
-
-	if (p->slice.slice_type == SLICE_B)
-	{
-		for (i = 0; i <= p->slice.num_ref_idx_l1_active_minus1; i++)
-			p->slice.luma_weight_l1_flag[i] = get_u(p->regs, 1);
-
-		if (p->info->chroma_format_idc != 0)
-			for (i = 0; i <= p->slice.num_ref_idx_l1_active_minus1; i++)
-				p->slice.chroma_weight_l1_flag[i] = get_u(p->regs, 1);
-
-		for (i = 0; i <= p->slice.num_ref_idx_l1_active_minus1; i++)
-		{
-			if (p->slice.luma_weight_l1_flag[i])
-			{
-				p->slice.delta_luma_weight_l1[i] = get_se(p->regs);
-				p->slice.luma_offset_l1[i] = get_se(p->regs);
-			}
-
-			if (p->slice.chroma_weight_l1_flag[i])
-			{
-				for (j = 0; j < 2; j++)
-				{
-					p->slice.delta_chroma_weight_l1[i][j] = get_se(p->regs);
-					p->slice.delta_chroma_offset_l1[i][j] = get_se(p->regs);
-				}
-			}
-		}
-	}
-}
-
-static void ref_pic_lists_modification(struct h265_private *p)
-{
-	int i;
-
-	p->slice.ref_pic_list_modification_flag_l0 = get_u(p->regs, 1);
-
-	if (p->slice.ref_pic_list_modification_flag_l0)
-		for (i = 0; i <= p->slice.num_ref_idx_l0_active_minus1; i++)
-			p->slice.list_entry_l0[i] = get_u(p->regs, ceil_log2(p->info->NumPocTotalCurr));
-
-	if (p->slice.slice_type == SLICE_B)
-	{
-		p->slice.ref_pic_list_modification_flag_l1 = get_u(p->regs, 1);
-
-		if (p->slice.ref_pic_list_modification_flag_l1)
-			for (i = 0; i <= p->slice.num_ref_idx_l1_active_minus1; i++)
-				p->slice.list_entry_l1[i] = get_u(p->regs, ceil_log2(p->info->NumPocTotalCurr));
-	}
+	sfree(e->surface);
+	e->surface = NULL;
+	e->handle = VDP_INVALID_HANDLE;
 }
 
-static void slice_header(struct h265_private *p)
+/*
+ * Resolve the RefPics handles to bus addresses once per picture. Surfaces
+ * still referenced from the previous picture are taken from the cache
+ * without going through the handle table, their yuv addresses are only
+ * looked up again if yuv_prepare() gave them a new buffer. Destroying any
+ * video surface flushes the cache, since its handle may be reused.
+ */
+static VdpStatus update_ref_cache(struct h265_private *p)
 {
-	int i;
-
-	p->slice.first_slice_segment_in_pic_flag = get_u(p->regs, 1);
-
-	if (p->nal_unit_type >= 16 && p->nal_unit_type <= 23)
-		p->slice.no_output_of_prior_pics_flag = get_u(p->regs, 1);
+	struct h265_ref_cache_entry old[16];
+	uint32_t generation = p->decoder->device->surface_generation;
+	VdpStatus ret = VDP_STATUS_OK;
+	int i, j;
 
-	p->slice.slice_pic_parameter_set_id = get_ue(p->regs);
+	memcpy(old, p->ref_cache.entry, sizeof(old));
 
-	if (!p->slice.first_slice_segment_in_pic_flag)
+	if (generation != p->ref_cache.surface_generation)
 	{
-		if (p->info->dependent_slice_segments_enabled_flag)
-			p->slice.dependent_slice_segment_flag = get_u(p->regs, 1);
+		for (j = 0; j < 16; j++)
+			release_ref_cache_entry(&old[j]);
 
-		p->slice.slice_segment_address = get_u(p->regs, ceil_log2(PicSizeInCtbsY));
+		p->ref_cache.surface_generation = generation;
 	}
 
-	if (!p->slice.dependent_slice_segment_flag)
+	for (i = 0; i < 16; i++)
 	{
-		p->slice.pic_output_flag = 1;
-		p->slice.num_ref_idx_l0_active_minus1 = p->info->num_ref_idx_l0_default_active_minus1;
-		p->slice.num_ref_idx_l1_active_minus1 = p->info->num_ref_idx_l1_default_active_minus1;
-		p->slice.collocated_from_l0_flag = 1;
-		p->slice.collocated_ref_idx = 0;
-		p->slice.slice_deblocking_filter_disabled_flag = p->info->pps_deblocking_filter_disabled_flag;
-		p->slice.slice_beta_offset_div2 = p->info->pps_beta_offset_div2;
-		p->slice.slice_tc_offset_div2 = p->info->pps_tc_offset_div2;
-		p->slice.slice_loop_filter_across_slices_enabled_flag = p->info->pps_loop_filter_across_slices_enabled_flag;
-
-		skip_bits(p->regs, p->info->num_extra_slice_header_bits);
-
-		p->slice.slice_type = get_ue(p->regs);
-
-		if (p->info->output_flag_present_flag)
-			p->slice.pic_output_flag = get_u(p->regs, 1);
+		struct h265_ref_cache_entry *e = &p->ref_cache.entry[i];
 
-		if (p->info->separate_colour_plane_flag == 1)
-			p->slice.colour_plane_id = get_u(p->regs, 2);
+		e->handle = p->info->RefPics[i];
+		e->surface = NULL;
 
-		if (p->nal_unit_type != 19 && p->nal_unit_type != 20)
-		{
-			p->slice.slice_pic_order_cnt_lsb = get_u(p->regs, p->info->log2_max_pic_order_cnt_lsb_minus4 + 4);
-
-			p->slice.short_term_ref_pic_set_sps_flag = get_u(p->regs, 1);
-
-			skip_bits(p->regs, p->info->NumShortTermPictureSliceHeaderBits);
+		if (e->handle == VDP_INVALID_HANDLE || ret != VDP_STATUS_OK)
+			continue;
 
-			if (p->info->long_term_ref_pics_present_flag)
-				skip_bits(p->regs, p->info->NumLongTermPictureSliceHeaderBits);
-
-			if (p->info->sps_temporal_mvp_enabled_flag)
-				p->slice.slice_temporal_mvp_enabled_flag = get_u(p->regs, 1);
-		}
-
-		if (p->info->sample_adaptive_offset_enabled_flag)
+		for (j = 0; j < 16; j++)
 		{
-			p->slice.slice_sao_luma_flag = get_u(p->regs, 1);
-			p->slice.slice_sao_chroma_flag = get_u(p->regs, 1);
+			if (old[j].surface && old[j].handle == e->handle)
+			{
+				*e = old[j];
+				old[j].surface = NULL;
+				p->ref_cache.hits++;
+				break;
+			}
 		}
 
-		if (p->slice.slice_type == SLICE_P || p->slice.slice_type == SLICE_B)
+		if (!e->surface)
 		{
-			p->slice.num_ref_idx_active_override_flag = get_u(p->regs, 1);
+			p->ref_cache.lookups++;
 
-			if (p->slice.num_ref_idx_active_override_flag)
+			e->surface = handle_get(e->handle);
+			if (!e->surface)
 			{
-				p->slice.num_ref_idx_l0_active_minus1 = get_ue(p->regs);
-				if (p->slice.slice_type == SLICE_B)
-					p->slice.num_ref_idx_l1_active_minus1 = get_ue(p->regs);
+				e->handle = VDP_INVALID_HANDLE;
+				ret = VDP_STATUS_INVALID_HANDLE;
+				continue;
 			}
 
-			if (p->info->lists_modification_present_flag && p->info->NumPocTotalCurr > 1)
-				ref_pic_lists_modification(p);
-
-			if (p->slice.slice_type == SLICE_B)
-				p->slice.mvd_l1_zero_flag = get_u(p->regs, 1);
-
-			if (p->info->cabac_init_present_flag)
-				p->slice.cabac_init_flag = get_u(p->regs, 1);
-
-			if (p->slice.slice_temporal_mvp_enabled_flag)
+			struct h265_video_private *vp = get_surface_priv(p, e->surface);
+			if (!vp)
 			{
-				if (p->slice.slice_type == SLICE_B)
-					p->slice.collocated_from_l0_flag = get_u(p->regs, 1);
-
-				if ((p->slice.collocated_from_l0_flag && p->slice.num_ref_idx_l0_active_minus1 > 0) || (!p->slice.collocated_from_l0_flag && p->slice.num_ref_idx_l1_active_minus1 > 0))
-					p->slice.collocated_ref_idx = get_ue(p->regs);
+				release_ref_cache_entry(e);
+				ret = VDP_STATUS_RESOURCES;
+				continue;
 			}
 
-			if ((p->info->weighted_pred_flag && p->slice.slice_type == SLICE_P) || (p->info->weighted_bipred_flag && p->slice.slice_type == SLICE_B))
-				pred_weight_table(p);
-
-			p->slice.five_minus_max_num_merge_cand = get_ue(p->regs);
+			e->extra_addr = cedrus_mem_get_bus_addr(vp->extra_data);
+			e->yuv_generation = e->surface->yuv_generation - 1;
 		}
 
-		p->slice.slice_qp_delta = get_se(p->regs);
-
-		if (p->info->pps_slice_chroma_qp_offsets_present_flag)
+		if (e->yuv_generation != e->surface->yuv_generation)
 		{
-			p->slice.slice_cb_qp_offset = get_se(p->regs);
-			p->slice.slice_cr_qp_offset = get_se(p->regs);
+			e->luma_addr = cedrus_mem_get_bus_addr(e->surface->yuv->data);
+			e->chroma_addr = e->luma_addr + e->surface->luma_size;
+			e->yuv_generation = e->surface->yuv_generation;
 		}
-
-		if (p->info->deblocking_filter_override_enabled_flag)
-			p->slice.deblocking_filter_override_flag = get_u(p->regs, 1);
-
-		if (p->slice.deblocking_filter_override_flag)
-		{
-			p->slice.slice_deblocking_filter_disabled_flag = get_u(p->regs, 1);
-
-			if (!p->slice.slice_deblocking_filter_disabled_flag)
-			{
-				p->slice.slice_beta_offset_div2 = get_se(p->regs);
-				p->slice.slice_tc_offset_div2 = get_se(p->regs);
-			}
-		}
-
-		if (p->info->pps_loop_filter_across_slices_enabled_flag && (p->slice.slice_sao_luma_flag || p->slice.slice_sao_chroma_flag || !p->slice.slice_deblocking_filter_disabled_flag))
-			p->slice.slice_loop_filter_across_slices_enabled_flag = get_u(p->regs, 1);
 	}
 
-	if (p->info->tiles_enabled_flag || p->info->entropy_coding_sync_enabled_flag)
-	{
-		p->slice.num_entry_point_offsets = get_ue(p->regs);
+	for (j = 0; j < 16; j++)
+		if (old[j].surface)
+			release_ref_cache_entry(&old[j]);
 
-		if (p->slice.num_entry_point_offsets > 0)
-		{
-			p->slice.offset_len_minus1 = get_ue(p->regs);
+	if (ret != VDP_STATUS_OK)
+		return ret;
 
-			for (i = 0; i < p->slice.num_entry_point_offsets; i++)
-				p->slice.entry_point_offset_minus1[i] = get_u(p->regs, p->slice.offset_len_minus1 + 1);
-		}
-	}
+	struct h265_video_private *vp = get_surface_priv(p, p->output);
+	if (!vp)
+		return VDP_STATUS_RESOURCES;
 
-	if (p->info->slice_segment_header_extension_present_flag)
-		skip_bits(p->regs, get_ue(p->regs) * 8);
+	p->ref_cache.extra_addr = cedrus_mem_get_bus_addr(vp->extra_data);
+
+	return VDP_STATUS_OK;
 }
 
 static void write_pic_list(struct h265_private *p)
@@ -429,28 +246,25 @@ static void write_pic_list(struct h265_private *p)
 
 	for (i = 0; i < 16; i++)
 	{
-		if (p->info->RefPics[i] != VDP_INVALID_HANDLE)
-		{
-			smart video_surface_ctx_t *v = handle_get(p->info->RefPics[i]);
-			struct h265_video_private *vp = get_surface_priv(p, v);
+		struct h265_ref_cache_entry *e = &p->ref_cache.entry[i];
 
+		if (e->surface)
+		{
 			writel(VE_SRAM_HEVC_PIC_LIST + i * 0x20, p->regs + VE_HEVC_SRAM_ADDR);
 			writel(p->info->PicOrderCntVal[i], p->regs + VE_HEVC_SRAM_DATA);
 			writel(p->info->PicOrderCntVal[i], p->regs + VE_HEVC_SRAM_DATA);
-			writel(cedrus_mem_get_bus_addr(vp->extra_data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
-			writel(cedrus_mem_get_bus_addr(vp->extra_data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
-			writel(cedrus_mem_get_bus_addr(v->yuv->data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
-			writel((cedrus_mem_get_bus_addr(v->yuv->data) + v->luma_size) >> 8, p->regs + VE_HEVC_SRAM_DATA);
+			writel(e->extra_addr >> 8, p->regs + VE_HEVC_SRAM_DATA);
+			writel(e->extra_addr >> 8, p->regs + VE_HEVC_SRAM_DATA);
+			writel(e->luma_addr >> 8, p->regs + VE_HEVC_SRAM_DATA);
+			writel(e->chroma_addr >> 8, p->regs + VE_HEVC_SRAM_DATA);
 		}
 	}
 
-	struct h265_video_private *vp = get_surface_priv(p, p->output);
-
 	writel(VE_SRAM_HEVC_PIC_LIST + i * 0x20, p->regs + VE_HEVC_SRAM_ADDR);
 	writel(p->info->CurrPicOrderCntVal, p->regs + VE_HEVC_SRAM_DATA);
 	writel(p->info->CurrPicOrderCntVal, p->regs + VE_HEVC_SRAM_DATA);
-	writel(cedrus_mem_get_bus_addr(vp->extra_data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
-	writel(cedrus_mem_get_bus_addr(vp->extra_data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
+	writel(p->ref_cache.extra_addr >> 8, p->regs + VE_HEVC_SRAM_DATA);
+	writel(p->ref_cache.extra_addr >> 8, p->regs + VE_HEVC_SRAM_DATA);
 	writel(cedrus_mem_get_bus_addr(p->output->yuv->data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
 	writel((cedrus_mem_get_bus_addr(p->output->yuv->data) + p->output->luma_size) >> 8, p->regs + VE_HEVC_SRAM_DATA);
 
@@ -479,7 +293,7 @@ static void write_ref_pic_lists(struct h265_private *p)
 		for (i = 0; i < p->slice.num_ref_idx_l0_active_minus1 + 1; i += 4)
 		{
 			uint32_t list = 0;
-			for (j = 0; j < 4; j++)
+			for (j = 0; j < 4 && i + j <= p->slice.num_ref_idx_l0_active_minus1; j++)
 			{
 				int entry = i + j;
 				if (p->slice.ref_pic_list_modification_flag_l0)
@@ -511,7 +325,7 @@ static void write_ref_pic_lists(struct h265_private *p)
 		for (i = 0; i < p->slice.num_ref_idx_l1_active_minus1 + 1; i += 4)
 		{
 			uint32_t list = 0;
-			for (j = 0; j < 4; j++)
+			for (j = 0; j < 4 && i + j <= p->slice.num_ref_idx_l1_active_minus1; j++)
 			{
 				int entry = i + j;
 				if (p->slice.ref_pic_list_modification_flag_l1)
@@ -525,49 +339,94 @@ static void write_ref_pic_lists(struct h265_private *p)
 	}
 }
 
+static int tile_width(struct h265_private *p, int tx)
+{
+	return p->info->tiles_enabled_flag ? p->info->column_width_minus1[tx] + 1 : PicWidthInCtbsY;
+}
+
+static int tile_height(struct h265_private *p, int ty)
+{
+	return p->info->tiles_enabled_flag ? p->info->row_height_minus1[ty] + 1 : PicHeightInCtbsY;
+}
+
+// the entry point list holds 4 words per substream
+static int prepare_entry_point_list(struct h265_private *p)
+{
+	int size = ALIGN(p->slice.num_entry_point_offsets * 16, 4096);
+
+	if (size <= p->entry_points_size)
+		return 1;
+
+	device_mem_free(p->decoder->device, p->entry_points);
+	p->entry_points_size = 0;
+
+	p->entry_points = device_mem_alloc(p->decoder->device, size, MEM_CODEC, p->decoder);
+	if (!p->entry_points)
+		return 0;
+
+	p->entry_points_size = size;
+
+	return 1;
+}
+
+/*
+ * Each entry point starts a new substream. With tiles that is the next
+ * tile in raster order, with WPP the next CTB row of the current tile,
+ * and with both the next row until the tile is done. Without tiles the
+ * whole picture is a single tile.
+ */
 static void write_entry_point_list(struct h265_private *p)
 {
-	int i, x, tx, y, ty;
+	int i, x, tx, x0, y, ty, y0;
+	int columns = p->info->tiles_enabled_flag ? p->info->num_tile_columns_minus1 + 1 : 1;
+	int wpp = p->info->entropy_coding_sync_enabled_flag;
 
-	if (!p->info->tiles_enabled_flag)
+	if (!p->info->tiles_enabled_flag && !wpp)
 		return;
 
-	for (x = 0, tx = 0; tx < p->info->num_tile_columns_minus1 + 1; tx++)
-	{
-		if (x + p->info->column_width_minus1[tx] + 1 > (p->slice.slice_segment_address % PicWidthInCtbsY))
-			break;
+	x = p->slice.slice_segment_address % PicWidthInCtbsY;
+	y = p->slice.slice_segment_address / PicWidthInCtbsY;
 
-		x += p->info->column_width_minus1[tx] + 1;
-	}
+	for (x0 = 0, tx = 0; tx < columns - 1 && x0 + tile_width(p, tx) <= x; tx++)
+		x0 += tile_width(p, tx);
 
-	for (y = 0, ty = 0; ty < p->info->num_tile_rows_minus1 + 1; ty++)
-	{
-		if (y + p->info->row_height_minus1[ty] + 1 > (p->slice.slice_segment_address / PicWidthInCtbsY))
-			break;
+	for (y0 = 0, ty = 0; p->info->tiles_enabled_flag && ty < p->info->num_tile_rows_minus1 && y0 + tile_height(p, ty) <= y; ty++)
+		y0 += tile_height(p, ty);
 
-		y += p->info->row_height_minus1[ty] + 1;
+	if (p->info->tiles_enabled_flag)
+	{
+		writel((y0 << 16) | (x0 << 0), p->regs + VE_HEVC_TILE_START_CTB);
+		writel(((y0 + tile_height(p, ty) - 1) << 16) | ((x0 + tile_width(p, tx) - 1) << 0), p->regs + VE_HEVC_TILE_END_CTB);
 	}
 
-	writel((y << 16) | (x << 0), p->regs + VE_HEVC_TILE_START_CTB);
-	writel(((y + p->info->row_height_minus1[ty]) << 16) | ((x + p->info->column_width_minus1[tx]) << 0), p->regs + VE_HEVC_TILE_END_CTB);
+	if (p->slice.num_entry_point_offsets == 0)
+		return;
 
 	uint32_t *entry_points = cedrus_mem_get_pointer(p->entry_points);
 	for (i = 0; i < p->slice.num_entry_point_offsets; i++)
 	{
-		if (tx + 1 >= p->info->num_tile_columns_minus1 + 1)
+		if (wpp && y + 1 < y0 + tile_height(p, ty))
+		{
+			y++;
+		}
+		else if (tx + 1 >= columns)
 		{
-			x = tx = 0;
-			y += p->info->row_height_minus1[ty++] + 1;
+			tx = 0;
+			x0 = 0;
+			y0 += tile_height(p, ty++);
+			y = y0;
 		}
 		else
 		{
-			x += p->info->column_width_minus1[tx++] + 1;
+			x0 += tile_width(p, tx++);
+			y = y0;
 		}
+		x = x0;
 
 		entry_points[i * 4 + 0] = p->slice.entry_point_offset_minus1[i] + 1;
 		entry_points[i * 4 + 1] = 0x0;
 		entry_points[i * 4 + 2] = (y << 16) | (x << 0);
-		entry_points[i * 4 + 3] = ((y + p->info->row_height_minus1[ty]) << 16) | ((x + p->info->column_width_minus1[tx]) << 0);
+		entry_points[i * 4 + 3] = ((y0 + tile_height(p, ty) - 1) << 16) | ((x0 + tile_width(p, tx) - 1) << 0);
 	}
 
 	cedrus_mem_flush_cache(p->entry_points);
@@ -618,7 +477,47 @@ static void write_weighted_pred(struct h265_private *p)
 	}
 }
 
-static void write_scaling_lists(struct h265_private *p)
+static uint64_t hash_scaling_lists(VdpPictureInfoHEVC const *info)
+{
+	const uint8_t *lists[] = {
+		&info->ScalingList4x4[0][0], &info->ScalingList8x8[0][0],
+		&info->ScalingList16x16[0][0], &info->ScalingList32x32[0][0],
+		info->ScalingListDCCoeff16x16, info->ScalingListDCCoeff32x32,
+	};
+	const size_t sizes[] = {
+		sizeof(info->ScalingList4x4), sizeof(info->ScalingList8x8),
+		sizeof(info->ScalingList16x16), sizeof(info->ScalingList32x32),
+		sizeof(info->ScalingListDCCoeff16x16), sizeof(info->ScalingListDCCoeff32x32),
+	};
+
+	// 64 bit FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	unsigned int i, j;
+	for (i = 0; i < ARRAY_SIZE(lists); i++)
+		for (j = 0; j < sizes[i]; j++)
+			hash = (hash ^ lists[i][j]) * 0x100000001b3ULL;
+
+	return hash;
+}
+
+static void pack_scaling_list(uint32_t **dst, const uint8_t *list, const uint8_t *diag, int size)
+{
+	int j;
+	uint32_t word = 0x0;
+
+	for (j = 0; j < size; j++)
+	{
+		word |= list[diag[j]] << ((j % 4) * 8);
+
+		if (j % 4 == 3)
+		{
+			*(*dst)++ = word;
+			word = 0x0;
+		}
+	}
+}
+
+static void prepare_scaling_lists(struct h265_private *p)
 {
 	static const uint8_t diag4x4[16] = {
 		 0,  1,  3,  6,
@@ -638,77 +537,253 @@ static void write_scaling_lists(struct h265_private *p)
 		35, 42, 48, 53, 57, 60, 62, 63,
 	};
 
-	uint32_t i, j, word = 0x0;
+	uint64_t hash = hash_scaling_lists(p->info);
+	if (p->scaling_lists.valid && p->scaling_lists.hash == hash)
+		return;
 
-	writel((p->info->ScalingListDCCoeff32x32[1] << 24) |
+	p->scaling_lists.dc_coef0 = (p->info->ScalingListDCCoeff32x32[1] << 24) |
 		(p->info->ScalingListDCCoeff32x32[0] << 16) |
 		(p->info->ScalingListDCCoeff16x16[1] << 8) |
-		(p->info->ScalingListDCCoeff16x16[0] << 0), p->regs + VE_HEVC_SCALING_LIST_DC_COEF0);
+		(p->info->ScalingListDCCoeff16x16[0] << 0);
 
-	writel((p->info->ScalingListDCCoeff16x16[5] << 24) |
+	p->scaling_lists.dc_coef1 = (p->info->ScalingListDCCoeff16x16[5] << 24) |
 		(p->info->ScalingListDCCoeff16x16[4] << 16) |
 		(p->info->ScalingListDCCoeff16x16[3] << 8) |
-		(p->info->ScalingListDCCoeff16x16[2] << 0), p->regs + VE_HEVC_SCALING_LIST_DC_COEF1);
+		(p->info->ScalingListDCCoeff16x16[2] << 0);
 
-	writel(VE_SRAM_HEVC_SCALING_LISTS, p->regs + VE_HEVC_SRAM_ADDR);
+	uint32_t *dst = p->scaling_lists.sram;
+	int i;
 
 	for (i = 0; i < 6; i++)
+		pack_scaling_list(&dst, p->info->ScalingList8x8[i], diag8x8, 64);
+
+	for (i = 0; i < 2; i++)
+		pack_scaling_list(&dst, p->info->ScalingList32x32[i], diag8x8, 64);
+
+	for (i = 0; i < 6; i++)
+		pack_scaling_list(&dst, p->info->ScalingList16x16[i], diag8x8, 64);
+
+	for (i = 0; i < 6; i++)
+		pack_scaling_list(&dst, p->info->ScalingList4x4[i], diag4x4, 16);
+
+	p->scaling_lists.hash = hash;
+	p->scaling_lists.valid = 1;
+}
+
+static void write_scaling_lists(struct h265_private *p)
+{
+	ve_shadow_t *shadow = &p->decoder->shadow;
+
+	shadow_writel(shadow, p->scaling_lists.dc_coef0, VE_HEVC_SCALING_LIST_DC_COEF0);
+	shadow_writel(shadow, p->scaling_lists.dc_coef1, VE_HEVC_SCALING_LIST_DC_COEF1);
+
+	// SRAM still holds this set from a previous slice or picture
+	if (p->scaling_lists.uploaded_generation == shadow->generation && p->scaling_lists.uploaded_hash == p->scaling_lists.hash)
 	{
-		for (j = 0; j < 64; j++)
-		{
-			word |= p->info->ScalingList8x8[i][diag8x8[j]] << ((j % 4) * 8);
+		p->scaling_lists.reused++;
+	}
+	else
+	{
+		unsigned int i;
 
-			if (j % 4 == 3)
-			{
-				writel(word, p->regs + VE_HEVC_SRAM_DATA);
-				word = 0x0;
-			}
-		}
+		writel(VE_SRAM_HEVC_SCALING_LISTS, p->regs + VE_HEVC_SRAM_ADDR);
+		for (i = 0; i < ARRAY_SIZE(p->scaling_lists.sram); i++)
+			writel(p->scaling_lists.sram[i], p->regs + VE_HEVC_SRAM_DATA);
+
+		p->scaling_lists.uploaded_generation = shadow->generation;
+		p->scaling_lists.uploaded_hash = p->scaling_lists.hash;
+		p->scaling_lists.uploaded++;
 	}
 
-	for (i = 0; i < 2; i++)
-	{
-		for (j = 0; j < 64; j++)
-		{
-			word |= p->info->ScalingList32x32[i][diag8x8[j]] << ((j % 4) * 8);
+	shadow_writel(shadow, (0x1 << 31), VE_HEVC_SCALING_LIST_CTRL);
+}
 
-			if (j % 4 == 3)
-			{
-				writel(word, p->regs + VE_HEVC_SRAM_DATA);
-				word = 0x0;
-			}
-		}
+// stream level state, only changes with the SPS
+static void write_sequence_regs(struct h265_private *p)
+{
+	shadow_writel(&p->decoder->shadow, ((p->info->strong_intra_smoothing_enabled_flag & 0x1) << 26) |
+		((p->info->sps_temporal_mvp_enabled_flag & 0x1) << 25) |
+		((p->info->sample_adaptive_offset_enabled_flag & 0x1) << 24) |
+		((p->info->amp_enabled_flag & 0x1) << 23) |
+		((p->info->max_transform_hierarchy_depth_intra & 0x7) << 20) |
+		((p->info->max_transform_hierarchy_depth_inter & 0x7) << 17) |
+		((p->info->log2_diff_max_min_transform_block_size & 0x3) << 15) |
+		((p->info->log2_min_transform_block_size_minus2 & 0x3) << 13) |
+		((p->info->log2_diff_max_min_luma_coding_block_size & 0x3) << 11) |
+		((p->info->log2_min_luma_coding_block_size_minus3 & 0x3) << 9) |
+		((p->info->chroma_format_idc & 0x3) << 0), VE_HEVC_SPS);
+
+	shadow_writel(&p->decoder->shadow, (p->decoder->height << 16) | p->decoder->width, VE_HEVC_PIC_SIZE);
+
+	shadow_writel(&p->decoder->shadow, ((p->info->pcm_enabled_flag & 0x1) << 15) |
+		((p->info->log2_diff_max_min_pcm_luma_coding_block_size & 0x3) << 10) |
+		((p->info->log2_min_pcm_luma_coding_block_size_minus3 & 0x3) << 8) |
+		((p->info->pcm_sample_bit_depth_chroma_minus1 & 0xf) << 4) |
+		((p->info->pcm_sample_bit_depth_luma_minus1 & 0xf) << 0), VE_HEVC_PCM_HDR);
+}
+
+// picture level state, the same for all slices of a picture
+static void write_picture_regs(struct h265_private *p)
+{
+	shadow_writel(&p->decoder->shadow, ((p->info->pps_cr_qp_offset & 0x1f) << 24) |
+		((p->info->pps_cb_qp_offset & 0x1f) << 16) |
+		((p->info->init_qp_minus26 & 0xff) << 8) |
+		((p->info->diff_cu_qp_delta_depth & 0xf) << 4) |
+		((p->info->cu_qp_delta_enabled_flag & 0x1) << 3) |
+		((p->info->transform_skip_enabled_flag & 0x1) << 2) |
+		((p->info->constrained_intra_pred_flag & 0x1) << 1) |
+		((p->info->sign_data_hiding_enabled_flag & 0x1) << 0), VE_HEVC_PPS0);
+	shadow_writel(&p->decoder->shadow, ((p->info->log2_parallel_merge_level_minus2 & 0x7) << 8) |
+		((p->info->pps_loop_filter_across_slices_enabled_flag & 0x1) << 6) |
+		((p->info->loop_filter_across_tiles_enabled_flag & 0x1) << 5) |
+		((p->info->entropy_coding_sync_enabled_flag & 0x1) << 4) |
+		((p->info->tiles_enabled_flag & 0x1) << 3) |
+		((p->info->transquant_bypass_enabled_flag & 0x1) << 2) |
+		((p->info->weighted_bipred_flag & 0x1) << 1) |
+		((p->info->weighted_pred_flag & 0x1) << 0), VE_HEVC_PPS1);
+
+	if (p->info->scaling_list_enabled_flag)
+		write_scaling_lists(p);
+	else
+		shadow_writel(&p->decoder->shadow, (0x1 << 30), VE_HEVC_SCALING_LIST_CTRL);
+
+	shadow_writel(&p->decoder->shadow, 0xc0000000, VE_EXTRA_OUT_FMT_OFFSET);
+	shadow_writel(&p->decoder->shadow, (0x2 << 4), 0x0ec);
+	shadow_writel(&p->decoder->shadow, p->output->chroma_size / 2, 0x0c4);
+	shadow_writel(&p->decoder->shadow, (ALIGN(p->decoder->width / 2, 16) << 16) | ALIGN(p->decoder->width, 32), 0x0c8);
+	shadow_writel(&p->decoder->shadow, 0x00000000, 0x0cc);
+	shadow_writel(&p->decoder->shadow, 0x00000000, 0x550);
+	shadow_writel(&p->decoder->shadow, 0x00000000, 0x554);
+	shadow_writel(&p->decoder->shadow, 0x00000000, 0x558);
+
+	shadow_writel(&p->decoder->shadow, 0x0, 0x580);
+	shadow_writel(&p->decoder->shadow, cedrus_mem_get_bus_addr(p->neighbor_info) >> 8, VE_HEVC_NEIGHBOR_INFO_ADDR);
+
+	write_pic_list(p);
+}
+
+static void write_slice_regs(struct h265_private *p)
+{
+	writel(0x40 | p->nal_unit_type, p->regs + VE_HEVC_NAL_HDR);
+
+	writel(((p->slice.five_minus_max_num_merge_cand & 0x7) << 24) |
+		((p->slice.num_ref_idx_l1_active_minus1 & 0xf) << 20) |
+		((p->slice.num_ref_idx_l0_active_minus1 & 0xf) << 16) |
+		((p->slice.collocated_ref_idx & 0xf) << 12) |
+		((p->slice.collocated_from_l0_flag & 0x1) << 11) |
+		((p->slice.cabac_init_flag & 0x1) << 10) |
+		((p->slice.mvd_l1_zero_flag & 0x1) << 9) |
+		((p->slice.slice_sao_chroma_flag & 0x1) << 8) |
+		((p->slice.slice_sao_luma_flag & 0x1) << 7) |
+		((p->slice.slice_temporal_mvp_enabled_flag & 0x1) << 6) |
+		((p->slice.slice_type & 0x3) << 2) |
+		((p->slice.dependent_slice_segment_flag & 0x1) << 1) |
+		((p->slice.first_slice_segment_in_pic_flag & 0x1) << 0), p->regs + VE_HEVC_SLICE_HDR0);
+	writel(((p->slice.slice_tc_offset_div2 & 0xf) << 28) |
+		((p->slice.slice_beta_offset_div2 & 0xf) << 24) |
+		(((p->slice.slice_deblocking_filter_disabled_flag | p->bypass_deblocking) & 0x1) << 23) |
+		((p->slice.slice_loop_filter_across_slices_enabled_flag & 0x1) << 22) |
+		(((p->info->NumPocStCurrAfter == 0) & 0x1) << 21) |
+		((p->slice.slice_cr_qp_offset & 0x1f) << 16) |
+		((p->slice.slice_cb_qp_offset & 0x1f) << 8) |
+		((p->slice.slice_qp_delta & 0x3f) << 0), p->regs + VE_HEVC_SLICE_HDR1);
+	writel(((p->slice.num_entry_point_offsets) << 8) |
+		(((p->slice.luma_log2_weight_denom + p->slice.delta_chroma_log2_weight_denom) & 0xf) << 4) |
+		((p->slice.luma_log2_weight_denom & 0xf) << 0), p->regs + VE_HEVC_SLICE_HDR2);
+
+	if (p->slice.first_slice_segment_in_pic_flag)
+		writel(0x0, p->regs + VE_HEVC_CTU_NUM);
+
+	writel(((p->slice.slice_segment_address / PicWidthInCtbsY) << 16) | ((p->slice.slice_segment_address % PicWidthInCtbsY) << 0), p->regs + VE_HEVC_CTB_ADDR);
+	writel(0x00000007, p->regs + VE_HEVC_CTRL);
+
+	write_entry_point_list(p);
+
+	write_ref_pic_lists(p);
+	write_weighted_pred(p);
+}
+
+// tile scan address of the CTB at raster scan address addr
+static int ctb_addr_rs_to_ts(struct h265_private *p, int addr)
+{
+	int x = addr % PicWidthInCtbsY, y = addr / PicWidthInCtbsY;
+	int tx = 0, ty = 0, ts = 0;
+
+	for (; y >= tile_height(p, ty); ty++)
+	{
+		y -= tile_height(p, ty);
+		ts += PicWidthInCtbsY * tile_height(p, ty);
+	}
+	for (; x >= tile_width(p, tx); tx++)
+	{
+		x -= tile_width(p, tx);
+		ts += tile_width(p, tx) * tile_height(p, ty);
 	}
 
-	for (i = 0; i < 6; i++)
+	return ts + y * tile_width(p, tx) + x;
+}
+
+/*
+ * Number of 16x16 macroblocks covered by the slice segment parsed last,
+ * up to the address of the one in the next NAL unit, or to the end of
+ * the picture if there is none.
+ */
+static uint32_t slice_segment_mbs(struct h265_private *p, const uint8_t *data, int len, int nal, int nal_count)
+{
+	int start = ctb_addr_rs_to_ts(p, p->slice.slice_segment_address);
+	int end = PicSizeInCtbsY;
+
+	if (nal + 1 < nal_count)
 	{
-		for (j = 0; j < 64; j++)
-		{
-			word |= p->info->ScalingList16x16[i][diag8x8[j]] << ((j % 4) * 8);
+		bitstream_t bs;
+		int pos = p->nal_offsets[nal + 1];
 
-			if (j % 4 == 3)
-			{
-				writel(word, p->regs + VE_HEVC_SRAM_DATA);
-				word = 0x0;
-			}
+		bs_init(&bs, data + pos, len - pos, 1);
+		bs_get_u(&bs, 1);
+		uint8_t nal_unit_type = bs_get_u(&bs, 6);
+		bs_get_u(&bs, 9);
+
+		if (nal_unit_type < 32 && !bs_get_u(&bs, 1))
+		{
+			if (nal_unit_type >= 16 && nal_unit_type <= 23)
+				bs_get_u(&bs, 1);
+			bs_get_ue(&bs);
+			if (p->info->dependent_slice_segments_enabled_flag)
+				bs_get_u(&bs, 1);
+
+			int address = bs_get_u(&bs, ceil_log2(PicSizeInCtbsY));
+			if (!bs_overrun(&bs) && address < PicSizeInCtbsY)
+				end = ctb_addr_rs_to_ts(p, address);
 		}
 	}
 
-	for (i = 0; i < 6; i++)
+	return max(end - start, 0) << (2 * (CtbLog2SizeY - 4));
+}
+
+/*
+ * Sub-layer non-reference pictures (TRAIL_N, TSA_N, STSA_N, RADL_N,
+ * RASL_N and the reserved RSV_VCL_N10/12/14) have even NAL unit types
+ * below 16. The type of the first VCL NAL unit tells.
+ */
+static int is_reference_picture(struct h265_private *p, const uint8_t *data, int len, int nal_count)
+{
+	int nal;
+
+	for (nal = 0; nal < nal_count; nal++)
 	{
-		for (j = 0; j < 16; j++)
-		{
-			word |= p->info->ScalingList4x4[i][diag4x4[j]] << ((j % 4) * 8);
+		int pos = p->nal_offsets[nal];
+		if (pos + 2 > len)
+			break;
 
-			if (j % 4 == 3)
-			{
-				writel(word, p->regs + VE_HEVC_SRAM_DATA);
-				word = 0x0;
-			}
-		}
+		uint8_t nal_unit_type = (data[pos] >> 1) & 0x3f;
+
+		if (nal_unit_type >= 32)
+			continue;
+
+		return !(nal_unit_type <= 14 && !(nal_unit_type & 1));
 	}
 
-	writel((0x1 << 31), p->regs + VE_HEVC_SCALING_LIST_CTRL);
+	return 1;
 }
 
 static VdpStatus h265_decode(decoder_ctx_t *decoder,
@@ -722,15 +797,72 @@ static VdpStatus h265_decode(decoder_ctx_t *decoder,
 	p->output = output;
 	memset(&p->slice, 0, sizeof(p->slice));
 
+	int nal, nal_count = find_nal_units(cedrus_mem_get_pointer(decoder->data), len, decoder->nal_length_size, p->nal_offsets, p->nal_offsets_size);
+	if (nal_count > p->nal_offsets_size)
+	{
+		int *nal_offsets = realloc(p->nal_offsets, nal_count * sizeof(*nal_offsets));
+		if (!nal_offsets)
+			return VDP_STATUS_RESOURCES;
+
+		p->nal_offsets = nal_offsets;
+		p->nal_offsets_size = nal_count;
+		find_nal_units(cedrus_mem_get_pointer(decoder->data), len, decoder->nal_length_size, p->nal_offsets, p->nal_offsets_size);
+	}
+
+	int is_reference = is_reference_picture(p, cedrus_mem_get_pointer(decoder->data), len, nal_count);
+	if (decoder_skip_picture(decoder, is_reference))
+		return VDP_STATUS_OK;
+
+	p->bypass_deblocking = decoder_bypass_deblocking(decoder, is_reference);
+
 	VdpStatus ret = yuv_prepare(output);
 	if (ret != VDP_STATUS_OK)
 		return ret;
 
-	p->regs = cedrus_ve_get(decoder->device->cedrus, CEDRUS_ENGINE_HEVC, 0x0);
+	// output is written directly, without SDROT
+	output->rotation = 0;
+
+	ret = update_ref_cache(p);
+	if (ret != VDP_STATUS_OK)
+		return ret;
 
-	int pos = 0;
-	while ((pos = find_startcode(cedrus_mem_get_pointer(decoder->data), len, pos)) != -1)
+	if (p->info->scaling_list_enabled_flag)
+		prepare_scaling_lists(p);
+
+	p->regs = decoder_ve_get(decoder, CEDRUS_ENGINE_HEVC, 0x0);
+
+	write_sequence_regs(p);
+	write_picture_regs(p);
+
+	for (nal = 0; nal < nal_count; nal++)
 	{
+		int pos = p->nal_offsets[nal];
+
+		bs_init(&p->bs, cedrus_mem_get_pointer(decoder->data) + pos, len - pos, 1);
+
+		bs_get_u(&p->bs, 1);
+		p->nal_unit_type = bs_get_u(&p->bs, 6);
+		bs_get_u(&p->bs, 6);
+		bs_get_u(&p->bs, 3);
+
+		if (!h265_slice_header(&p->slice, &p->bs, p->info, p->nal_unit_type))
+		{
+			VDPAU_DBG("Invalid slice header");
+			ret = VDP_STATUS_ERROR;
+			break;
+		}
+
+		if (!prepare_entry_point_list(p))
+		{
+			ret = VDP_STATUS_RESOURCES;
+			break;
+		}
+
+		/*
+		 * The bitstream init (VE_HEVC_TRIG 0x7) loads its window from
+		 * VE_HEVC_BITS_ADDR, _OFFSET, _LEN and _END_ADDR, so these are
+		 * the only registers written again for every slice.
+		 */
 		writel((cedrus_mem_get_bus_addr(decoder->data) + VBV_SIZE - 1) >> 8, p->regs + VE_HEVC_BITS_END_ADDR);
 		writel((len - pos) * 8, p->regs + VE_HEVC_BITS_LEN);
 		writel(pos * 8, p->regs + VE_HEVC_BITS_OFFSET);
@@ -738,124 +870,40 @@ static VdpStatus h265_decode(decoder_ctx_t *decoder,
 
 		writel(0x7, p->regs + VE_HEVC_TRIG);
 
-		get_u(p->regs, 1);
-		p->nal_unit_type = get_u(p->regs, 6);
-		get_u(p->regs, 6);
-		get_u(p->regs, 3);
-
-		slice_header(p);
-
-		writel(0x40 | p->nal_unit_type, p->regs + VE_HEVC_NAL_HDR);
-
-		writel(((p->info->strong_intra_smoothing_enabled_flag & 0x1) << 26) |
-			((p->info->sps_temporal_mvp_enabled_flag & 0x1) << 25) |
-			((p->info->sample_adaptive_offset_enabled_flag & 0x1) << 24) |
-			((p->info->amp_enabled_flag & 0x1) << 23) |
-			((p->info->max_transform_hierarchy_depth_intra & 0x7) << 20) |
-			((p->info->max_transform_hierarchy_depth_inter & 0x7) << 17) |
-			((p->info->log2_diff_max_min_transform_block_size & 0x3) << 15) |
-			((p->info->log2_min_transform_block_size_minus2 & 0x3) << 13) |
-			((p->info->log2_diff_max_min_luma_coding_block_size & 0x3) << 11) |
-			((p->info->log2_min_luma_coding_block_size_minus3 & 0x3) << 9) |
-			((p->info->chroma_format_idc & 0x3) << 0), p->regs + VE_HEVC_SPS);
-
-		writel((decoder->height << 16) | decoder->width, p->regs + VE_HEVC_PIC_SIZE);
-
-		writel(((p->info->pcm_enabled_flag & 0x1) << 15) |
-			((p->info->log2_diff_max_min_pcm_luma_coding_block_size & 0x3) << 10) |
-			((p->info->log2_min_pcm_luma_coding_block_size_minus3 & 0x3) << 8) |
-			((p->info->pcm_sample_bit_depth_chroma_minus1 & 0xf) << 4) |
-			((p->info->pcm_sample_bit_depth_luma_minus1 & 0xf) << 0), p->regs + VE_HEVC_PCM_HDR);
-
-		writel(((p->info->pps_cr_qp_offset & 0x1f) << 24) |
-			((p->info->pps_cb_qp_offset & 0x1f) << 16) |
-			((p->info->init_qp_minus26 & 0xff) << 8) |
-			((p->info->diff_cu_qp_delta_depth & 0xf) << 4) |
-			((p->info->cu_qp_delta_enabled_flag & 0x1) << 3) |
-			((p->info->transform_skip_enabled_flag & 0x1) << 2) |
-			((p->info->constrained_intra_pred_flag & 0x1) << 1) |
-			((p->info->sign_data_hiding_enabled_flag & 0x1) << 0), p->regs + VE_HEVC_PPS0);
-		writel(((p->info->log2_parallel_merge_level_minus2 & 0x7) << 8) |
-			((p->info->pps_loop_filter_across_slices_enabled_flag & 0x1) << 6) |
-			((p->info->loop_filter_across_tiles_enabled_flag & 0x1) << 5) |
-			((p->info->entropy_coding_sync_enabled_flag & 0x1) << 4) |
-			((p->info->tiles_enabled_flag & 0x1) << 3) |
-			((p->info->transquant_bypass_enabled_flag & 0x1) << 2) |
-			((p->info->weighted_bipred_flag & 0x1) << 1) |
-			((p->info->weighted_pred_flag & 0x1) << 0), p->regs + VE_HEVC_PPS1);
-
-		if (p->info->scaling_list_enabled_flag)
-			write_scaling_lists(p);
-		else
-			writel((0x1 << 30), p->regs + VE_HEVC_SCALING_LIST_CTRL);
-
-		writel(((p->slice.five_minus_max_num_merge_cand & 0x7) << 24) |
-			((p->slice.num_ref_idx_l1_active_minus1 & 0xf) << 20) |
-			((p->slice.num_ref_idx_l0_active_minus1 & 0xf) << 16) |
-			((p->slice.collocated_ref_idx & 0xf) << 12) |
-			((p->slice.collocated_from_l0_flag & 0x1) << 11) |
-			((p->slice.cabac_init_flag & 0x1) << 10) |
-			((p->slice.mvd_l1_zero_flag & 0x1) << 9) |
-			((p->slice.slice_sao_chroma_flag & 0x1) << 8) |
-			((p->slice.slice_sao_luma_flag & 0x1) << 7) |
-			((p->slice.slice_temporal_mvp_enabled_flag & 0x1) << 6) |
-			((p->slice.slice_type & 0x3) << 2) |
-			((p->slice.dependent_slice_segment_flag & 0x1) << 1) |
-			((p->slice.first_slice_segment_in_pic_flag & 0x1) << 0), p->regs + VE_HEVC_SLICE_HDR0);
-		writel(((p->slice.slice_tc_offset_div2 & 0xf) << 28) |
-			((p->slice.slice_beta_offset_div2 & 0xf) << 24) |
-			((p->slice.slice_deblocking_filter_disabled_flag & 0x1) << 23) |
-			((p->slice.slice_loop_filter_across_slices_enabled_flag & 0x1) << 22) |
-			(((p->info->NumPocStCurrAfter == 0) & 0x1) << 21) |
-			((p->slice.slice_cr_qp_offset & 0x1f) << 16) |
-			((p->slice.slice_cb_qp_offset & 0x1f) << 8) |
-			((p->slice.slice_qp_delta & 0x3f) << 0), p->regs + VE_HEVC_SLICE_HDR1);
-		writel(((p->slice.num_entry_point_offsets) << 8) |
-			(((p->slice.luma_log2_weight_denom + p->slice.delta_chroma_log2_weight_denom) & 0xf) << 4) |
-			((p->slice.luma_log2_weight_denom & 0xf) << 0), p->regs + VE_HEVC_SLICE_HDR2);
-
-		if (p->slice.first_slice_segment_in_pic_flag)
-			writel(0x0, p->regs + VE_HEVC_CTU_NUM);
-
-		writel(((p->slice.slice_segment_address / PicWidthInCtbsY) << 16) | ((p->slice.slice_segment_address % PicWidthInCtbsY) << 0), p->regs + VE_HEVC_CTB_ADDR);
-		writel(0x00000007, p->regs + VE_HEVC_CTRL);
-
-		writel(0xc0000000, p->regs + VE_EXTRA_OUT_FMT_OFFSET);
-		writel((0x2 << 4), p->regs + 0x0ec);
-		writel(output->chroma_size / 2, p->regs + 0x0c4);
-		writel((ALIGN(decoder->width / 2, 16) << 16) | ALIGN(decoder->width, 32), p->regs + 0x0c8);
-		writel(0x00000000, p->regs + 0x0cc);
-		writel(0x00000000, p->regs + 0x550);
-		writel(0x00000000, p->regs + 0x554);
-		writel(0x00000000, p->regs + 0x558);
-
-		write_entry_point_list(p);
-
-		writel(0x0, p->regs + 0x580);
-		writel(cedrus_mem_get_bus_addr(p->neighbor_info) >> 8, p->regs + VE_HEVC_NEIGHBOR_INFO_ADDR);
-
-		write_pic_list(p);
-
-		write_ref_pic_lists(p);
-		write_weighted_pred(p);
+		// header was parsed by CPU, let the VE skip to slice data
+		skip_bits(p->regs, bs_bits_read(&p->bs));
+
+		write_slice_regs(p);
 
 		writel(0x8, p->regs + VE_HEVC_TRIG);
-		cedrus_ve_wait(decoder->device->cedrus, 1);
+		ret = decoder_ve_wait(decoder, p->regs + VE_HEVC_STATUS, 0x7, slice_segment_mbs(p, cedrus_mem_get_pointer(decoder->data), len, nal, nal_count));
 
 		writel(readl(p->regs + VE_HEVC_STATUS) & 0x7, p->regs + VE_HEVC_STATUS);
+
+		if (ret != VDP_STATUS_OK)
+			break;
 	}
 
-	cedrus_ve_put(decoder->device->cedrus);
+	decoder_ve_put(decoder);
 
-	return VDP_STATUS_OK;
+	return ret;
 }
 
 static void h265_private_free(decoder_ctx_t *decoder)
 {
 	struct h265_private *p = decoder->private;
 
-	cedrus_mem_free(p->neighbor_info);
-	cedrus_mem_free(p->entry_points);
+	int i;
+
+	VDPAU_DBG("HEVC scaling lists uploaded %lu times, reused %lu times", p->scaling_lists.uploaded, p->scaling_lists.reused);
+	VDPAU_DBG("HEVC reference surfaces looked up %lu times, cached %lu times", p->ref_cache.lookups, p->ref_cache.hits);
+
+	for (i = 0; i < 16; i++)
+		release_ref_cache_entry(&p->ref_cache.entry[i]);
+
+	device_mem_free(decoder->device, p->neighbor_info);
+	device_mem_free(decoder->device, p->entry_points);
+	free(p->nal_offsets);
 
 	free(p);
 }
@@ -866,8 +914,7 @@ VdpStatus new_decoder_h265(decoder_ctx_t *decoder)
 	if (!p)
 		return VDP_STATUS_RESOURCES;
 
-	p->neighbor_info = cedrus_mem_alloc(decoder->device->cedrus, 397 * 1024);
-	p->entry_points = cedrus_mem_alloc(decoder->device->cedrus, 4 * 1024);
+	p->neighbor_info = device_mem_alloc(decoder->device, 397 * 1024, MEM_CODEC, decoder);
 
 	decoder->decode = h265_decode;
 	decoder->private = p;
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "h265_slice.h"
+
+#define ceil_log2(n) ((n) <= 1 ? 0 : 32 - __builtin_clz((n) - 1))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+
+#define MinCbLog2SizeY (info->log2_min_luma_coding_block_size_minus3 + 3)
+#define CtbLog2SizeY (MinCbLog2SizeY + info->log2_diff_max_min_luma_coding_block_size)
+#define CtbSizeY (1 << CtbLog2SizeY)
+#define PicWidthInCtbsY DIV_ROUND_UP(info->pic_width_in_luma_samples, CtbSizeY)
+#define PicHeightInCtbsY DIV_ROUND_UP(info->pic_height_in_luma_samples, CtbSizeY)
+#define PicSizeInCtbsY (PicWidthInCtbsY * PicHeightInCtbsY)
+#define ChromaArrayType (info->separate_colour_plane_flag ? 0 : info->chroma_format_idc)
+
+static int pred_weight_table(struct h265_slice_header *s, bitstream_t *bs, VdpPictureInfoHEVC const *info)
+{
+	int i, j;
+
+	s->luma_log2_weight_denom = bs_get_ue(bs);
+	s->delta_chroma_log2_weight_denom = 0;
+	if (ChromaArrayType != 0)
+		s->delta_chroma_log2_weight_denom = bs_get_se(bs);
+
+	// both denominators are used as shift counts
+	if (s->luma_log2_weight_denom > 7 || s->luma_log2_weight_denom + s->delta_chroma_log2_weight_denom < 0 || s->luma_log2_weight_denom + s->delta_chroma_log2_weight_denom > 7)
+		return 0;
+
+	for (i = 0; i <= s->num_ref_idx_l0_active_minus1; i++)
+		s->luma_weight_l0_flag[i] = bs_get_u(bs, 1);
+
+	for (i = 0; i <= s->num_ref_idx_l0_active_minus1; i++)
+		s->chroma_weight_l0_flag[i] = ChromaArrayType != 0 ? bs_get_u(bs, 1) : 0;
+
+	for (i = 0; i <= s->num_ref_idx_l0_active_minus1; i++)
+	{
+		if (s->luma_weight_l0_flag[i])
+		{
+			s->delta_luma_weight_l0[i] = bs_get_se(bs);
+			s->luma_offset_l0[i] = bs_get_se(bs);
+		}
+
+		if (s->chroma_weight_l0_flag[i])
+		{
+			for (j = 0; j < 2; j++)
+			{
+				s->delta_chroma_weight_l0[i][j] = bs_get_se(bs);
+				s->delta_chroma_offset_l0[i][j] = bs_get_se(bs);
+			}
+		}
+	}
+
+	if (s->slice_type == SLICE_B)
+	{
+		for (i = 0; i <= s->num_ref_idx_l1_active_minus1; i++)
+			s->luma_weight_l1_flag[i] = bs_get_u(bs, 1);
+
+		for (i = 0; i <= s->num_ref_idx_l1_active_minus1; i++)
+			s->chroma_weight_l1_flag[i] = ChromaArrayType != 0 ? bs_get_u(bs, 1) : 0;
+
+		for (i = 0; i <= s->num_ref_idx_l1_active_minus1; i++)
+		{
+			if (s->luma_weight_l1_flag[i])
+			{
+				s->delta_luma_weight_l1[i] = bs_get_se(bs);
+				s->luma_offset_l1[i] = bs_get_se(bs);
+			}
+
+			if (s->chroma_weight_l1_flag[i])
+			{
+				for (j = 0; j < 2; j++)
+				{
+					s->delta_chroma_weight_l1[i][j] = bs_get_se(bs);
+					s->delta_chroma_offset_l1[i][j] = bs_get_se(bs);
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+// list entries index the NumPocTotalCurr entries of the initial lists
+static int ref_pic_lists_modification(struct h265_slice_header *s, bitstream_t *bs, VdpPictureInfoHEVC const *info)
+{
+	int i;
+
+	s->ref_pic_list_modification_flag_l0 = bs_get_u(bs, 1);
+
+	if (s->ref_pic_list_modification_flag_l0)
+	{
+		for (i = 0; i <= s->num_ref_idx_l0_active_minus1; i++)
+		{
+			s->list_entry_l0[i] = bs_get_u(bs, ceil_log2(info->NumPocTotalCurr));
+			if (s->list_entry_l0[i] >= info->NumPocTotalCurr)
+				return 0;
+		}
+	}
+
+	if (s->slice_type == SLICE_B)
+	{
+		s->ref_pic_list_modification_flag_l1 = bs_get_u(bs, 1);
+
+		if (s->ref_pic_list_modification_flag_l1)
+		{
+			for (i = 0; i <= s->num_ref_idx_l1_active_minus1; i++)
+			{
+				s->list_entry_l1[i] = bs_get_u(bs, ceil_log2(info->NumPocTotalCurr));
+				if (s->list_entry_l1[i] >= info->NumPocTotalCurr)
+					return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+int h265_slice_header(struct h265_slice_header *s, bitstream_t *bs, VdpPictureInfoHEVC const *info, uint8_t nal_unit_type)
+{
+	int i;
+
+	s->first_slice_segment_in_pic_flag = bs_get_u(bs, 1);
+
+	s->no_output_of_prior_pics_flag = 0;
+	if (nal_unit_type >= 16 && nal_unit_type <= 23)
+		s->no_output_of_prior_pics_flag = bs_get_u(bs, 1);
+
+	s->slice_pic_parameter_set_id = bs_get_ue(bs);
+
+	s->dependent_slice_segment_flag = 0;
+	s->slice_segment_address = 0;
+	if (!s->first_slice_segment_in_pic_flag)
+	{
+		if (info->dependent_slice_segments_enabled_flag)
+			s->dependent_slice_segment_flag = bs_get_u(bs, 1);
+
+		s->slice_segment_address = bs_get_u(bs, ceil_log2(PicSizeInCtbsY));
+		if (s->slice_segment_address >= PicSizeInCtbsY)
+			return 0;
+	}
+
+	if (!s->dependent_slice_segment_flag)
+	{
+		s->pic_output_flag = 1;
+		s->num_ref_idx_l0_active_minus1 = info->num_ref_idx_l0_default_active_minus1;
+		s->num_ref_idx_l1_active_minus1 = info->num_ref_idx_l1_default_active_minus1;
+		s->collocated_from_l0_flag = 1;
+		s->collocated_ref_idx = 0;
+		s->slice_deblocking_filter_disabled_flag = info->pps_deblocking_filter_disabled_flag;
+		s->slice_beta_offset_div2 = info->pps_beta_offset_div2;
+		s->slice_tc_offset_div2 = info->pps_tc_offset_div2;
+		s->slice_loop_filter_across_slices_enabled_flag = info->pps_loop_filter_across_slices_enabled_flag;
+
+		// flags that are not present must not leak from an earlier picture
+		s->colour_plane_id = 0;
+		s->slice_pic_order_cnt_lsb = 0;
+		s->short_term_ref_pic_set_sps_flag = 0;
+		s->slice_temporal_mvp_enabled_flag = 0;
+		s->slice_sao_luma_flag = 0;
+		s->slice_sao_chroma_flag = 0;
+		s->num_ref_idx_active_override_flag = 0;
+		s->ref_pic_list_modification_flag_l0 = 0;
+		s->ref_pic_list_modification_flag_l1 = 0;
+		s->mvd_l1_zero_flag = 0;
+		s->cabac_init_flag = 0;
+		s->five_minus_max_num_merge_cand = 0;
+		s->slice_cb_qp_offset = 0;
+		s->slice_cr_qp_offset = 0;
+		s->deblocking_filter_override_flag = 0;
+
+		bs_skip_bits(bs, info->num_extra_slice_header_bits);
+
+		s->slice_type = bs_get_ue(bs);
+		if (s->slice_type > SLICE_I)
+			return 0;
+
+		if (info->output_flag_present_flag)
+			s->pic_output_flag = bs_get_u(bs, 1);
+
+		if (info->separate_colour_plane_flag == 1)
+			s->colour_plane_id = bs_get_u(bs, 2);
+
+		if (nal_unit_type != 19 && nal_unit_type != 20)
+		{
+			s->slice_pic_order_cnt_lsb = bs_get_u(bs, info->log2_max_pic_order_cnt_lsb_minus4 + 4);
+
+			s->short_term_ref_pic_set_sps_flag = bs_get_u(bs, 1);
+
+			bs_skip_bits(bs, info->NumShortTermPictureSliceHeaderBits);
+
+			if (info->long_term_ref_pics_present_flag)
+				bs_skip_bits(bs, info->NumLongTermPictureSliceHeaderBits);
+
+			if (info->sps_temporal_mvp_enabled_flag)
+				s->slice_temporal_mvp_enabled_flag = bs_get_u(bs, 1);
+		}
+
+		if (info->sample_adaptive_offset_enabled_flag)
+		{
+			s->slice_sao_luma_flag = bs_get_u(bs, 1);
+			if (ChromaArrayType != 0)
+				s->slice_sao_chroma_flag = bs_get_u(bs, 1);
+		}
+
+		if (s->slice_type == SLICE_P || s->slice_type == SLICE_B)
+		{
+			s->num_ref_idx_active_override_flag = bs_get_u(bs, 1);
+
+			if (s->num_ref_idx_active_override_flag)
+			{
+				s->num_ref_idx_l0_active_minus1 = bs_get_ue(bs);
+				if (s->slice_type == SLICE_B)
+					s->num_ref_idx_l1_active_minus1 = bs_get_ue(bs);
+			}
+
+			if (s->num_ref_idx_l0_active_minus1 > 14 || s->num_ref_idx_l1_active_minus1 > 14)
+				return 0;
+
+			if (info->lists_modification_present_flag && info->NumPocTotalCurr > 1)
+				if (!ref_pic_lists_modification(s, bs, info))
+					return 0;
+
+			if (s->slice_type == SLICE_B)
+				s->mvd_l1_zero_flag = bs_get_u(bs, 1);
+
+			if (info->cabac_init_present_flag)
+				s->cabac_init_flag = bs_get_u(bs, 1);
+
+			if (s->slice_temporal_mvp_enabled_flag)
+			{
+				if (s->slice_type == SLICE_B)
+					s->collocated_from_l0_flag = bs_get_u(bs, 1);
+
+				if ((s->collocated_from_l0_flag && s->num_ref_idx_l0_active_minus1 > 0) || (!s->collocated_from_l0_flag && s->num_ref_idx_l1_active_minus1 > 0))
+					s->collocated_ref_idx = bs_get_ue(bs);
+
+				if (s->collocated_ref_idx > (s->collocated_from_l0_flag ? s->num_ref_idx_l0_active_minus1 : s->num_ref_idx_l1_active_minus1))
+					return 0;
+			}
+
+			if ((info->weighted_pred_flag && s->slice_type == SLICE_P) || (info->weighted_bipred_flag && s->slice_type == SLICE_B))
+				if (!pred_weight_table(s, bs, info))
+					return 0;
+
+			s->five_minus_max_num_merge_cand = bs_get_ue(bs);
+			if (s->five_minus_max_num_merge_cand > 4)
+				return 0;
+		}
+
+		s->slice_qp_delta = bs_get_se(bs);
+
+		if (info->pps_slice_chroma_qp_offsets_present_flag)
+		{
+			s->slice_cb_qp_offset = bs_get_se(bs);
+			s->slice_cr_qp_offset = bs_get_se(bs);
+		}
+
+		if (info->deblocking_filter_override_enabled_flag)
+			s->deblocking_filter_override_flag = bs_get_u(bs, 1);
+
+		if (s->deblocking_filter_override_flag)
+		{
+			s->slice_deblocking_filter_disabled_flag = bs_get_u(bs, 1);
+
+			if (!s->slice_deblocking_filter_disabled_flag)
+			{
+				s->slice_beta_offset_div2 = bs_get_se(bs);
+				s->slice_tc_offset_div2 = bs_get_se(bs);
+			}
+		}
+
+		if (info->pps_loop_filter_across_slices_enabled_flag && (s->slice_sao_luma_flag || s->slice_sao_chroma_flag || !s->slice_deblocking_filter_disabled_flag))
+			s->slice_loop_filter_across_slices_enabled_flag = bs_get_u(bs, 1);
+	}
+
+	s->num_entry_point_offsets = 0;
+	if (info->tiles_enabled_flag || info->entropy_coding_sync_enabled_flag)
+	{
+		s->num_entry_point_offsets = bs_get_ue(bs);
+		if (s->num_entry_point_offsets > MAX_ENTRY_POINTS)
+			return 0;
+
+		if (s->num_entry_point_offsets > 0)
+		{
+			s->offset_len_minus1 = bs_get_ue(bs);
+			if (s->offset_len_minus1 > 31)
+				return 0;
+
+			for (i = 0; i < s->num_entry_point_offsets; i++)
+				s->entry_point_offset_minus1[i] = bs_get_u(bs, s->offset_len_minus1 + 1);
+		}
+	}
+
+	if (info->slice_segment_header_extension_present_flag)
+		bs_skip_bits(bs, bs_get_ue(bs) * 8);
+
+	return !bs_overrun(bs);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __H265_SLICE_H__
+#define __H265_SLICE_H__
+
+#include <stdint.h>
+#include <vdpau/vdpau.h>
+#include "bitstream.h"
+
+#define MAX_ENTRY_POINTS 1024
+
+#define SLICE_B	0
+#define SLICE_P	1
+#define SLICE_I	2
+
+struct h265_slice_header
+{
+	uint8_t first_slice_segment_in_pic_flag;
+	uint8_t no_output_of_prior_pics_flag;
+	uint8_t slice_pic_parameter_set_id;
+	uint8_t dependent_slice_segment_flag;
+	uint32_t slice_segment_address;
+	uint8_t slice_type;
+	uint8_t pic_output_flag;
+	uint8_t colour_plane_id;
+	uint16_t slice_pic_order_cnt_lsb;
+	uint8_t short_term_ref_pic_set_sps_flag;
+
+	uint8_t slice_temporal_mvp_enabled_flag;
+	uint8_t	slice_sao_luma_flag;
+	uint8_t slice_sao_chroma_flag;
+	uint8_t num_ref_idx_active_override_flag;
+	uint8_t num_ref_idx_l0_active_minus1;
+	uint8_t num_ref_idx_l1_active_minus1;
+	uint8_t mvd_l1_zero_flag;
+	uint8_t cabac_init_flag;
+	uint8_t collocated_from_l0_flag;
+	uint8_t collocated_ref_idx;
+	uint8_t five_minus_max_num_merge_cand;
+	int8_t slice_qp_delta;
+	int8_t slice_cb_qp_offset;
+	int8_t slice_cr_qp_offset;
+	uint8_t deblocking_filter_override_flag;
+	uint8_t slice_deblocking_filter_disabled_flag;
+	int8_t slice_beta_offset_div2;
+	int8_t slice_tc_offset_div2;
+	uint8_t slice_loop_filter_across_slices_enabled_flag;
+	uint16_t num_entry_point_offsets;
+	uint8_t offset_len_minus1;
+	uint32_t entry_point_offset_minus1[MAX_ENTRY_POINTS];
+
+	uint8_t ref_pic_list_modification_flag_l0;
+	uint8_t ref_pic_list_modification_flag_l1;
+	uint8_t list_entry_l0[16];
+	uint8_t list_entry_l1[16];
+
+	uint8_t luma_log2_weight_denom;
+	int8_t delta_chroma_log2_weight_denom;
+	uint8_t luma_weight_l0_flag[16];
+	uint8_t chroma_weight_l0_flag[16];
+	int8_t delta_luma_weight_l0[16];
+	int8_t luma_offset_l0[16];
+	int8_t delta_chroma_weight_l0[16][2];
+	int16_t delta_chroma_offset_l0[16][2];
+	uint8_t luma_weight_l1_flag[16];
+	uint8_t chroma_weight_l1_flag[16];
+	int8_t delta_luma_weight_l1[16];
+	int8_t luma_offset_l1[16];
+	int8_t delta_chroma_weight_l1[16][2];
+	int16_t delta_chroma_offset_l1[16][2];
+};
+
+/*
+ * Parses a slice segment header, bs has to be positioned right after
+ * the NAL unit header. Fields of dependent slice segments keep the
+ * values of the previous independent one, so the same header has to be
+ * passed for all slice segments of a picture, zeroed before the first.
+ * Returns 0 if the header is invalid or truncated.
+ */
+int h265_slice_header(struct h265_slice_header *s, bitstream_t *bs, VdpPictureInfoHEVC const *info, uint8_t nal_unit_type);
+
+#endif
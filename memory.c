@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <cedrus/cedrus.h>
+#include "debug.h"
+#include "memory.h"
+
+static const char *const category_names[MEM_CATEGORIES] =
+{
+	[MEM_VBV] = "VBV",
+	[MEM_YUV] = "YUV",
+	[MEM_REC] = "reconstruction",
+	[MEM_MV] = "motion vectors",
+	[MEM_CODEC] = "codec",
+	[MEM_RGBA] = "RGBA",
+	[MEM_INTEROP] = "interop",
+	[MEM_CACHED] = "cached",
+};
+
+void mem_account_init(mem_account_t *account, cedrus_t *cedrus, size_t budget)
+{
+	memset(account, 0, sizeof(*account));
+	pthread_mutex_init(&account->mutex, NULL);
+	pthread_mutex_init(&account->shrinker_mutex, NULL);
+	account->cedrus = cedrus;
+	account->budget = budget;
+
+	if (budget)
+		VDPAU_DBG("CMA budget %zu bytes", budget);
+}
+
+void mem_account_release(mem_account_t *account)
+{
+	int i;
+
+	for (i = 0; i < MEM_CATEGORIES; i++)
+		if (account->peak[i])
+			VDPAU_DBG("CMA %s: %zu bytes peak", category_names[i], account->peak[i]);
+
+	VDPAU_DBG("CMA total: %zu bytes peak, %lu allocations failed", account->total_peak, account->failures);
+
+	for (i = 0; i < account->count; i++)
+		VDPAU_DBG("CMA leak: %zu bytes of %s owned by %p", account->records[i].size, category_names[account->records[i].category], account->records[i].owner);
+
+	free(account->records);
+	pthread_mutex_destroy(&account->shrinker_mutex);
+	pthread_mutex_destroy(&account->mutex);
+}
+
+void mem_shrinker_register(mem_account_t *account, mem_shrinker_t *shrinker)
+{
+	pthread_mutex_lock(&account->shrinker_mutex);
+	shrinker->next = account->shrinkers;
+	account->shrinkers = shrinker;
+	pthread_mutex_unlock(&account->shrinker_mutex);
+}
+
+void mem_shrinker_unregister(mem_account_t *account, mem_shrinker_t *shrinker)
+{
+	mem_shrinker_t **s;
+
+	pthread_mutex_lock(&account->shrinker_mutex);
+	for (s = &account->shrinkers; *s; s = &(*s)->next)
+		if (*s == shrinker)
+		{
+			*s = shrinker->next;
+			break;
+		}
+	pthread_mutex_unlock(&account->shrinker_mutex);
+}
+
+// reserve size bytes of the budget, returns 0 if it would be exceeded
+static int reserve(mem_account_t *account, size_t size)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&account->mutex);
+	if (!account->budget || account->total + size <= account->budget)
+	{
+		account->total += size;
+		ret = 1;
+	}
+	pthread_mutex_unlock(&account->mutex);
+
+	return ret;
+}
+
+static void unreserve(mem_account_t *account, size_t size)
+{
+	pthread_mutex_lock(&account->mutex);
+	account->total -= size;
+	pthread_mutex_unlock(&account->mutex);
+}
+
+/*
+ * Shed cached buffers until the budget has room for size bytes, which
+ * are reserved then. Returns 0 if all caches are empty and there still
+ * is no room.
+ */
+static int shrink_and_reserve(mem_account_t *account, size_t size)
+{
+	mem_shrinker_t *shrinker;
+	int ret = 0;
+
+	pthread_mutex_lock(&account->shrinker_mutex);
+	for (shrinker = account->shrinkers; shrinker && !ret; shrinker = shrinker->next)
+		if (shrinker->shrink(shrinker))
+			ret = reserve(account, size);
+	pthread_mutex_unlock(&account->shrinker_mutex);
+
+	return ret;
+}
+
+static cedrus_mem_t *shrink_and_alloc(mem_account_t *account, size_t size)
+{
+	mem_shrinker_t *shrinker;
+	cedrus_mem_t *mem = NULL;
+
+	pthread_mutex_lock(&account->shrinker_mutex);
+	for (shrinker = account->shrinkers; shrinker && !mem; shrinker = shrinker->next)
+		if (shrinker->shrink(shrinker))
+			mem = cedrus_mem_alloc(account->cedrus, size);
+	pthread_mutex_unlock(&account->shrinker_mutex);
+
+	return mem;
+}
+
+cedrus_mem_t *mem_account_alloc(mem_account_t *account, size_t size, enum mem_category category, const void *owner)
+{
+	cedrus_mem_t *mem = NULL;
+
+	if (!reserve(account, size) && !shrink_and_reserve(account, size))
+	{
+		VDPAU_DBG("CMA budget exceeded, %zu bytes of %s for %p refused", size, category_names[category], owner);
+		goto err;
+	}
+
+	mem = cedrus_mem_alloc(account->cedrus, size);
+	if (!mem)
+		mem = shrink_and_alloc(account, size);
+
+	if (!mem)
+	{
+		unreserve(account, size);
+		VDPAU_DBG("CMA allocation of %zu bytes of %s for %p failed", size, category_names[category], owner);
+		goto err;
+	}
+
+	pthread_mutex_lock(&account->mutex);
+	if (account->count == account->allocated)
+	{
+		int allocated = account->allocated ? account->allocated * 2 : 64;
+		mem_record_t *records = realloc(account->records, allocated * sizeof(*records));
+		if (!records)
+		{
+			account->total -= size;
+			pthread_mutex_unlock(&account->mutex);
+			cedrus_mem_free(mem);
+			goto err;
+		}
+
+		account->records = records;
+		account->allocated = allocated;
+	}
+
+	mem_record_t *record = &account->records[account->count++];
+	record->mem = mem;
+	record->size = size;
+	record->category = category;
+	record->owner = owner;
+
+	account->current[category] += size;
+	if (account->current[category] > account->peak[category])
+		account->peak[category] = account->current[category];
+	if (account->total > account->total_peak)
+		account->total_peak = account->total;
+	pthread_mutex_unlock(&account->mutex);
+
+	return mem;
+
+err:
+	__sync_fetch_and_add(&account->failures, 1);
+	return NULL;
+}
+
+// search backwards, short lived buffers are usually the most recent ones
+static mem_record_t *find_record(mem_account_t *account, cedrus_mem_t *mem)
+{
+	int i;
+
+	for (i = account->count - 1; i >= 0; i--)
+		if (account->records[i].mem == mem)
+			return &account->records[i];
+
+	return NULL;
+}
+
+void mem_account_free(mem_account_t *account, cedrus_mem_t *mem)
+{
+	mem_record_t *record;
+
+	if (!mem)
+		return;
+
+	pthread_mutex_lock(&account->mutex);
+	if ((record = find_record(account, mem)))
+	{
+		account->current[record->category] -= record->size;
+		account->total -= record->size;
+		*record = account->records[--account->count];
+	}
+	pthread_mutex_unlock(&account->mutex);
+
+	cedrus_mem_free(mem);
+}
+
+void mem_account_retag(mem_account_t *account, cedrus_mem_t *mem, enum mem_category category, const void *owner)
+{
+	mem_record_t *record;
+
+	pthread_mutex_lock(&account->mutex);
+	if ((record = find_record(account, mem)))
+	{
+		account->current[record->category] -= record->size;
+		account->current[category] += record->size;
+		if (account->current[category] > account->peak[category])
+			account->peak[category] = account->current[category];
+		record->category = category;
+		record->owner = owner;
+	}
+	pthread_mutex_unlock(&account->mutex);
+}
+
+void mem_account_usage(mem_account_t *account, enum mem_category category, size_t *current, size_t *peak)
+{
+	pthread_mutex_lock(&account->mutex);
+	if (current)
+		*current = category < MEM_CATEGORIES ? account->current[category] : account->total;
+	if (peak)
+		*peak = category < MEM_CATEGORIES ? account->peak[category] : account->total_peak;
+	pthread_mutex_unlock(&account->mutex);
+}
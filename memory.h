@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __MEMORY_H__
+#define __MEMORY_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <cedrus/cedrus.h>
+
+enum mem_category
+{
+	MEM_VBV,
+	MEM_YUV,
+	MEM_REC,
+	MEM_MV,
+	MEM_CODEC,
+	MEM_RGBA,
+	MEM_INTEROP,
+	MEM_CACHED,
+	MEM_CATEGORIES
+};
+
+typedef struct
+{
+	cedrus_mem_t *mem;
+	size_t size;
+	enum mem_category category;
+	const void *owner;
+} mem_record_t;
+
+/*
+ * Caches of buffers that can be released when an allocation fails or
+ * would exceed the budget. shrink() returns the number of bytes freed,
+ * it must not block on locks held while allocating.
+ */
+typedef struct mem_shrinker
+{
+	size_t (*shrink)(struct mem_shrinker *shrinker);
+	struct mem_shrinker *next;
+} mem_shrinker_t;
+
+typedef struct
+{
+	pthread_mutex_t mutex;
+	cedrus_t *cedrus;
+	mem_record_t *records;
+	int count, allocated;
+	size_t current[MEM_CATEGORIES], peak[MEM_CATEGORIES];
+	size_t total, total_peak, budget;
+	unsigned long failures;
+	pthread_mutex_t shrinker_mutex;
+	mem_shrinker_t *shrinkers;
+} mem_account_t;
+
+// budget 0 means no limit
+void mem_account_init(mem_account_t *account, cedrus_t *cedrus, size_t budget);
+void mem_account_release(mem_account_t *account);
+cedrus_mem_t *mem_account_alloc(mem_account_t *account, size_t size, enum mem_category category, const void *owner);
+void mem_account_free(mem_account_t *account, cedrus_mem_t *mem);
+// move a buffer to another category and owner, e.g. when taken from a cache
+void mem_account_retag(mem_account_t *account, cedrus_mem_t *mem, enum mem_category category, const void *owner);
+// category MEM_CATEGORIES returns the total of all categories
+void mem_account_usage(mem_account_t *account, enum mem_category category, size_t *current, size_t *peak);
+
+void mem_shrinker_register(mem_account_t *account, mem_shrinker_t *shrinker);
+void mem_shrinker_unregister(mem_account_t *account, mem_shrinker_t *shrinker);
+
+#endif
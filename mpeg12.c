@@ -21,6 +21,7 @@
 #include <cedrus/cedrus.h>
 #include <cedrus/cedrus_regs.h>
 #include "vdpau_private.h"
+#include "startcode.h"
 
 static const uint8_t zigzag_scan[64] =
 {
@@ -37,26 +38,14 @@ static const uint8_t zigzag_scan[64] =
 static int mpeg_find_startcode(const uint8_t *data, int len)
 {
 	int pos = 0;
-	while (pos < len)
+	while ((pos = find_startcode(data, len, pos)) != -1 && pos + 3 < len)
 	{
-		int zeros = 0;
-		for ( ; pos < len; pos++)
-		{
-			if (data[pos] == 0x00)
-				zeros++;
-			else if (data[pos] == 0x01 && zeros >= 2)
-			{
-				pos++;
-				break;
-			}
-			else
-				zeros = 0;
-		}
-
-		uint8_t marker = data[pos++];
+		uint8_t marker = data[pos + 3];
 
 		if (marker >= 0x01 && marker <= 0xaf)
-			return pos - 4;
+			return pos;
+
+		pos += 3;
 	}
 	return 0;
 }
@@ -69,10 +58,20 @@ static VdpStatus mpeg12_decode(decoder_ctx_t *decoder,
 	VdpPictureInfoMPEG1Or2 const *info = (VdpPictureInfoMPEG1Or2 const *)_info;
 	int start_offset = mpeg_find_startcode(cedrus_mem_get_pointer(decoder->data), len);
 
+	// B pictures are never used for reference
+	if (decoder_skip_picture(decoder, info->picture_coding_type != 3))
+		return VDP_STATUS_OK;
+
 	VdpStatus ret = yuv_prepare(output);
 	if (ret != VDP_STATUS_OK)
 		return ret;
 
+	video_surface_ctx_t *sdrot;
+	uint32_t sdrot_ctrl;
+	ret = sdrot_prepare(decoder, output, &sdrot, &sdrot_ctrl);
+	if (ret != VDP_STATUS_OK)
+		return ret;
+
 	ret = rec_prepare(output);
 	if (ret != VDP_STATUS_OK)
 		return ret;
@@ -80,7 +79,7 @@ static VdpStatus mpeg12_decode(decoder_ctx_t *decoder,
 	int i;
 
 	// activate MPEG engine
-	void *ve_regs = cedrus_ve_get(decoder->device->cedrus, CEDRUS_ENGINE_MPEG, 0);
+	void *ve_regs = decoder_ve_get(decoder, CEDRUS_ENGINE_MPEG, 0);
 
 	// set quantisation tables
 	for (i = 0; i < 64; i++)
@@ -91,8 +90,8 @@ static VdpStatus mpeg12_decode(decoder_ctx_t *decoder,
 	// set size
 	uint16_t width = (decoder->width + 15) / 16;
 	uint16_t height = (decoder->height + 15) / 16;
-	writel((width << 8) | height, ve_regs + VE_MPEG_SIZE);
-	writel(((width * 16) << 16) | (height * 16), ve_regs + VE_MPEG_FRAME_SIZE);
+	shadow_writel(&decoder->shadow, (width << 8) | height, VE_MPEG_SIZE);
+	shadow_writel(&decoder->shadow, ((width * 16) << 16) | (height * 16), VE_MPEG_FRAME_SIZE);
 
 	// set picture header
 	uint32_t pic_header = 0;
@@ -117,8 +116,9 @@ static VdpStatus mpeg12_decode(decoder_ctx_t *decoder,
 
 	// ??
 	writel(0x80000138 | ((cedrus_get_ve_version(decoder->device->cedrus) < 0x1680) << 7), ve_regs + VE_MPEG_CTRL);
+	shadow_writel(&decoder->shadow, 0x40620000 | sdrot_ctrl, VE_MPEG_SDROT_CTRL);
 	if (cedrus_get_ve_version(decoder->device->cedrus) >= 0x1680)
-		writel((0x2 << 30) | (0x1 << 28) | (output->chroma_size / 2), ve_regs + VE_EXTRA_OUT_FMT_OFFSET);
+		shadow_writel(&decoder->shadow, (0x2 << 30) | (0x1 << 28) | (sdrot->chroma_size / 2), VE_EXTRA_OUT_FMT_OFFSET);
 
 	// set forward/backward predicion buffers
 	if (info->forward_reference != VDP_INVALID_HANDLE)
@@ -137,8 +137,8 @@ static VdpStatus mpeg12_decode(decoder_ctx_t *decoder,
 	// set output buffers (Luma / Croma)
 	writel(cedrus_mem_get_bus_addr(output->rec), ve_regs + VE_MPEG_REC_LUMA);
 	writel(cedrus_mem_get_bus_addr(output->rec) + output->luma_size, ve_regs + VE_MPEG_REC_CHROMA);
-	writel(cedrus_mem_get_bus_addr(output->yuv->data), ve_regs + VE_MPEG_ROT_LUMA);
-	writel(cedrus_mem_get_bus_addr(output->yuv->data) + output->luma_size, ve_regs + VE_MPEG_ROT_CHROMA);
+	writel(cedrus_mem_get_bus_addr(sdrot->yuv->data), ve_regs + VE_MPEG_ROT_LUMA);
+	writel(cedrus_mem_get_bus_addr(sdrot->yuv->data) + sdrot->luma_size, ve_regs + VE_MPEG_ROT_CHROMA);
 
 	// set input offset in bits
 	writel(start_offset * 8, ve_regs + VE_MPEG_VLD_OFFSET);
@@ -148,7 +148,7 @@ static VdpStatus mpeg12_decode(decoder_ctx_t *decoder,
 
 	// input end
 	uint32_t input_addr = cedrus_mem_get_bus_addr(decoder->data);
-	writel(input_addr + VBV_SIZE - 1, ve_regs + VE_MPEG_VLD_END);
+	shadow_writel(&decoder->shadow, input_addr + VBV_SIZE - 1, VE_MPEG_VLD_END);
 
 	// set input buffer
 	writel((input_addr & 0x0ffffff0) | (input_addr >> 28) | (0x7 << 28), ve_regs + VE_MPEG_VLD_ADDR);
@@ -157,15 +157,15 @@ static VdpStatus mpeg12_decode(decoder_ctx_t *decoder,
 	writel((((decoder->profile == VDP_DECODER_PROFILE_MPEG1) ? 1 : 2) << 24) | 0x8000000f, ve_regs + VE_MPEG_TRIGGER);
 
 	// wait for interrupt
-	cedrus_ve_wait(decoder->device->cedrus, 1);
+	ret = decoder_ve_wait(decoder, ve_regs + VE_MPEG_STATUS, 0xf, DIV_ROUND_UP(decoder->width, 16) * DIV_ROUND_UP(decoder->height, 16));
 
 	// clean interrupt flag
 	writel(0x0000c00f, ve_regs + VE_MPEG_STATUS);
 
 	// stop MPEG engine
-	cedrus_ve_put(decoder->device->cedrus);
+	decoder_ve_put(decoder);
 
-	return VDP_STATUS_OK;
+	return ret;
 }
 
 VdpStatus new_decoder_mpeg12(decoder_ctx_t *decoder)
@@ -23,55 +23,17 @@
 #include <cedrus/cedrus.h>
 #include <cedrus/cedrus_regs.h>
 #include "vdpau_private.h"
+#include "startcode.h"
+#include "bitstream.h"
 
-typedef struct
+static int next_startcode(bitstream_t *bs)
 {
-	const uint8_t *data;
-	unsigned int length;
-	unsigned int bitpos;
-} bitstream;
-
-static int find_startcode(bitstream *bs)
-{
-	unsigned int pos, zeros = 0;
-	for (pos = bs->bitpos / 8; pos < bs->length; pos++)
-	{
-		if (bs->data[pos] == 0x00)
-			zeros++;
-		else if (bs->data[pos] == 0x01 && zeros >= 2)
-		{
-			bs->bitpos = (pos + 1) * 8;
-			return 1;
-		}
-		else
-			zeros = 0;
-	}
-
-	return 0;
-}
-
-static uint32_t get_bits(bitstream *bs, int n)
-{
-	uint32_t bits = 0;
-	int remaining_bits = n;
-
-	while (remaining_bits > 0)
-	{
-		int bits_in_current_byte = 8 - (bs->bitpos & 7);
-
-		int trash_bits = 0;
-		if (remaining_bits < bits_in_current_byte)
-			trash_bits = bits_in_current_byte - remaining_bits;
-
-		int useful_bits = bits_in_current_byte - trash_bits;
-
-		bits = (bits << useful_bits) | (bs->data[bs->bitpos / 8] >> trash_bits);
-
-		remaining_bits -= useful_bits;
-		bs->bitpos += useful_bits;
-	}
+	int pos = find_startcode(bs->data, bs->length, bs_bits_read(bs) / 8);
+	if (pos == -1)
+		return 0;
 
-	return bits & ((1 << n) - 1);
+	bs_seek(bs, (pos + 3) * 8);
+	return 1;
 }
 
 typedef struct
@@ -84,9 +46,9 @@ typedef struct
 static void mpeg4_private_free(decoder_ctx_t *decoder)
 {
 	mpeg4_private_t *decoder_p = (mpeg4_private_t *)decoder->private;
-	cedrus_mem_free(decoder_p->mbh_buffer);
-	cedrus_mem_free(decoder_p->dcac_buffer);
-	cedrus_mem_free(decoder_p->ncf_buffer);
+	device_mem_free(decoder->device, decoder_p->mbh_buffer);
+	device_mem_free(decoder->device, decoder_p->dcac_buffer);
+	device_mem_free(decoder->device, decoder_p->ncf_buffer);
 	free(decoder_p);
 }
 
@@ -102,46 +64,124 @@ typedef struct
 	int vop_quant;
 } vop_header;
 
-static int decode_vop_header(bitstream *bs, VdpPictureInfoMPEG4Part2 const *info, vop_header *h)
+// enough bits to code vop_time_increment_resolution - 1, at least one
+static int time_increment_bits(VdpPictureInfoMPEG4Part2 const *info)
 {
-	h->vop_coding_type = get_bits(bs, 2);
+	if (info->vop_time_increment_resolution < 2)
+		return 1;
+
+	return 32 - __builtin_clz(info->vop_time_increment_resolution - 1);
+}
+
+static int decode_vop_header(bitstream_t *bs, VdpPictureInfoMPEG4Part2 const *info, vop_header *h)
+{
+	h->vop_coding_type = bs_get_u(bs, 2);
 
 	// modulo_time_base
-	while (get_bits(bs, 1) != 0);
+	while (bs_get_u(bs, 1) != 0);
 
-	if (get_bits(bs, 1) != 1)
+	if (bs_get_u(bs, 1) != 1)
 		VDPAU_DBG("vop header marker error");
 
 	// vop_time_increment
-	get_bits(bs, 32 - __builtin_clz(info->vop_time_increment_resolution));
+	bs_get_u(bs, time_increment_bits(info));
 
-	if (get_bits(bs, 1) != 1)
+	if (bs_get_u(bs, 1) != 1)
 		VDPAU_DBG("vop header marker error");
 
 	// vop_coded
-	if (!get_bits(bs, 1))
+	if (!bs_get_u(bs, 1))
 		return 0;
 
 	// rounding_type
 	if (h->vop_coding_type == VOP_P)
-		get_bits(bs, 1);
+		bs_get_u(bs, 1);
 
-	h->intra_dc_vlc_thr = get_bits(bs, 3);
+	h->intra_dc_vlc_thr = bs_get_u(bs, 3);
 
 	// assume default size of 5 bits
-	h->vop_quant = get_bits(bs, 5);
+	h->vop_quant = bs_get_u(bs, 5);
 
 	// vop_fcode_forward
 	if (h->vop_coding_type != VOP_I)
-		get_bits(bs, 3);
+		bs_get_u(bs, 3);
 
 	// vop_fcode_backward
 	if (h->vop_coding_type == VOP_B)
-		get_bits(bs, 3);
+		bs_get_u(bs, 3);
 
 	return 1;
 }
 
+typedef struct
+{
+	unsigned int bitpos;
+	int mb;
+	int quant;
+} video_packet;
+
+// the zeros of the marker plus the final one bit
+static int resync_marker_length(VdpPictureInfoMPEG4Part2 const *info, int vop_coding_type)
+{
+	if (vop_coding_type == VOP_I)
+		return 17;
+	else if (vop_coding_type == VOP_B)
+		return max(18, 16 + max(info->vop_fcode_forward, info->vop_fcode_backward));
+	else
+		return 16 + info->vop_fcode_forward;
+}
+
+/*
+ * Resync markers are byte aligned and can't be emulated by macroblock
+ * data, so a plain byte scan finds them. All of them are shorter than
+ * a start code.
+ */
+static int find_resync_marker(const uint8_t *data, int start, int end, int marker_length)
+{
+	int pos;
+
+	for (pos = start; pos + 2 < end; pos++)
+		if (data[pos] == 0x00 && data[pos + 1] == 0x00 && (data[pos + 2] >> (24 - marker_length)) == 0x1)
+			return pos;
+
+	return -1;
+}
+
+static int decode_video_packet_header(bitstream_t *bs, VdpPictureInfoMPEG4Part2 const *info, int marker_length, int mb_count, video_packet *p)
+{
+	bs_get_u(bs, marker_length);
+
+	p->mb = bs_get_u(bs, mb_count > 1 ? 32 - __builtin_clz(mb_count - 1) : 1);
+	p->quant = bs_get_u(bs, 5);
+
+	// header_extension_code, repeats the VOP header
+	if (bs_get_u(bs, 1))
+	{
+		while (bs_get_u(bs, 1) != 0);
+
+		if (bs_get_u(bs, 1) != 1)
+			VDPAU_DBG("video packet header marker error");
+
+		bs_get_u(bs, time_increment_bits(info));
+
+		if (bs_get_u(bs, 1) != 1)
+			VDPAU_DBG("video packet header marker error");
+
+		int vop_coding_type = bs_get_u(bs, 2);
+		bs_get_u(bs, 3);
+
+		if (vop_coding_type != VOP_I)
+			bs_get_u(bs, 3);
+
+		if (vop_coding_type == VOP_B)
+			bs_get_u(bs, 3);
+	}
+
+	p->bitpos = bs_bits_read(bs);
+
+	return p->mb > 0 && p->mb < mb_count && !bs_overrun(bs);
+}
+
 static VdpStatus mpeg4_decode(decoder_ctx_t *decoder,
                               VdpPictureInfo const *_info,
                               const int len,
@@ -150,25 +190,30 @@ static VdpStatus mpeg4_decode(decoder_ctx_t *decoder,
 	VdpPictureInfoMPEG4Part2 const *info = (VdpPictureInfoMPEG4Part2 const *)_info;
 	mpeg4_private_t *decoder_p = (mpeg4_private_t *)decoder->private;
 
-	if (!info->resync_marker_disable)
-	{
-		VDPAU_DBG("We can't decode VOPs with resync markers yet! Sorry");
-		return VDP_STATUS_ERROR;
-	}
+	// B-VOPs are never used for reference
+	if (decoder_skip_picture(decoder, info->vop_coding_type != 2))
+		return VDP_STATUS_OK;
 
 	VdpStatus ret = yuv_prepare(output);
 	if (ret != VDP_STATUS_OK)
 		return ret;
 
+	video_surface_ctx_t *sdrot;
+	uint32_t sdrot_ctrl;
+	ret = sdrot_prepare(decoder, output, &sdrot, &sdrot_ctrl);
+	if (ret != VDP_STATUS_OK)
+		return ret;
+
 	ret = rec_prepare(output);
 	if (ret != VDP_STATUS_OK)
 		return ret;
 
-	bitstream bs = { .data = cedrus_mem_get_pointer(decoder->data), .length = len, .bitpos = 0 };
+	bitstream_t bs;
+	bs_init(&bs, cedrus_mem_get_pointer(decoder->data), len, 0);
 
-	while (find_startcode(&bs))
+	while (next_startcode(&bs))
 	{
-		if (get_bits(&bs, 8) != 0xb6)
+		if (bs_get_u(&bs, 8) != 0xb6)
 			continue;
 
 		vop_header hdr;
@@ -176,23 +221,23 @@ static VdpStatus mpeg4_decode(decoder_ctx_t *decoder,
 			continue;
 
 		// activate MPEG engine
-		void *ve_regs = cedrus_ve_get(decoder->device->cedrus, CEDRUS_ENGINE_MPEG, 0);
+		void *ve_regs = decoder_ve_get(decoder, CEDRUS_ENGINE_MPEG, 0);
 
 		// set buffers
-		writel(cedrus_mem_get_bus_addr(decoder_p->mbh_buffer), ve_regs + VE_MPEG_MBH_ADDR);
-		writel(cedrus_mem_get_bus_addr(decoder_p->dcac_buffer), ve_regs + VE_MPEG_DCAC_ADDR);
-		writel(cedrus_mem_get_bus_addr(decoder_p->ncf_buffer), ve_regs + VE_MPEG_NCF_ADDR);
+		shadow_writel(&decoder->shadow, cedrus_mem_get_bus_addr(decoder_p->mbh_buffer), VE_MPEG_MBH_ADDR);
+		shadow_writel(&decoder->shadow, cedrus_mem_get_bus_addr(decoder_p->dcac_buffer), VE_MPEG_DCAC_ADDR);
+		shadow_writel(&decoder->shadow, cedrus_mem_get_bus_addr(decoder_p->ncf_buffer), VE_MPEG_NCF_ADDR);
 
 		// set output buffers
 		writel(cedrus_mem_get_bus_addr(output->rec), ve_regs + VE_MPEG_REC_LUMA);
 		writel(cedrus_mem_get_bus_addr(output->rec) + output->luma_size, ve_regs + VE_MPEG_REC_CHROMA);
-		writel(cedrus_mem_get_bus_addr(output->yuv->data), ve_regs + VE_MPEG_ROT_LUMA);
-		writel(cedrus_mem_get_bus_addr(output->yuv->data) + output->luma_size, ve_regs + VE_MPEG_ROT_CHROMA);
+		writel(cedrus_mem_get_bus_addr(sdrot->yuv->data), ve_regs + VE_MPEG_ROT_LUMA);
+		writel(cedrus_mem_get_bus_addr(sdrot->yuv->data) + sdrot->luma_size, ve_regs + VE_MPEG_ROT_CHROMA);
 
 		// ??
-		writel(0x40620000, ve_regs + VE_MPEG_SDROT_CTRL);
+		shadow_writel(&decoder->shadow, 0x40620000 | sdrot_ctrl, VE_MPEG_SDROT_CTRL);
 		if (cedrus_get_ve_version(decoder->device->cedrus) >= 0x1680)
-			writel((0x2 << 30) | (0x1 << 28) | (output->chroma_size / 2), ve_regs + VE_EXTRA_OUT_FMT_OFFSET);
+			shadow_writel(&decoder->shadow, (0x2 << 30) | (0x1 << 28) | (sdrot->chroma_size / 2), VE_EXTRA_OUT_FMT_OFFSET);
 
 		// set vop header
 		writel(((hdr.vop_coding_type == VOP_B ? 0x1 : 0x0) << 28)
@@ -211,18 +256,12 @@ static VdpStatus mpeg4_decode(decoder_ctx_t *decoder,
 		// set size
 		uint16_t width = (decoder->width + 15) / 16;
 		uint16_t height = (decoder->height + 15) / 16;
-		writel((((width + 1) & ~0x1) << 16) | (width << 8) | height, ve_regs + VE_MPEG_SIZE);
-		writel(((width * 16) << 16) | (height * 16), ve_regs + VE_MPEG_FRAME_SIZE);
-
-		// ??
-		writel(0x0, ve_regs + VE_MPEG_MBA);
+		shadow_writel(&decoder->shadow, (((width + 1) & ~0x1) << 16) | (width << 8) | height, VE_MPEG_SIZE);
+		shadow_writel(&decoder->shadow, ((width * 16) << 16) | (height * 16), VE_MPEG_FRAME_SIZE);
 
 		// enable interrupt, unknown control flags
 		writel(0x80084118 | ((cedrus_get_ve_version(decoder->device->cedrus) < 0x1680) << 7) | ((hdr.vop_coding_type == VOP_P ? 0x1 : 0x0) << 12), ve_regs + VE_MPEG_CTRL);
 
-		// set quantization parameter
-		writel(hdr.vop_quant, ve_regs + VE_MPEG_QP_INPUT);
-
 		// set forward/backward predicion buffers
 		if (info->forward_reference != VDP_INVALID_HANDLE)
 		{
@@ -245,32 +284,93 @@ static VdpStatus mpeg4_decode(decoder_ctx_t *decoder,
 			writel((info->trb[1] << 16) | (info->trd[1] << 0), ve_regs + VE_MPEG_TRBTRD_FIELD);
 		}
 
-		// clear status
-		writel(0xffffffff, ve_regs + VE_MPEG_STATUS);
-
-		// set input offset in bits
-		writel(bs.bitpos, ve_regs + VE_MPEG_VLD_OFFSET);
-
-		// set input length in bits
-		writel(len * 8 - bs.bitpos, ve_regs + VE_MPEG_VLD_LEN);
-
 		// input end
 		uint32_t input_addr = cedrus_mem_get_bus_addr(decoder->data);
-		writel(input_addr + VBV_SIZE - 1, ve_regs + VE_MPEG_VLD_END);
+		shadow_writel(&decoder->shadow, input_addr + VBV_SIZE - 1, VE_MPEG_VLD_END);
 
-		// set input buffer
-		writel((input_addr & 0x0ffffff0) | (input_addr >> 28) | (0x7 << 28), ve_regs + VE_MPEG_VLD_ADDR);
+		/*
+		 * Every video packet is decoded on its own, the CPU only finds
+		 * the packet boundaries and parses the packet headers.
+		 */
+		int mb_count = width * height;
+		int marker_length = resync_marker_length(info, hdr.vop_coding_type);
+		video_packet packet = { .bitpos = bs_bits_read(&bs), .mb = 0, .quant = hdr.vop_quant };
 
-		// trigger
-		writel(0x8400000d | ((width * height) << 8), ve_regs + VE_MPEG_TRIGGER);
+		int vop_end = find_startcode(bs.data, len, (bs_bits_read(&bs) + 7) / 8);
+		if (vop_end == -1)
+			vop_end = len;
 
-		cedrus_ve_wait(decoder->device->cedrus, 1);
+		while (1)
+		{
+			video_packet next = { 0 };
+			unsigned int end = len * 8;
+			int mb_end = mb_count;
+			int next_pos = -1;
+
+			if (!info->resync_marker_disable)
+				next_pos = find_resync_marker(bs.data, (packet.bitpos + 7) / 8, vop_end, marker_length);
+
+			if (next_pos != -1)
+			{
+				bs_seek(&bs, next_pos * 8);
+				if (decode_video_packet_header(&bs, info, marker_length, mb_count, &next) && next.mb > packet.mb)
+				{
+					end = next_pos * 8;
+					mb_end = next.mb;
+				}
+				else
+				{
+					VDPAU_DBG("Invalid video packet header");
+					next_pos = -1;
+				}
+			}
+
+			/*
+			 * Unverified on hardware: this assumes the VLD starts over at
+			 * VE_MPEG_MBA with the QP from the packet header and reads from
+			 * VE_MPEG_VLD_OFFSET, without looking for resync markers itself.
+			 * VE_MPEG_VOP_HDR bit 22 still tells it whether markers exist.
+			 */
+
+			// first macroblock of the packet
+			writel(((packet.mb % width) << 8) | (packet.mb / width), ve_regs + VE_MPEG_MBA);
+
+			// set quantization parameter
+			writel(packet.quant, ve_regs + VE_MPEG_QP_INPUT);
+
+			// clear status
+			writel(0xffffffff, ve_regs + VE_MPEG_STATUS);
+
+			// set input offset in bits
+			writel(packet.bitpos, ve_regs + VE_MPEG_VLD_OFFSET);
+
+			// set input length in bits
+			writel(end - packet.bitpos, ve_regs + VE_MPEG_VLD_LEN);
+
+			// set input buffer
+			writel((input_addr & 0x0ffffff0) | (input_addr >> 28) | (0x7 << 28), ve_regs + VE_MPEG_VLD_ADDR);
+
+			// trigger
+			writel(0x8400000d | ((mb_end - packet.mb) << 8), ve_regs + VE_MPEG_TRIGGER);
+
+			ret = decoder_ve_wait(decoder, ve_regs + VE_MPEG_STATUS, 0xf, mb_end - packet.mb);
+
+			// clear status
+			writel(readl(ve_regs + VE_MPEG_STATUS) | 0xf, ve_regs + VE_MPEG_STATUS);
+
+			if (ret != VDP_STATUS_OK || next_pos == -1)
+				break;
+
+			packet = next;
+		}
 
-		// clear status
-		writel(readl(ve_regs + VE_MPEG_STATUS) | 0xf, ve_regs + VE_MPEG_STATUS);
+		bs_seek(&bs, packet.bitpos);
 
 		// stop MPEG engine
-		cedrus_ve_put(decoder->device->cedrus);
+		decoder_ve_put(decoder);
+
+		if (ret != VDP_STATUS_OK)
+			return ret;
 	}
 
 	return VDP_STATUS_OK;
@@ -285,15 +385,15 @@ VdpStatus new_decoder_mpeg4(decoder_ctx_t *decoder)
 	int width = ((decoder->width + 15) / 16);
 	int height = ((decoder->height + 15) / 16);
 
-	decoder_p->mbh_buffer = cedrus_mem_alloc(decoder->device->cedrus, height * 2048);
+	decoder_p->mbh_buffer = device_mem_alloc(decoder->device, height * 2048, MEM_CODEC, decoder);
 	if (!decoder_p->mbh_buffer)
 		goto err_mbh;
 
-	decoder_p->dcac_buffer = cedrus_mem_alloc(decoder->device->cedrus, width * height * 2);
+	decoder_p->dcac_buffer = device_mem_alloc(decoder->device, width * height * 2, MEM_CODEC, decoder);
 	if (!decoder_p->dcac_buffer)
 		goto err_dcac;
 
-	decoder_p->ncf_buffer = cedrus_mem_alloc(decoder->device->cedrus, 4 * 1024);
+	decoder_p->ncf_buffer = device_mem_alloc(decoder->device, 4 * 1024, MEM_CODEC, decoder);
 	if (!decoder_p->ncf_buffer)
 		goto err_ncf;
 
@@ -304,9 +404,9 @@ VdpStatus new_decoder_mpeg4(decoder_ctx_t *decoder)
 	return VDP_STATUS_OK;
 
 err_ncf:
-	cedrus_mem_free(decoder_p->dcac_buffer);
+	device_mem_free(decoder->device, decoder_p->dcac_buffer);
 err_dcac:
-	cedrus_mem_free(decoder_p->mbh_buffer);
+	device_mem_free(decoder->device, decoder_p->mbh_buffer);
 err_mbh:
 	free(decoder_p);
 err_priv:
@@ -405,8 +405,8 @@ static vdpauSurfaceNV register_surface(int isOutputSurface,
 		nv->type = NV_SURFACE_VIDEO;
 		nv->vdpsurface = sref(vdpsurface);
 
-		nv->yuvY = cedrus_mem_alloc(vdpsurface->device->cedrus, vdpsurface->luma_size);
-		nv->yuvUV = cedrus_mem_alloc(vdpsurface->device->cedrus, vdpsurface->chroma_size);
+		nv->yuvY = device_mem_alloc(vdpsurface->device, vdpsurface->luma_size, MEM_INTEROP, nv);
+		nv->yuvUV = device_mem_alloc(vdpsurface->device, vdpsurface->chroma_size, MEM_INTEROP, nv);
 		nv->conv_width = (vdpsurface->width + 15) & ~15;
 		nv->conv_height = (vdpsurface->height + 15) & ~15;
 
@@ -584,8 +584,8 @@ void glVDPAUUnregisterSurfaceNV(vdpauSurfaceNV surface)
 
 		vdp_eglReleaseContext();
 
-		cedrus_mem_free(nv->yuvY);
-		cedrus_mem_free(nv->yuvUV);
+		device_mem_free(vdpsurface->device, nv->yuvY);
+		device_mem_free(vdpsurface->device, nv->yuvUV);
 
 		vdpsurface->nv_state = NV_UNREGISTERED;
 		sfree(vdpsurface);
@@ -750,6 +750,13 @@ void glVDPAUMapSurfacesNV(GLsizei numSurfaces,
 		{
 			video_surface_ctx_t *vdpsurface = (video_surface_ctx_t *)nv->vdpsurface;
 
+			/* The eglImage planes have the surface size, a picture rotated by 90 or 270 degrees doesn't fit them. */
+			if (vdpsurface->rotation & 1)
+			{
+				VDPAU_DBG("INTEROP: Error video surface is rotated");
+				return;
+			}
+
 			if (nv->access == NV_WRITE_DISCARD_NV)
 			{
 				/* Clear surface, because we only want to write from to it. */
@@ -71,6 +71,7 @@ static int video_surface_changed(video_surface_ctx_t *vs1, video_surface_ctx_t *
 	    (vs1 && !vs2) ||
 	    (vs1->height != vs2->height) ||
 	    (vs1->width != vs2->width) ||
+	    (vs1->rotation != vs2->rotation) ||
 	    (vs1->chroma_type != vs2->chroma_type) ||
 	    (vs1->source_format != vs2->source_format))
 		return 1;
@@ -134,7 +134,7 @@ VdpStatus rgba_create(rgba_surface_t *rgba,
 
 	if (device->osd_enabled)
 	{
-		rgba->data = cedrus_mem_alloc(device->cedrus, width * height * 4);
+		rgba->data = device_mem_alloc(device, width * height * 4, MEM_RGBA, rgba);
 		if (!rgba->data)
 			return VDP_STATUS_RESOURCES;
 
@@ -163,7 +163,7 @@ void rgba_destroy(rgba_surface_t *rgba)
 		if(!rgba->device->g2d_enabled)
 			vdp_pixman_unref(rgba);
 
-		cedrus_mem_free(rgba->data);
+		device_mem_free(rgba->device, rgba->data);
 	}
 
 	sfree(rgba->device);
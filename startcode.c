@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <string.h>
+#include "startcode.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BLOCK_SIZE 16
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define BLOCK_SIZE 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define BLOCK_SIZE 16
+#else
+#define BLOCK_SIZE 8
+#endif
+
+/*
+ * A start code needs two zero bytes, so a block without any zero byte
+ * can't contain the beginning of one and is skipped as a whole.
+ */
+static inline int block_has_zero(const uint8_t *p)
+{
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	uint8x16_t eq = vceqq_u8(vld1q_u8(p), vdupq_n_u8(0));
+#ifdef __aarch64__
+	return vmaxvq_u8(eq) != 0;
+#else
+	uint64x2_t eq64 = vreinterpretq_u64_u8(eq);
+	return (vgetq_lane_u64(eq64, 0) | vgetq_lane_u64(eq64, 1)) != 0;
+#endif
+#elif defined(__AVX2__)
+	__m256i v = _mm256_loadu_si256((const __m256i *)p);
+	return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256())) != 0;
+#elif defined(__SSE2__)
+	__m128i v = _mm_loadu_si128((const __m128i *)p);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0;
+#else
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return ((v - 0x0101010101010101ULL) & ~v & 0x8080808080808080ULL) != 0;
+#endif
+}
+
+int find_startcode(const uint8_t *data, int len, int start)
+{
+	int pos = start;
+
+	if (pos < 0)
+		return -1;
+
+	while (pos + BLOCK_SIZE + 2 <= len)
+	{
+		if (block_has_zero(data + pos))
+		{
+			int end = pos + BLOCK_SIZE;
+			for (; pos < end; pos++)
+				if (data[pos] == 0x00 && data[pos + 1] == 0x00 && data[pos + 2] == 0x01)
+					return pos;
+		}
+		else
+			pos += BLOCK_SIZE;
+	}
+
+	for (; pos + 2 < len; pos++)
+		if (data[pos] == 0x00 && data[pos + 1] == 0x00 && data[pos + 2] == 0x01)
+			return pos;
+
+	return -1;
+}
+
+int find_nal_unit(const uint8_t *data, int len, int *next, int nal_length_size)
+{
+	int pos = *next;
+
+	if (nal_length_size == 0)
+	{
+		pos = find_startcode(data, len, pos);
+		if (pos == -1)
+			return -1;
+
+		*next = pos + 3;
+		return pos + 3;
+	}
+
+	if (pos < 0 || pos + nal_length_size > len)
+		return -1;
+
+	uint32_t size = 0;
+	int i;
+	for (i = 0; i < nal_length_size; i++)
+		size = (size << 8) | data[pos + i];
+
+	pos += nal_length_size;
+	if (size == 0 || size > (uint32_t)(len - pos))
+		return -1;
+
+	*next = pos + size;
+	return pos;
+}
+
+int find_nal_units(const uint8_t *data, int len, int nal_length_size, int *offsets, int max)
+{
+	int count = 0;
+	int next = 0;
+	int pos;
+
+	while ((pos = find_nal_unit(data, len, &next, nal_length_size)) != -1)
+	{
+		if (count < max)
+			offsets[count] = pos;
+		count++;
+	}
+
+	return count;
+}
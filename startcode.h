@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __STARTCODE_H__
+#define __STARTCODE_H__
+
+#include <stdint.h>
+
+/*
+ * Returns the offset of the next 0x000001 start code prefix at or
+ * after start, or -1 if there is none.
+ */
+int find_startcode(const uint8_t *data, int len, int start);
+
+/*
+ * Returns the offset of the header of the next NAL unit, starting the
+ * search at *next, which is advanced past it. nal_length_size 0 means
+ * Annex B start codes, otherwise every NAL unit is preceded by its big
+ * endian length of that many bytes. Returns -1 if there is none.
+ */
+int find_nal_unit(const uint8_t *data, int len, int *next, int nal_length_size);
+
+/*
+ * Stores the header offsets of up to max NAL units. Returns the number
+ * of NAL units in the buffer, which is more than max if some of them
+ * didn't fit.
+ */
+int find_nal_units(const uint8_t *data, int len, int nal_length_size, int *offsets, int max);
+
+#endif
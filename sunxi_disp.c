@@ -204,8 +204,8 @@ static int sunxi_disp_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int
 		disp->video_info.fb.addr[1] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size;
 		disp->video_info.fb.addr[2] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size + surface->vs->chroma_size / 2;
 
-		disp->video_info.fb.size.width = surface->vs->width;
-		disp->video_info.fb.size.height = surface->vs->height;
+		disp->video_info.fb.size.width = display_width(surface->vs);
+		disp->video_info.fb.size.height = display_height(surface->vs);
 		disp->video_info.src_win.x = surface->video_src_rect.x0;
 		disp->video_info.src_win.y = surface->video_src_rect.y0;
 		disp->video_info.src_win.width = surface->video_src_rect.x1 - surface->video_src_rect.x0;
@@ -197,8 +197,8 @@ static int sunxi_disp1_5_set_video_layer(struct sunxi_disp *sunxi_disp, int x, i
 	disp->video_info.fb.addr[1] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size;
 	disp->video_info.fb.addr[2] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size + surface->vs->chroma_size / 2;
 
-	disp->video_info.fb.size.width = surface->vs->width;
-	disp->video_info.fb.size.height = surface->vs->height;
+	disp->video_info.fb.size.width = display_width(surface->vs);
+	disp->video_info.fb.size.height = display_height(surface->vs);
 	disp->video_info.fb.src_win = src;
 	disp->video_info.screen_win = scn;
 	disp->video_info.fb.pre_multiply = 1;
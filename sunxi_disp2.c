@@ -190,14 +190,14 @@ static int sunxi_disp2_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int
 	disp->video_config.info.fb.addr[1] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size;
 	disp->video_config.info.fb.addr[2] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size + surface->vs->chroma_size / 2;
 
-	disp->video_config.info.fb.size[0].width = surface->vs->width;
-	disp->video_config.info.fb.size[0].height = surface->vs->height;
+	disp->video_config.info.fb.size[0].width = display_width(surface->vs);
+	disp->video_config.info.fb.size[0].height = display_height(surface->vs);
 	disp->video_config.info.fb.align[0] = 32;
-	disp->video_config.info.fb.size[1].width = surface->vs->width / 2;
-	disp->video_config.info.fb.size[1].height = surface->vs->height / 2;
+	disp->video_config.info.fb.size[1].width = display_width(surface->vs) / 2;
+	disp->video_config.info.fb.size[1].height = display_height(surface->vs) / 2;
 	disp->video_config.info.fb.align[1] = 16;
-	disp->video_config.info.fb.size[2].width = surface->vs->width / 2;
-	disp->video_config.info.fb.size[2].height = surface->vs->height / 2;
+	disp->video_config.info.fb.size[2].width = display_width(surface->vs) / 2;
+	disp->video_config.info.fb.size[2].height = display_height(surface->vs) / 2;
 	disp->video_config.info.fb.align[2] = 16;
 	disp->video_config.info.fb.crop.x = (unsigned long long)(src.x) << 32;
 	disp->video_config.info.fb.crop.y = (unsigned long long)(src.y) << 32;
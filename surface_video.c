@@ -22,13 +22,170 @@
 #include "vdpau_private.h"
 #include "tiled_yuv.h"
 
+// free all cached buffers, returns the number of bytes freed
+static size_t yuv_pool_trim(yuv_pool_t *pool)
+{
+	cedrus_mem_t *data[YUV_POOL_MAX];
+	size_t freed = 0;
+	int count;
+
+	pthread_mutex_lock(&pool->mutex);
+	count = pool->count;
+	memcpy(data, pool->data, count * sizeof(data[0]));
+	while (pool->count > 0)
+		freed += pool->size[--pool->count];
+	pool->trimmed += count;
+	pthread_mutex_unlock(&pool->mutex);
+
+	while (count > 0)
+		mem_account_free(pool->mem, data[--count]);
+
+	return freed;
+}
+
+static size_t yuv_pool_shrink(mem_shrinker_t *shrinker)
+{
+	return yuv_pool_trim((yuv_pool_t *)shrinker);
+}
+
+void yuv_pool_init(device_ctx_t *device)
+{
+	yuv_pool_t *pool = &device->yuv_pool;
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pool->mem = &device->mem;
+	pool->cap = 4;
+
+	char *env_vdpau_yuv_pool = getenv("VDPAU_YUV_POOL");
+	if (env_vdpau_yuv_pool)
+		pool->cap = min(max(atoi(env_vdpau_yuv_pool), 0), YUV_POOL_MAX);
+
+	pool->shrinker.shrink = yuv_pool_shrink;
+	mem_shrinker_register(pool->mem, &pool->shrinker);
+}
+
+void yuv_pool_release(device_ctx_t *device)
+{
+	yuv_pool_t *pool = &device->yuv_pool;
+
+	mem_shrinker_unregister(pool->mem, &pool->shrinker);
+	VDPAU_DBG("YUV buffer pool: %lu hits, %lu misses, %lu trimmed", pool->hits, pool->misses, pool->trimmed);
+	yuv_pool_trim(pool);
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+static cedrus_mem_t *yuv_pool_get(device_ctx_t *device, int size, enum mem_category category, const void *owner)
+{
+	yuv_pool_t *pool = &device->yuv_pool;
+	cedrus_mem_t *mem = NULL;
+	int i;
+
+	pthread_mutex_lock(&pool->mutex);
+	// search from the end, most recently returned buffers are last
+	for (i = pool->count - 1; i >= 0; i--)
+		if (pool->size[i] == size)
+		{
+			mem = pool->data[i];
+			pool->count--;
+			memmove(&pool->data[i], &pool->data[i + 1], (pool->count - i) * sizeof(pool->data[0]));
+			memmove(&pool->size[i], &pool->size[i + 1], (pool->count - i) * sizeof(pool->size[0]));
+			break;
+		}
+
+	if (mem)
+		pool->hits++;
+	else
+		pool->misses++;
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (mem)
+		device_mem_retag(device, mem, category, owner);
+	else
+		mem = device_mem_alloc(device, size, category, owner);
+
+	return mem;
+}
+
+static void yuv_pool_put(device_ctx_t *device, cedrus_mem_t *mem, int size)
+{
+	yuv_pool_t *pool = &device->yuv_pool;
+	cedrus_mem_t *drop = NULL;
+
+	device_mem_retag(device, mem, MEM_CACHED, pool);
+
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->cap == 0)
+		drop = mem;
+	else
+	{
+		if (pool->count >= pool->cap)
+		{
+			// pool is full, drop the oldest buffer
+			drop = pool->data[0];
+			pool->count--;
+			memmove(&pool->data[0], &pool->data[1], pool->count * sizeof(pool->data[0]));
+			memmove(&pool->size[0], &pool->size[1], pool->count * sizeof(pool->size[0]));
+			pool->trimmed++;
+		}
+
+		pool->data[pool->count] = mem;
+		pool->size[pool->count] = size;
+		pool->count++;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (drop)
+		device_mem_free(device, drop);
+}
+
+// fill the pool with count buffers of the given size and keep them cached
+int yuv_pool_prewarm(device_ctx_t *device, int size, int count)
+{
+	yuv_pool_t *pool = &device->yuv_pool;
+	int i, cached = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (i = 0; i < pool->count; i++)
+		if (pool->size[i] == size)
+			cached++;
+	count = min(count - cached, YUV_POOL_MAX - pool->count);
+	pool->cap = max(pool->cap, pool->count + count);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < count; i++)
+	{
+		cedrus_mem_t *mem = device_mem_alloc(device, size, MEM_CACHED, pool);
+		if (!mem)
+			break;
+
+		pthread_mutex_lock(&pool->mutex);
+		if (pool->count < YUV_POOL_MAX)
+		{
+			pool->data[pool->count] = mem;
+			pool->size[pool->count] = size;
+			pool->count++;
+			mem = NULL;
+		}
+		pthread_mutex_unlock(&pool->mutex);
+
+		if (mem)
+		{
+			device_mem_free(device, mem);
+			break;
+		}
+	}
+
+	return cached + i;
+}
+
 void yuv_unref(yuv_data_t *yuv)
 {
 	yuv->ref_count--;
 
 	if (yuv->ref_count == 0)
 	{
-		cedrus_mem_free(yuv->data);
+		yuv_pool_put(yuv->device, yuv->data, yuv->size);
+		sfree(yuv->device);
 		free(yuv);
 	}
 }
@@ -39,21 +196,55 @@ yuv_data_t *yuv_ref(yuv_data_t *yuv)
 	return yuv;
 }
 
+// on failure the surface keeps its previous buffer
 static VdpStatus yuv_new(video_surface_ctx_t *video_surface)
 {
-	video_surface->yuv = calloc(1, sizeof(yuv_data_t));
-	if (!video_surface->yuv)
+	yuv_data_t *yuv = calloc(1, sizeof(yuv_data_t));
+	if (!yuv)
 		return VDP_STATUS_RESOURCES;
 
-	video_surface->yuv->ref_count = 1;
-	video_surface->yuv->data = cedrus_mem_alloc(video_surface->device->cedrus, video_surface->luma_size + video_surface->chroma_size);
+	yuv->ref_count = 1;
+	yuv->size = video_surface->luma_size + video_surface->chroma_size;
+	yuv->data = yuv_pool_get(video_surface->device, yuv->size, MEM_YUV, video_surface);
 
-	if (!(video_surface->yuv->data))
+	if (!yuv->data)
 	{
-		free(video_surface->yuv);
+		free(yuv);
 		return VDP_STATUS_RESOURCES;
 	}
 
+	yuv->device = sref(video_surface->device);
+	video_surface->yuv = yuv;
+	video_surface->yuv_generation++;
+
+	return VDP_STATUS_OK;
+}
+
+/*
+ * Plane sizes of a surface buffer. Buffers of 4:2:0 surfaces that SDROT
+ * writes rotated by a quarter turn get chroma planes big enough for
+ * either orientation, as the rotated planes are shorter but wider.
+ */
+VdpStatus video_surface_size(uint32_t width, uint32_t height, VdpChromaType chroma_type, uint32_t rotation, int *luma_size, int *chroma_size)
+{
+	*luma_size = ALIGN(width, 32) * ALIGN(height, 32);
+	switch (chroma_type)
+	{
+	case VDP_CHROMA_TYPE_444:
+		*chroma_size = *luma_size * 2;
+		break;
+	case VDP_CHROMA_TYPE_422:
+		*chroma_size = *luma_size;
+		break;
+	case VDP_CHROMA_TYPE_420:
+		*chroma_size = ALIGN(width, 32) * ALIGN(height / 2, 32);
+		if (rotation & 1)
+			*chroma_size = max(*chroma_size, ALIGN(height, 32) * ALIGN(width / 2, 32));
+		break;
+	default:
+		return VDP_STATUS_INVALID_CHROMA_TYPE;
+	}
+
 	return VDP_STATUS_OK;
 }
 
@@ -61,26 +252,121 @@ VdpStatus yuv_prepare(video_surface_ctx_t *video_surface)
 {
 	if (video_surface->yuv->ref_count > 1)
 	{
-		video_surface->yuv->ref_count--;
-		return yuv_new(video_surface);
+		yuv_data_t *shared = video_surface->yuv;
+
+		VdpStatus ret = yuv_new(video_surface);
+		if (ret != VDP_STATUS_OK)
+			return ret;
+
+		shared->ref_count--;
+	}
+
+	return VDP_STATUS_OK;
+}
+
+// resize the buffers of a surface for writing it with the given rotation
+static VdpStatus yuv_resize(video_surface_ctx_t *video_surface, uint32_t rotation)
+{
+	int luma_size, chroma_size;
+	VdpStatus ret = video_surface_size(video_surface->width, video_surface->height, video_surface->chroma_type, rotation, &luma_size, &chroma_size);
+	if (ret != VDP_STATUS_OK)
+		return ret;
+
+	if (luma_size == video_surface->luma_size && chroma_size == video_surface->chroma_size)
+		return VDP_STATUS_OK;
+
+	// rec_prepare() allocates it again with the new size
+	if (video_surface->rec_separate)
+	{
+		yuv_pool_put(video_surface->device, video_surface->rec, video_surface->luma_size + video_surface->chroma_size);
+		video_surface->rec_separate = 0;
 	}
 
+	if (video_surface->yuv->size < luma_size + chroma_size)
+	{
+		yuv_data_t *old = video_surface->yuv;
+		int old_luma_size = video_surface->luma_size, old_chroma_size = video_surface->chroma_size;
+
+		video_surface->luma_size = luma_size;
+		video_surface->chroma_size = chroma_size;
+
+		ret = yuv_new(video_surface);
+		if (ret != VDP_STATUS_OK)
+		{
+			video_surface->luma_size = old_luma_size;
+			video_surface->chroma_size = old_chroma_size;
+			return ret;
+		}
+
+		yuv_unref(old);
+	}
+
+	video_surface->luma_size = luma_size;
+	video_surface->chroma_size = chroma_size;
+
 	return VDP_STATUS_OK;
 }
 
 VdpStatus rec_prepare(video_surface_ctx_t *video_surface)
 {
-	if (cedrus_get_ve_version(video_surface->device->cedrus) >= 0x1680)
+	// older engines can share the buffer, unless SDROT writes a rotated copy to it
+	if (cedrus_get_ve_version(video_surface->device->cedrus) >= 0x1680 || video_surface->rotation)
 	{
-		if (!video_surface->rec)
+		if (!video_surface->rec_separate)
 		{
-			video_surface->rec = cedrus_mem_alloc(video_surface->device->cedrus, video_surface->luma_size + video_surface->chroma_size);
+			video_surface->rec = yuv_pool_get(video_surface->device, video_surface->luma_size + video_surface->chroma_size, MEM_REC, video_surface);
 			if (!video_surface->rec)
 				return VDP_STATUS_RESOURCES;
+			video_surface->rec_separate = 1;
 		}
 	}
 	else
+	{
+		if (video_surface->rec_separate)
+		{
+			yuv_pool_put(video_surface->device, video_surface->rec, video_surface->luma_size + video_surface->chroma_size);
+			video_surface->rec_separate = 0;
+		}
 		video_surface->rec = video_surface->yuv->data;
+	}
+
+	return VDP_STATUS_OK;
+}
+
+/*
+ * Select the surface the SDROT unit writes the display copy of a decoded
+ * picture to, and the SDROT_CTRL bits needed for it. Without a scaled
+ * output attached this is the surface itself, unscaled. Has to be
+ * called before rec_prepare(), which depends on the rotation.
+ */
+VdpStatus sdrot_prepare(decoder_ctx_t *decoder, video_surface_ctx_t *video_surface, video_surface_ctx_t **target, uint32_t *ctrl)
+{
+	*target = video_surface;
+	*ctrl = SDROT_CTRL_ROTATE(decoder->rotation);
+
+	if (!video_surface->scaled)
+	{
+		video_surface->rotation = decoder->rotation;
+		return yuv_resize(video_surface, decoder->rotation);
+	}
+
+	VdpStatus ret = yuv_resize(video_surface, 0);
+	if (ret != VDP_STATUS_OK)
+		return ret;
+
+	ret = yuv_prepare(video_surface->scaled);
+	if (ret != VDP_STATUS_OK)
+		return ret;
+
+	ret = yuv_resize(video_surface->scaled, decoder->rotation);
+	if (ret != VDP_STATUS_OK)
+		return ret;
+
+	video_surface->rotation = 0;
+	video_surface->scaled->source_format = INTERNAL_YCBCR_FORMAT;
+	video_surface->scaled->rotation = decoder->rotation;
+	*target = video_surface->scaled;
+	*ctrl |= SDROT_CTRL_SCALE(video_surface->scale);
 
 	return VDP_STATUS_OK;
 }
@@ -89,13 +375,17 @@ static void cleanup_video_surface(void *ptr, void *meta)
 {
 	video_surface_ctx_t *surface = ptr;
 
+	sfree(surface->scaled);
+
 	if (surface->decoder_private_free)
 		surface->decoder_private_free(surface);
 
-	if (surface->rec && surface->rec != surface->yuv->data)
-		cedrus_mem_free(surface->rec);
+	if (surface->rec_separate)
+		yuv_pool_put(surface->device, surface->rec, surface->luma_size + surface->chroma_size);
 
-	yuv_unref(surface->yuv);
+	// NULL if the surface couldn't be created
+	if (surface->yuv)
+		yuv_unref(surface->yuv);
 
 	sfree(surface->device);
 }
@@ -125,30 +415,64 @@ VdpStatus vdp_video_surface_create(VdpDevice device,
 	vs->height = height;
 	vs->chroma_type = chroma_type;
 
-	vs->luma_size = ALIGN(width, 32) * ALIGN(height, 32);
-	switch (chroma_type)
-	{
-	case VDP_CHROMA_TYPE_444:
-		vs->chroma_size = vs->luma_size * 2;
-		break;
-	case VDP_CHROMA_TYPE_422:
-		vs->chroma_size = vs->luma_size;
-		break;
-	case VDP_CHROMA_TYPE_420:
-		vs->chroma_size = ALIGN(vs->width, 32) * ALIGN(vs->height / 2, 32);
-		break;
-	default:
-		handle_destroy(*surface);
-		return VDP_STATUS_INVALID_CHROMA_TYPE;
-	}
+	VdpStatus ret = video_surface_size(width, height, chroma_type, 0, &vs->luma_size, &vs->chroma_size);
+	if (ret != VDP_STATUS_OK)
+		return ret;
 
-	VdpStatus ret = yuv_new(vs);
+	ret = yuv_new(vs);
 	if (ret != VDP_STATUS_OK)
 		return ret;
 
 	return handle_create(surface, vs);
 }
 
+VdpStatus vdp_video_surface_destroy(VdpVideoSurface surface)
+{
+	smart video_surface_ctx_t *vs = handle_get(surface);
+	if (!vs)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	// the handle may be reused, tell decoders caching it
+	__sync_fetch_and_add(&vs->device->surface_generation, 1);
+
+	return handle_destroy(surface);
+}
+
+VdpStatus vdp_video_surface_set_scaled_output_sunxi(VdpVideoSurface surface,
+                                                    VdpVideoSurface scaled_surface,
+                                                    uint32_t scale)
+{
+	smart video_surface_ctx_t *vs = handle_get(surface);
+	if (!vs)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (scale > 3)
+		return VDP_STATUS_INVALID_VALUE;
+
+	sfree(vs->scaled);
+	vs->scaled = NULL;
+	vs->scale = 0;
+
+	if (scale == 0)
+		return VDP_STATUS_OK;
+
+	smart video_surface_ctx_t *scaled = handle_get(scaled_surface);
+	if (!scaled || scaled == vs || scaled->scaled)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (scaled->chroma_type != VDP_CHROMA_TYPE_420 || vs->chroma_type != VDP_CHROMA_TYPE_420)
+		return VDP_STATUS_INVALID_CHROMA_TYPE;
+
+	// SDROT fills exactly this much, a larger surface would show garbage
+	if (scaled->width != (vs->width + (1 << scale) - 1) >> scale || scaled->height != (vs->height + (1 << scale) - 1) >> scale)
+		return VDP_STATUS_INVALID_SIZE;
+
+	vs->scaled = sref(scaled);
+	vs->scale = scale;
+
+	return VDP_STATUS_OK;
+}
+
 VdpStatus vdp_video_surface_get_parameters(VdpVideoSurface surface,
                                            VdpChromaType *chroma_type,
                                            uint32_t *width,
@@ -182,6 +506,10 @@ VdpStatus vdp_video_surface_get_bits_y_cb_cr(VdpVideoSurface surface,
 	if (vs->chroma_type != VDP_CHROMA_TYPE_420 || vs->source_format != INTERNAL_YCBCR_FORMAT)
 		return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
 
+	// the picture doesn't fit the surface size anymore
+	if (vs->rotation & 1)
+		return VDP_STATUS_ERROR;
+
 	if (destination_pitches[0] < vs->width || destination_pitches[1] < vs->width / 2)
 		return VDP_STATUS_ERROR;
 
@@ -222,6 +550,7 @@ VdpStatus vdp_video_surface_put_bits_y_cb_cr(VdpVideoSurface surface,
 		return ret;
 
 	vs->source_format = source_ycbcr_format;
+	vs->rotation = 0;
 
 	switch (source_ycbcr_format)
 	{
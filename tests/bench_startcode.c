@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include "startcode.h"
+#include "test.h"
+
+#define BUFFER_SIZE (8 * 1024 * 1024)
+#define ROUNDS 20
+
+static int scalar_find_startcode(const uint8_t *data, int len, int start)
+{
+	int pos;
+
+	for (pos = start; pos + 2 < len; pos++)
+		if (data[pos] == 0x00 && data[pos + 1] == 0x00 && data[pos + 2] == 0x01)
+			return pos;
+
+	return -1;
+}
+
+static uint64_t get_time(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (uint64_t)tp.tv_sec * 1000000000ULL + (uint64_t)tp.tv_nsec;
+}
+
+static double bench(int (*scan)(const uint8_t *, int, int), const uint8_t *data, int len, int *found)
+{
+	uint64_t start = get_time();
+	int round, pos;
+
+	for (round = 0; round < ROUNDS; round++)
+	{
+		*found = 0;
+		for (pos = 0; (pos = scan(data, len, pos)) != -1; pos += 3)
+			(*found)++;
+	}
+
+	return (double)len * ROUNDS / (get_time() - start) * 1000.0;
+}
+
+int main(void)
+{
+	uint8_t *data = malloc(BUFFER_SIZE);
+	int i, found_scalar, found_vector;
+
+	if (!data)
+		return 1;
+
+	// slice data is close to random, with a start code every 64 KiB
+	for (i = 0; i < BUFFER_SIZE; i++)
+		data[i] = test_rand();
+	for (i = 0; i + 2 < BUFFER_SIZE; i++)
+		if (data[i] == 0x00 && data[i + 1] == 0x00 && data[i + 2] <= 0x03)
+			data[i + 2] = 0x03;
+	for (i = 0; i + 2 < BUFFER_SIZE; i += 65536)
+	{
+		data[i] = 0x00;
+		data[i + 1] = 0x00;
+		data[i + 2] = 0x01;
+	}
+
+	double scalar = bench(scalar_find_startcode, data, BUFFER_SIZE, &found_scalar);
+	double vector = bench(find_startcode, data, BUFFER_SIZE, &found_vector);
+
+	printf("find_startcode: scalar %.0f MB/s, vectorised %.0f MB/s (%.1fx), %d start codes\n",
+		scalar, vector, vector / scalar, found_vector);
+
+	free(data);
+
+	return found_scalar != found_vector;
+}
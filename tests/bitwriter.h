@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __BITWRITER_H__
+#define __BITWRITER_H__
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Writes the syntax elements of synthetic bitstreams for the codec tests,
+ * the counterpart of bitstream.h. Writes past the end are dropped.
+ */
+typedef struct
+{
+	uint8_t data[4096];
+	unsigned int bits;
+} bitwriter_t;
+
+static inline void bw_init(bitwriter_t *bw)
+{
+	memset(bw, 0, sizeof(*bw));
+}
+
+static inline void bw_put_u(bitwriter_t *bw, uint32_t val, int num)
+{
+	while (num--)
+	{
+		if (bw->bits / 8 < sizeof(bw->data) && ((val >> num) & 0x1))
+			bw->data[bw->bits / 8] |= 0x80 >> (bw->bits % 8);
+		bw->bits++;
+	}
+}
+
+static inline void bw_put_ue(bitwriter_t *bw, uint32_t val)
+{
+	int len = 32 - __builtin_clz(val + 1);
+
+	bw_put_u(bw, 0, len - 1);
+	bw_put_u(bw, val + 1, len);
+}
+
+static inline void bw_put_se(bitwriter_t *bw, int32_t val)
+{
+	bw_put_ue(bw, val > 0 ? 2 * val - 1 : -2 * val);
+}
+
+// rbsp_trailing_bits(), also used as byte_alignment() before slice data
+static inline void bw_trailing_bits(bitwriter_t *bw)
+{
+	bw_put_u(bw, 1, 1);
+	while (bw->bits % 8)
+		bw_put_u(bw, 0, 1);
+}
+
+static inline void bw_put_bytes(bitwriter_t *bw, const uint8_t *bytes, int len)
+{
+	while (len--)
+		bw_put_u(bw, *bytes++, 8);
+}
+
+static inline unsigned int bw_bytes(const bitwriter_t *bw)
+{
+	return (bw->bits + 7) / 8;
+}
+
+/*
+ * Appends the content as NAL unit with start code to dst at *pos,
+ * inserting emulation prevention bytes.
+ */
+static inline void bw_nal_unit(const bitwriter_t *bw, uint8_t *dst, int *pos)
+{
+	unsigned int i, zeros = 0;
+
+	dst[(*pos)++] = 0x00;
+	dst[(*pos)++] = 0x00;
+	dst[(*pos)++] = 0x01;
+
+	for (i = 0; i < bw_bytes(bw); i++)
+	{
+		if (zeros >= 2 && bw->data[i] <= 0x03)
+		{
+			dst[(*pos)++] = 0x03;
+			zeros = 0;
+		}
+
+		dst[(*pos)++] = bw->data[i];
+		zeros = bw->data[i] ? 0 : zeros + 1;
+	}
+}
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "h265_slice.h"
+#include "bitstream.h"
+#include "h265_gen.h"
+#include "test.h"
+
+/*
+ * Fuzz target for the HEVC slice header parser. The first INFO_BYTES
+ * of the input select the picture parameters, the rest is a NAL unit
+ * without start code. Build with "make fuzz" for libFuzzer, otherwise
+ * main() below mutates generated headers and runs as part of "make check".
+ */
+
+#define INFO_BYTES 16
+
+static void info_from_bytes(VdpPictureInfoHEVC *info, const uint8_t *d)
+{
+	memset(info, 0, sizeof(*info));
+
+	info->chroma_format_idc = d[0] & 0x3;
+	info->separate_colour_plane_flag = info->chroma_format_idc == 3 ? (d[0] >> 2) & 0x1 : 0;
+	info->log2_min_luma_coding_block_size_minus3 = (d[0] >> 3) & 0x1;
+	info->log2_diff_max_min_luma_coding_block_size = ((d[0] >> 4) & 0x3) % (4 - info->log2_min_luma_coding_block_size_minus3);
+	info->pic_width_in_luma_samples = ((d[1] | d[2] << 8) % 512 + 1) * 8;
+	info->pic_height_in_luma_samples = ((d[3] | d[4] << 8) % 288 + 1) * 8;
+	info->log2_max_pic_order_cnt_lsb_minus4 = d[5] % 13;
+	info->long_term_ref_pics_present_flag = (d[6] >> 0) & 0x1;
+	info->sps_temporal_mvp_enabled_flag = (d[6] >> 1) & 0x1;
+	info->sample_adaptive_offset_enabled_flag = (d[6] >> 2) & 0x1;
+	info->dependent_slice_segments_enabled_flag = (d[6] >> 3) & 0x1;
+	info->output_flag_present_flag = (d[6] >> 4) & 0x1;
+	info->cabac_init_present_flag = (d[6] >> 5) & 0x1;
+	info->pps_slice_chroma_qp_offsets_present_flag = (d[6] >> 6) & 0x1;
+	info->weighted_pred_flag = (d[6] >> 7) & 0x1;
+	info->weighted_bipred_flag = (d[7] >> 0) & 0x1;
+	info->tiles_enabled_flag = (d[7] >> 1) & 0x1;
+	info->entropy_coding_sync_enabled_flag = (d[7] >> 2) & 0x1;
+	info->pps_loop_filter_across_slices_enabled_flag = (d[7] >> 3) & 0x1;
+	info->deblocking_filter_override_enabled_flag = (d[7] >> 4) & 0x1;
+	info->pps_deblocking_filter_disabled_flag = (d[7] >> 5) & 0x1;
+	info->lists_modification_present_flag = (d[7] >> 6) & 0x1;
+	info->slice_segment_header_extension_present_flag = (d[7] >> 7) & 0x1;
+	info->num_extra_slice_header_bits = d[8] % 3;
+	info->num_ref_idx_l0_default_active_minus1 = d[9] % 15;
+	info->num_ref_idx_l1_default_active_minus1 = d[10] % 15;
+	info->pps_beta_offset_div2 = d[11] % 13 - 6;
+	info->pps_tc_offset_div2 = d[12] % 13 - 6;
+	info->NumPocTotalCurr = d[13] % 17;
+	info->NumShortTermPictureSliceHeaderBits = d[14];
+	info->NumLongTermPictureSliceHeaderBits = d[15];
+}
+
+static uint32_t pic_size_in_ctbs;
+
+// what the decoder relies on after a successful parse
+static void check_header(struct h265_slice_header const *s, VdpPictureInfoHEVC const *info)
+{
+	int i;
+
+	if (s->slice_segment_address >= pic_size_in_ctbs || s->slice_type > SLICE_I)
+		abort();
+
+	if (s->num_entry_point_offsets > MAX_ENTRY_POINTS || s->offset_len_minus1 > 31)
+		abort();
+
+	if (s->dependent_slice_segment_flag || s->slice_type == SLICE_I)
+		return;
+
+	if (s->num_ref_idx_l0_active_minus1 > 14 || s->num_ref_idx_l1_active_minus1 > 14)
+		abort();
+
+	if (s->collocated_ref_idx > (s->collocated_from_l0_flag ? s->num_ref_idx_l0_active_minus1 : s->num_ref_idx_l1_active_minus1))
+		abort();
+
+	if (s->five_minus_max_num_merge_cand > 4)
+		abort();
+
+	if (s->ref_pic_list_modification_flag_l0)
+		for (i = 0; i <= s->num_ref_idx_l0_active_minus1; i++)
+			if (s->list_entry_l0[i] >= info->NumPocTotalCurr)
+				abort();
+
+	if (s->ref_pic_list_modification_flag_l1 && s->slice_type == SLICE_B)
+		for (i = 0; i <= s->num_ref_idx_l1_active_minus1; i++)
+			if (s->list_entry_l1[i] >= info->NumPocTotalCurr)
+				abort();
+
+	if ((info->weighted_pred_flag && s->slice_type == SLICE_P) || (info->weighted_bipred_flag && s->slice_type == SLICE_B))
+		if (s->luma_log2_weight_denom > 7 || s->luma_log2_weight_denom + s->delta_chroma_log2_weight_denom < 0 || s->luma_log2_weight_denom + s->delta_chroma_log2_weight_denom > 7)
+			abort();
+}
+
+static struct h265_slice_header slice;
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	VdpPictureInfoHEVC info;
+	bitstream_t bs;
+
+	if (size < INFO_BYTES)
+		return 0;
+
+	info_from_bytes(&info, data);
+	pic_size_in_ctbs = gen_pic_size_in_ctbs(&info);
+
+	bs_init(&bs, data + INFO_BYTES, size - INFO_BYTES, 1);
+	bs_get_u(&bs, 1);
+	uint8_t nal_unit_type = bs_get_u(&bs, 6);
+	bs_get_u(&bs, 9);
+
+	// every input is a picture of its own
+	memset(&slice, 0, sizeof(slice));
+	if (h265_slice_header(&slice, &bs, &info, nal_unit_type))
+		check_header(&slice, &info);
+
+	return 0;
+}
+
+#ifndef LIBFUZZER
+
+static uint8_t input[INFO_BYTES + 8192];
+
+static size_t seed(void)
+{
+	VdpPictureInfoHEVC info;
+	struct h265_slice_header e;
+	bitwriter_t bw;
+	int i, len = 0;
+
+	for (i = 0; i < INFO_BYTES; i++)
+		input[i] = test_rand();
+
+	info_from_bytes(&info, input);
+	memset(&e, 0, sizeof(e));
+	bw_init(&bw);
+	gen_slice(&bw, &info, test_rand() % 22, test_rand() % 2, &e);
+
+	// without the start code
+	uint8_t nal[8192 + 3];
+	bw_nal_unit(&bw, nal, &len);
+	memcpy(input + INFO_BYTES, nal + 3, len - 3);
+
+	return INFO_BYTES + len - 3;
+}
+
+int main(int argc, char **argv)
+{
+	int i, j, iterations = argc > 1 ? atoi(argv[1]) : 20000;
+
+	for (i = 0; i < iterations; i++)
+	{
+		size_t size = seed();
+
+		switch (test_rand() % 4)
+		{
+		case 0:
+			for (j = test_rand() % 8; j >= 0; j--)
+				input[test_rand() % size] ^= 1 << (test_rand() % 8);
+			break;
+
+		case 1:
+			size = test_rand() % (size + 1);
+			break;
+
+		case 2:
+			memset(input + INFO_BYTES + test_rand() % (size - INFO_BYTES), test_rand() & 0x1 ? 0x00 : 0xff, test_rand() % 16);
+			break;
+
+		default:
+			input[INFO_BYTES + test_rand() % (size - INFO_BYTES)] = test_rand();
+			break;
+		}
+
+		LLVMFuzzerTestOneInput(input, size);
+	}
+
+	return test_result("fuzz_h265_slice");
+}
+
+#endif
@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __H265_GEN_H__
+#define __H265_GEN_H__
+
+#include <string.h>
+#include "h265_slice.h"
+#include "bitwriter.h"
+#include "test.h"
+
+/*
+ * Random picture parameters and slice segment headers following the
+ * syntax of ITU-T H.265 7.3.6, written independently of the parser.
+ * gen_slice() fills in what a conforming parser has to return.
+ */
+
+#define gen_bits(n) (test_rand() % (1u << (n)))
+#define gen_range(lo, hi) ((int)(lo) + (int)(test_rand() % ((hi) - (lo) + 1)))
+
+static inline int gen_ceil_log2(uint32_t n)
+{
+	return n <= 1 ? 0 : 32 - __builtin_clz(n - 1);
+}
+
+static inline uint32_t gen_pic_size_in_ctbs(VdpPictureInfoHEVC const *info)
+{
+	int ctb = 1 << (info->log2_min_luma_coding_block_size_minus3 + 3 + info->log2_diff_max_min_luma_coding_block_size);
+
+	return ((info->pic_width_in_luma_samples + ctb - 1) / ctb) * ((info->pic_height_in_luma_samples + ctb - 1) / ctb);
+}
+
+// random content for syntax the parser skips
+static inline void gen_skipped_bits(bitwriter_t *bw, int num)
+{
+	for (; num > 16; num -= 16)
+		bw_put_u(bw, gen_bits(16), 16);
+
+	bw_put_u(bw, gen_bits(num), num);
+}
+
+static inline void gen_info(VdpPictureInfoHEVC *info)
+{
+	memset(info, 0, sizeof(*info));
+
+	info->chroma_format_idc = gen_range(0, 3);
+	info->separate_colour_plane_flag = info->chroma_format_idc == 3 ? gen_bits(1) : 0;
+	info->log2_min_luma_coding_block_size_minus3 = gen_range(0, 1);
+	info->log2_diff_max_min_luma_coding_block_size = gen_range(0, 3 - info->log2_min_luma_coding_block_size_minus3);
+	info->pic_width_in_luma_samples = gen_range(1, 512) * 8;
+	info->pic_height_in_luma_samples = gen_range(1, 288) * 8;
+	info->log2_max_pic_order_cnt_lsb_minus4 = gen_range(0, 12);
+	info->long_term_ref_pics_present_flag = gen_bits(1);
+	info->sps_temporal_mvp_enabled_flag = gen_bits(1);
+	info->sample_adaptive_offset_enabled_flag = gen_bits(1);
+	info->dependent_slice_segments_enabled_flag = gen_bits(1);
+	info->output_flag_present_flag = gen_bits(1);
+	info->num_extra_slice_header_bits = gen_range(0, 2);
+	info->cabac_init_present_flag = gen_bits(1);
+	info->num_ref_idx_l0_default_active_minus1 = gen_range(0, 14);
+	info->num_ref_idx_l1_default_active_minus1 = gen_range(0, 14);
+	info->pps_slice_chroma_qp_offsets_present_flag = gen_bits(1);
+	info->weighted_pred_flag = gen_bits(1);
+	info->weighted_bipred_flag = gen_bits(1);
+	info->tiles_enabled_flag = gen_bits(1);
+	info->entropy_coding_sync_enabled_flag = gen_bits(1);
+	info->pps_loop_filter_across_slices_enabled_flag = gen_bits(1);
+	info->deblocking_filter_override_enabled_flag = gen_bits(1);
+	info->pps_deblocking_filter_disabled_flag = gen_bits(1);
+	info->pps_beta_offset_div2 = gen_range(0, 12) - 6;
+	info->pps_tc_offset_div2 = gen_range(0, 12) - 6;
+	info->lists_modification_present_flag = gen_bits(1);
+	info->slice_segment_header_extension_present_flag = gen_bits(1);
+	info->NumPocTotalCurr = gen_range(0, 8);
+	info->NumShortTermPictureSliceHeaderBits = gen_range(0, 20);
+	info->NumLongTermPictureSliceHeaderBits = gen_range(0, 20);
+}
+
+static inline void gen_pred_weight_table(bitwriter_t *bw, VdpPictureInfoHEVC const *info, struct h265_slice_header *e)
+{
+	int chroma = !info->separate_colour_plane_flag && info->chroma_format_idc;
+	int i, j, l;
+
+	e->luma_log2_weight_denom = gen_range(0, 7);
+	bw_put_ue(bw, e->luma_log2_weight_denom);
+	e->delta_chroma_log2_weight_denom = 0;
+	if (chroma)
+	{
+		e->delta_chroma_log2_weight_denom = gen_range(0, 7) - e->luma_log2_weight_denom;
+		bw_put_se(bw, e->delta_chroma_log2_weight_denom);
+	}
+
+	for (l = 0; l < (e->slice_type == SLICE_B ? 2 : 1); l++)
+	{
+		int count = (l ? e->num_ref_idx_l1_active_minus1 : e->num_ref_idx_l0_active_minus1) + 1;
+		uint8_t *luma_flag = l ? e->luma_weight_l1_flag : e->luma_weight_l0_flag;
+		uint8_t *chroma_flag = l ? e->chroma_weight_l1_flag : e->chroma_weight_l0_flag;
+		int8_t *luma_weight = l ? e->delta_luma_weight_l1 : e->delta_luma_weight_l0;
+		int8_t *luma_offset = l ? e->luma_offset_l1 : e->luma_offset_l0;
+		int8_t (*chroma_weight)[2] = l ? e->delta_chroma_weight_l1 : e->delta_chroma_weight_l0;
+		int16_t (*chroma_offset)[2] = l ? e->delta_chroma_offset_l1 : e->delta_chroma_offset_l0;
+
+		for (i = 0; i < count; i++)
+		{
+			luma_flag[i] = gen_bits(1);
+			bw_put_u(bw, luma_flag[i], 1);
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			chroma_flag[i] = chroma ? gen_bits(1) : 0;
+			if (chroma)
+				bw_put_u(bw, chroma_flag[i], 1);
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			if (luma_flag[i])
+			{
+				luma_weight[i] = gen_range(0, 255) - 128;
+				luma_offset[i] = gen_range(0, 255) - 128;
+				bw_put_se(bw, luma_weight[i]);
+				bw_put_se(bw, luma_offset[i]);
+			}
+
+			if (chroma_flag[i])
+				for (j = 0; j < 2; j++)
+				{
+					chroma_weight[i][j] = gen_range(0, 255) - 128;
+					chroma_offset[i][j] = gen_range(0, 1023) - 512;
+					bw_put_se(bw, chroma_weight[i][j]);
+					bw_put_se(bw, chroma_offset[i][j]);
+				}
+		}
+	}
+}
+
+/*
+ * Writes a slice segment header for info into bw, after the NAL unit
+ * header. e holds the previous slice segment of the picture, it is
+ * updated to what the parser has to return. Dependent slice segments
+ * are only generated if first is 0.
+ */
+static inline void gen_slice(bitwriter_t *bw, VdpPictureInfoHEVC const *info, uint8_t nal_unit_type, int first, struct h265_slice_header *e)
+{
+	int i, l;
+
+	bw_put_u(bw, 0, 1);
+	bw_put_u(bw, nal_unit_type, 6);
+	bw_put_u(bw, 0, 6);
+	bw_put_u(bw, 1, 3);
+
+	e->first_slice_segment_in_pic_flag = first;
+	bw_put_u(bw, first, 1);
+	e->no_output_of_prior_pics_flag = 0;
+	if (nal_unit_type >= 16 && nal_unit_type <= 23)
+	{
+		e->no_output_of_prior_pics_flag = gen_bits(1);
+		bw_put_u(bw, e->no_output_of_prior_pics_flag, 1);
+	}
+
+	e->slice_pic_parameter_set_id = gen_range(0, 63);
+	bw_put_ue(bw, e->slice_pic_parameter_set_id);
+
+	e->dependent_slice_segment_flag = 0;
+	e->slice_segment_address = 0;
+	if (!first)
+	{
+		if (info->dependent_slice_segments_enabled_flag)
+		{
+			e->dependent_slice_segment_flag = gen_bits(1);
+			bw_put_u(bw, e->dependent_slice_segment_flag, 1);
+		}
+
+		uint32_t ctbs = gen_pic_size_in_ctbs(info);
+		e->slice_segment_address = ctbs > 1 ? gen_range(1, ctbs - 1) : 0;
+		bw_put_u(bw, e->slice_segment_address, gen_ceil_log2(ctbs));
+	}
+
+	if (!e->dependent_slice_segment_flag)
+	{
+		bw_put_u(bw, 0, info->num_extra_slice_header_bits);
+
+		e->slice_type = nal_unit_type >= 16 ? SLICE_I : gen_range(0, 2);
+		bw_put_ue(bw, e->slice_type);
+
+		e->pic_output_flag = 1;
+		e->colour_plane_id = 0;
+		e->slice_pic_order_cnt_lsb = 0;
+		e->short_term_ref_pic_set_sps_flag = 0;
+		e->num_ref_idx_active_override_flag = 0;
+		e->ref_pic_list_modification_flag_l0 = 0;
+		e->ref_pic_list_modification_flag_l1 = 0;
+		e->mvd_l1_zero_flag = 0;
+		e->cabac_init_flag = 0;
+		e->five_minus_max_num_merge_cand = 0;
+		e->slice_cb_qp_offset = 0;
+		e->slice_cr_qp_offset = 0;
+		e->deblocking_filter_override_flag = 0;
+		if (info->output_flag_present_flag)
+		{
+			e->pic_output_flag = gen_bits(1);
+			bw_put_u(bw, e->pic_output_flag, 1);
+		}
+
+		if (info->separate_colour_plane_flag)
+		{
+			e->colour_plane_id = gen_range(0, 2);
+			bw_put_u(bw, e->colour_plane_id, 2);
+		}
+
+		e->slice_temporal_mvp_enabled_flag = 0;
+		if (nal_unit_type != 19 && nal_unit_type != 20)
+		{
+			e->slice_pic_order_cnt_lsb = gen_bits(info->log2_max_pic_order_cnt_lsb_minus4 + 4);
+			bw_put_u(bw, e->slice_pic_order_cnt_lsb, info->log2_max_pic_order_cnt_lsb_minus4 + 4);
+
+			e->short_term_ref_pic_set_sps_flag = gen_bits(1);
+			bw_put_u(bw, e->short_term_ref_pic_set_sps_flag, 1);
+
+			// st_ref_pic_set() and the long-term part are only skipped
+			gen_skipped_bits(bw, info->NumShortTermPictureSliceHeaderBits);
+			if (info->long_term_ref_pics_present_flag)
+				gen_skipped_bits(bw, info->NumLongTermPictureSliceHeaderBits);
+
+			if (info->sps_temporal_mvp_enabled_flag)
+			{
+				e->slice_temporal_mvp_enabled_flag = gen_bits(1);
+				bw_put_u(bw, e->slice_temporal_mvp_enabled_flag, 1);
+			}
+		}
+
+		e->slice_sao_luma_flag = 0;
+		e->slice_sao_chroma_flag = 0;
+		if (info->sample_adaptive_offset_enabled_flag)
+		{
+			e->slice_sao_luma_flag = gen_bits(1);
+			bw_put_u(bw, e->slice_sao_luma_flag, 1);
+			if (!info->separate_colour_plane_flag && info->chroma_format_idc)
+			{
+				e->slice_sao_chroma_flag = gen_bits(1);
+				bw_put_u(bw, e->slice_sao_chroma_flag, 1);
+			}
+		}
+
+		e->num_ref_idx_l0_active_minus1 = info->num_ref_idx_l0_default_active_minus1;
+		e->num_ref_idx_l1_active_minus1 = info->num_ref_idx_l1_default_active_minus1;
+		e->collocated_from_l0_flag = 1;
+		e->collocated_ref_idx = 0;
+
+		if (e->slice_type != SLICE_I)
+		{
+			e->num_ref_idx_active_override_flag = gen_bits(1);
+			bw_put_u(bw, e->num_ref_idx_active_override_flag, 1);
+			if (e->num_ref_idx_active_override_flag)
+			{
+				e->num_ref_idx_l0_active_minus1 = gen_range(0, 14);
+				bw_put_ue(bw, e->num_ref_idx_l0_active_minus1);
+				if (e->slice_type == SLICE_B)
+				{
+					e->num_ref_idx_l1_active_minus1 = gen_range(0, 14);
+					bw_put_ue(bw, e->num_ref_idx_l1_active_minus1);
+				}
+			}
+
+			if (info->lists_modification_present_flag && info->NumPocTotalCurr > 1)
+			{
+				for (l = 0; l < (e->slice_type == SLICE_B ? 2 : 1); l++)
+				{
+					uint8_t *flag = l ? &e->ref_pic_list_modification_flag_l1 : &e->ref_pic_list_modification_flag_l0;
+					uint8_t *entry = l ? e->list_entry_l1 : e->list_entry_l0;
+					int count = (l ? e->num_ref_idx_l1_active_minus1 : e->num_ref_idx_l0_active_minus1) + 1;
+
+					*flag = gen_bits(1);
+					bw_put_u(bw, *flag, 1);
+					if (*flag)
+						for (i = 0; i < count; i++)
+						{
+							entry[i] = test_rand() % info->NumPocTotalCurr;
+							bw_put_u(bw, entry[i], gen_ceil_log2(info->NumPocTotalCurr));
+						}
+				}
+			}
+
+			if (e->slice_type == SLICE_B)
+			{
+				e->mvd_l1_zero_flag = gen_bits(1);
+				bw_put_u(bw, e->mvd_l1_zero_flag, 1);
+			}
+
+			if (info->cabac_init_present_flag)
+			{
+				e->cabac_init_flag = gen_bits(1);
+				bw_put_u(bw, e->cabac_init_flag, 1);
+			}
+
+			if (e->slice_temporal_mvp_enabled_flag)
+			{
+				if (e->slice_type == SLICE_B)
+				{
+					e->collocated_from_l0_flag = gen_bits(1);
+					bw_put_u(bw, e->collocated_from_l0_flag, 1);
+				}
+
+				if ((e->collocated_from_l0_flag && e->num_ref_idx_l0_active_minus1 > 0) || (!e->collocated_from_l0_flag && e->num_ref_idx_l1_active_minus1 > 0))
+				{
+					e->collocated_ref_idx = gen_range(0, e->collocated_from_l0_flag ? e->num_ref_idx_l0_active_minus1 : e->num_ref_idx_l1_active_minus1);
+					bw_put_ue(bw, e->collocated_ref_idx);
+				}
+			}
+
+			if ((info->weighted_pred_flag && e->slice_type == SLICE_P) || (info->weighted_bipred_flag && e->slice_type == SLICE_B))
+				gen_pred_weight_table(bw, info, e);
+
+			e->five_minus_max_num_merge_cand = gen_range(0, 4);
+			bw_put_ue(bw, e->five_minus_max_num_merge_cand);
+		}
+
+		e->slice_qp_delta = gen_range(0, 50) - 25;
+		bw_put_se(bw, e->slice_qp_delta);
+
+		if (info->pps_slice_chroma_qp_offsets_present_flag)
+		{
+			e->slice_cb_qp_offset = gen_range(0, 24) - 12;
+			e->slice_cr_qp_offset = gen_range(0, 24) - 12;
+			bw_put_se(bw, e->slice_cb_qp_offset);
+			bw_put_se(bw, e->slice_cr_qp_offset);
+		}
+
+		e->slice_deblocking_filter_disabled_flag = info->pps_deblocking_filter_disabled_flag;
+		e->slice_beta_offset_div2 = info->pps_beta_offset_div2;
+		e->slice_tc_offset_div2 = info->pps_tc_offset_div2;
+		if (info->deblocking_filter_override_enabled_flag)
+		{
+			e->deblocking_filter_override_flag = gen_bits(1);
+			bw_put_u(bw, e->deblocking_filter_override_flag, 1);
+		}
+
+		if (e->deblocking_filter_override_flag)
+		{
+			e->slice_deblocking_filter_disabled_flag = gen_bits(1);
+			bw_put_u(bw, e->slice_deblocking_filter_disabled_flag, 1);
+			if (!e->slice_deblocking_filter_disabled_flag)
+			{
+				e->slice_beta_offset_div2 = gen_range(0, 12) - 6;
+				e->slice_tc_offset_div2 = gen_range(0, 12) - 6;
+				bw_put_se(bw, e->slice_beta_offset_div2);
+				bw_put_se(bw, e->slice_tc_offset_div2);
+			}
+		}
+
+		e->slice_loop_filter_across_slices_enabled_flag = info->pps_loop_filter_across_slices_enabled_flag;
+		if (info->pps_loop_filter_across_slices_enabled_flag && (e->slice_sao_luma_flag || e->slice_sao_chroma_flag || !e->slice_deblocking_filter_disabled_flag))
+		{
+			e->slice_loop_filter_across_slices_enabled_flag = gen_bits(1);
+			bw_put_u(bw, e->slice_loop_filter_across_slices_enabled_flag, 1);
+		}
+	}
+
+	e->num_entry_point_offsets = 0;
+	if (info->tiles_enabled_flag || info->entropy_coding_sync_enabled_flag)
+	{
+		e->num_entry_point_offsets = gen_range(0, 16);
+		bw_put_ue(bw, e->num_entry_point_offsets);
+		if (e->num_entry_point_offsets)
+		{
+			e->offset_len_minus1 = gen_range(0, 31);
+			bw_put_ue(bw, e->offset_len_minus1);
+			for (i = 0; i < e->num_entry_point_offsets; i++)
+			{
+				e->entry_point_offset_minus1[i] = e->offset_len_minus1 == 31 ? test_rand() : gen_bits(e->offset_len_minus1 + 1);
+				bw_put_u(bw, e->entry_point_offset_minus1[i], e->offset_len_minus1 + 1);
+			}
+		}
+	}
+
+	if (info->slice_segment_header_extension_present_flag)
+	{
+		int len = gen_range(0, 4);
+		bw_put_ue(bw, len);
+		bw_put_u(bw, 0, len * 8);
+	}
+
+	bw_trailing_bits(bw);
+}
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Reference counted allocations with the libcsptr interface, implemented
+ * in mock/driver.c.
+ */
+
+#ifndef __MOCK_SMART_PTR_H__
+#define __MOCK_SMART_PTR_H__
+
+#include <stddef.h>
+
+typedef void (*f_destructor)(void *ptr, void *meta);
+
+enum pointer_kind
+{
+	UNIQUE,
+	SHARED,
+};
+
+void *smalloc(size_t size, size_t nmemb, enum pointer_kind kind, f_destructor destructor);
+void *sref(void *ptr);
+void sfree(void *ptr);
+void sfree_stack(void *ptr);
+
+#define smart __attribute__((cleanup(sfree_stack)))
+
+#endif
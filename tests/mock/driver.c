@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "driver.h"
+#include "tiled_yuv.h"
+
+mock_ve_t mock_ve;
+int mock_ve_version = 0x1680;
+unsigned long mock_ve_gets;
+
+unsigned long mock_mem_allocs, mock_mem_frees;
+
+static void __attribute__((constructor)) mock_driver_init(void)
+{
+	mock_ve_init(&mock_ve);
+}
+
+/*
+ * libcsptr
+ */
+
+struct smart_meta
+{
+	int ref_count;
+	f_destructor destructor;
+};
+
+void *smalloc(size_t size, size_t nmemb, enum pointer_kind kind, f_destructor destructor)
+{
+	struct smart_meta *meta = malloc(sizeof(*meta) + size);
+	if (!meta)
+		return NULL;
+
+	meta->ref_count = 1;
+	meta->destructor = destructor;
+
+	return meta + 1;
+}
+
+void *sref(void *ptr)
+{
+	struct smart_meta *meta = (struct smart_meta *)ptr - 1;
+
+	__sync_fetch_and_add(&meta->ref_count, 1);
+
+	return ptr;
+}
+
+void sfree(void *ptr)
+{
+	if (!ptr)
+		return;
+
+	struct smart_meta *meta = (struct smart_meta *)ptr - 1;
+	if (__sync_sub_and_fetch(&meta->ref_count, 1))
+		return;
+
+	if (meta->destructor)
+		meta->destructor(ptr, NULL);
+
+	free(meta);
+}
+
+void sfree_stack(void *ptr)
+{
+	sfree(*(void **)ptr);
+}
+
+/*
+ * libcedrus, buffers get increasing fake bus addresses
+ */
+
+struct cedrus_mem
+{
+	void *virt;
+	size_t size;
+	uint32_t bus;
+};
+
+static uint32_t next_bus_addr = 0x40000000;
+
+int cedrus_get_ve_version(cedrus_t *dev)
+{
+	return mock_ve_version;
+}
+
+void *cedrus_ve_get(cedrus_t *dev, enum cedrus_engine engine, uint32_t flags)
+{
+	mock_ve_gets++;
+
+	return mock_ve.regs;
+}
+
+void cedrus_ve_put(cedrus_t *dev)
+{
+}
+
+int cedrus_ve_wait(cedrus_t *dev, int timeout)
+{
+	return 1;
+}
+
+cedrus_mem_t *cedrus_mem_alloc(cedrus_t *dev, size_t size)
+{
+	cedrus_mem_t *mem = malloc(sizeof(*mem));
+	if (!mem)
+		return NULL;
+
+	mem->virt = calloc(1, size);
+	if (!mem->virt)
+	{
+		free(mem);
+		return NULL;
+	}
+
+	mem->size = size;
+	mem->bus = __sync_fetch_and_add(&next_bus_addr, ALIGN(size, 4096));
+	__sync_fetch_and_add(&mock_mem_allocs, 1);
+
+	return mem;
+}
+
+void cedrus_mem_free(cedrus_mem_t *mem)
+{
+	if (!mem)
+		return;
+
+	free(mem->virt);
+	free(mem);
+	__sync_fetch_and_add(&mock_mem_frees, 1);
+}
+
+void cedrus_mem_flush_cache(cedrus_mem_t *mem)
+{
+}
+
+void *cedrus_mem_get_pointer(const cedrus_mem_t *mem)
+{
+	return mem->virt;
+}
+
+uint32_t cedrus_mem_get_phys_addr(const cedrus_mem_t *mem)
+{
+	return mem->bus;
+}
+
+uint32_t cedrus_mem_get_bus_addr(const cedrus_mem_t *mem)
+{
+	return mem->bus;
+}
+
+/*
+ * tiled_yuv.S is ARM only, the tests don't look at the pixels
+ */
+
+void tiled_to_planar(void *src, void *dst, unsigned int dst_pitch,
+                     unsigned int width, unsigned int height)
+{
+}
+
+void tiled_deinterleave_to_planar(void *src, void *dst1, void *dst2,
+                                  unsigned int dst_pitch,
+                                  unsigned int width, unsigned int height)
+{
+}
+
+/*
+ * codecs not linked into a test
+ */
+
+__attribute__((weak)) VdpStatus new_decoder_mpeg12(decoder_ctx_t *decoder)
+{
+	return VDP_STATUS_INVALID_DECODER_PROFILE;
+}
+
+__attribute__((weak)) VdpStatus new_decoder_h264(decoder_ctx_t *decoder)
+{
+	return VDP_STATUS_INVALID_DECODER_PROFILE;
+}
+
+__attribute__((weak)) VdpStatus new_decoder_mpeg4(decoder_ctx_t *decoder)
+{
+	return VDP_STATUS_INVALID_DECODER_PROFILE;
+}
+
+__attribute__((weak)) VdpStatus new_decoder_h265(decoder_ctx_t *decoder)
+{
+	return VDP_STATUS_INVALID_DECODER_PROFILE;
+}
+
+/*
+ * device.c without the display parts
+ */
+
+static void cleanup_device(void *ptr, void *meta)
+{
+	device_ctx_t *device = ptr;
+
+	yuv_pool_release(device);
+	mem_account_release(&device->mem);
+	ve_sched_release(&device->ve_sched);
+}
+
+VdpStatus mock_device_create(int ve_exclusive, int prewarm, VdpDevice *device)
+{
+	smart device_ctx_t *dev = handle_alloc(sizeof(*dev), cleanup_device);
+	if (!dev)
+		return VDP_STATUS_RESOURCES;
+
+	mem_account_init(&dev->mem, dev->cedrus, 0);
+	ve_sched_init(&dev->ve_sched);
+	yuv_pool_init(dev);
+	dev->ve_exclusive = ve_exclusive;
+	dev->prewarm_enabled = prewarm;
+
+	return handle_create(device, dev);
+}
+
+void mock_ve_foreign_use(VdpDevice device)
+{
+	smart device_ctx_t *dev = handle_get(device);
+
+	dev->ve_owner = NULL;
+}
+
+cedrus_mem_t *device_mem_alloc(device_ctx_t *device, size_t size, enum mem_category category, const void *owner)
+{
+	return mem_account_alloc(&device->mem, size, category, owner);
+}
+
+void device_mem_free(device_ctx_t *device, cedrus_mem_t *mem)
+{
+	mem_account_free(&device->mem, mem);
+}
+
+void device_mem_retag(device_ctx_t *device, cedrus_mem_t *mem, enum mem_category category, const void *owner)
+{
+	mem_account_retag(&device->mem, mem, category, owner);
+}
+
+// vdp_decoder_render() with the bitstream in a single buffer
+VdpStatus mock_decoder_render(VdpDecoder decoder, VdpVideoSurface target, VdpPictureInfo const *info, const void *data, int len)
+{
+	VdpBitstreamBuffer buffer = {
+		.bitstream = data,
+		.bitstream_bytes = len,
+	};
+
+	return vdp_decoder_render(decoder, target, info, 1, &buffer);
+}
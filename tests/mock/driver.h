@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * The hardware and device level parts of the driver, so that decoder.c,
+ * surface_video.c and the codecs run on top of the mock VE. The codec
+ * under test is linked in by the test itself, the others report an
+ * unsupported profile.
+ */
+
+#ifndef __MOCK_DRIVER_H__
+#define __MOCK_DRIVER_H__
+
+#include "vdpau_private.h"
+#include "ve.h"
+
+// the VE handed out by cedrus_ve_get()
+extern mock_ve_t mock_ve;
+extern int mock_ve_version;
+extern unsigned long mock_ve_gets;
+
+// CMA allocations done through cedrus_mem_alloc()
+extern unsigned long mock_mem_allocs, mock_mem_frees;
+
+VdpStatus mock_device_create(int ve_exclusive, int prewarm, VdpDevice *device);
+
+// another user took the VE, as seen by the next decoder_ve_get()
+void mock_ve_foreign_use(VdpDevice device);
+
+VdpStatus mock_decoder_render(VdpDecoder decoder, VdpVideoSurface target, VdpPictureInfo const *info, const void *data, int len);
+
+#endif
@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * The parts of the VDPAU API the driver sources use, so they build for
+ * the tests without libvdpau. Status, chroma and format values match the
+ * real header, the API entry points not used by the tests are declared
+ * without prototypes.
+ */
+
+#ifndef __MOCK_VDPAU_H__
+#define __MOCK_VDPAU_H__
+
+#include <stdint.h>
+
+#define VDP_TRUE 1
+#define VDP_FALSE 0
+#define VDP_INVALID_HANDLE 0xffffffffU
+
+typedef int VdpBool;
+typedef uint32_t VdpChromaType;
+typedef uint32_t VdpYCbCrFormat;
+typedef uint32_t VdpRGBAFormat;
+typedef uint32_t VdpFuncId;
+typedef uint32_t VdpDecoderProfile;
+typedef uint32_t VdpPresentationQueueStatus;
+typedef uint32_t VdpOutputSurfaceRenderBlendFactor;
+typedef uint32_t VdpOutputSurfaceRenderBlendEquation;
+typedef uint32_t VdpDevice;
+typedef uint32_t VdpVideoSurface;
+typedef uint32_t VdpOutputSurface;
+typedef uint32_t VdpDecoder;
+typedef uint64_t VdpTime;
+
+typedef enum
+{
+	VDP_STATUS_OK = 0,
+	VDP_STATUS_NO_IMPLEMENTATION,
+	VDP_STATUS_DISPLAY_PREEMPTED,
+	VDP_STATUS_INVALID_HANDLE,
+	VDP_STATUS_INVALID_POINTER,
+	VDP_STATUS_INVALID_CHROMA_TYPE,
+	VDP_STATUS_INVALID_Y_CB_CR_FORMAT,
+	VDP_STATUS_INVALID_RGBA_FORMAT,
+	VDP_STATUS_INVALID_INDEXED_FORMAT,
+	VDP_STATUS_INVALID_COLOR_STANDARD,
+	VDP_STATUS_INVALID_COLOR_TABLE_FORMAT,
+	VDP_STATUS_INVALID_BLEND_FACTOR,
+	VDP_STATUS_INVALID_BLEND_EQUATION,
+	VDP_STATUS_INVALID_FLAG,
+	VDP_STATUS_INVALID_DECODER_PROFILE,
+	VDP_STATUS_INVALID_VIDEO_MIXER_FEATURE,
+	VDP_STATUS_INVALID_VIDEO_MIXER_PARAMETER,
+	VDP_STATUS_INVALID_VIDEO_MIXER_ATTRIBUTE,
+	VDP_STATUS_INVALID_VIDEO_MIXER_PICTURE_STRUCTURE,
+	VDP_STATUS_INVALID_FUNC_ID,
+	VDP_STATUS_INVALID_SIZE,
+	VDP_STATUS_INVALID_VALUE,
+	VDP_STATUS_INVALID_STRUCT_VERSION,
+	VDP_STATUS_RESOURCES,
+	VDP_STATUS_HANDLE_DEVICE_MISMATCH,
+	VDP_STATUS_ERROR,
+} VdpStatus;
+
+#define VDP_CHROMA_TYPE_420 ((VdpChromaType)0)
+#define VDP_CHROMA_TYPE_422 ((VdpChromaType)1)
+#define VDP_CHROMA_TYPE_444 ((VdpChromaType)2)
+
+#define VDP_YCBCR_FORMAT_NV12     ((VdpYCbCrFormat)0)
+#define VDP_YCBCR_FORMAT_YV12     ((VdpYCbCrFormat)1)
+#define VDP_YCBCR_FORMAT_UYVY     ((VdpYCbCrFormat)2)
+#define VDP_YCBCR_FORMAT_YUYV     ((VdpYCbCrFormat)3)
+#define VDP_YCBCR_FORMAT_Y8U8V8A8 ((VdpYCbCrFormat)4)
+#define VDP_YCBCR_FORMAT_V8U8Y8A8 ((VdpYCbCrFormat)5)
+
+#define VDP_DECODER_PROFILE_MPEG1                     ((VdpDecoderProfile)0)
+#define VDP_DECODER_PROFILE_MPEG2_SIMPLE              ((VdpDecoderProfile)1)
+#define VDP_DECODER_PROFILE_MPEG2_MAIN                ((VdpDecoderProfile)2)
+#define VDP_DECODER_PROFILE_H264_BASELINE             ((VdpDecoderProfile)6)
+#define VDP_DECODER_PROFILE_H264_MAIN                 ((VdpDecoderProfile)7)
+#define VDP_DECODER_PROFILE_H264_HIGH                 ((VdpDecoderProfile)8)
+#define VDP_DECODER_PROFILE_VC1_SIMPLE                ((VdpDecoderProfile)9)
+#define VDP_DECODER_PROFILE_VC1_MAIN                  ((VdpDecoderProfile)10)
+#define VDP_DECODER_PROFILE_VC1_ADVANCED              ((VdpDecoderProfile)11)
+#define VDP_DECODER_PROFILE_MPEG4_PART2_SP            ((VdpDecoderProfile)12)
+#define VDP_DECODER_PROFILE_MPEG4_PART2_ASP           ((VdpDecoderProfile)13)
+#define VDP_DECODER_PROFILE_H264_CONSTRAINED_BASELINE ((VdpDecoderProfile)19)
+#define VDP_DECODER_PROFILE_H264_CONSTRAINED_HIGH     ((VdpDecoderProfile)21)
+#define VDP_DECODER_PROFILE_HEVC_MAIN                 ((VdpDecoderProfile)100)
+
+#define VDP_DECODER_LEVEL_MPEG1_NA           0
+#define VDP_DECODER_LEVEL_MPEG2_HL           3
+#define VDP_DECODER_LEVEL_H264_5_1           51
+#define VDP_DECODER_LEVEL_MPEG4_PART2_ASP_L5 5
+#define VDP_DECODER_LEVEL_HEVC_5             150
+
+#define VDP_FUNC_ID_BASE_DRIVER ((VdpFuncId)0x2000)
+
+typedef struct
+{
+	uint32_t x0, y0, x1, y1;
+} VdpRect;
+
+typedef struct
+{
+	float red, green, blue, alpha;
+} VdpColor;
+
+typedef float VdpCSCMatrix[3][4];
+
+typedef struct
+{
+	uint32_t struct_version;
+	VdpOutputSurfaceRenderBlendFactor blend_factor_source_color;
+	VdpOutputSurfaceRenderBlendFactor blend_factor_destination_color;
+	VdpOutputSurfaceRenderBlendFactor blend_factor_source_alpha;
+	VdpOutputSurfaceRenderBlendFactor blend_factor_destination_alpha;
+	VdpOutputSurfaceRenderBlendEquation blend_equation_color;
+	VdpOutputSurfaceRenderBlendEquation blend_equation_alpha;
+	VdpColor blend_constant;
+} VdpOutputSurfaceRenderBlendState;
+
+typedef struct
+{
+	uint32_t struct_version;
+	void const *bitstream;
+	uint32_t bitstream_bytes;
+} VdpBitstreamBuffer;
+
+typedef void VdpPictureInfo;
+
+typedef void VdpPreemptionCallback(VdpDevice device, void *context);
+
+typedef struct
+{
+	VdpVideoSurface surface;
+	VdpBool is_long_term;
+	VdpBool top_is_reference;
+	VdpBool bottom_is_reference;
+	int32_t field_order_cnt[2];
+	uint16_t frame_idx;
+} VdpReferenceFrameH264;
+
+typedef struct
+{
+	uint32_t slice_count;
+	int32_t field_order_cnt[2];
+	VdpBool is_reference;
+	uint16_t frame_num;
+	uint8_t field_pic_flag;
+	uint8_t bottom_field_flag;
+	uint8_t num_ref_frames;
+	uint8_t mb_adaptive_frame_field_flag;
+	uint8_t constrained_intra_pred_flag;
+	uint8_t weighted_pred_flag;
+	uint8_t weighted_bipred_idc;
+	uint8_t frame_mbs_only_flag;
+	uint8_t transform_8x8_mode_flag;
+	int8_t chroma_qp_index_offset;
+	int8_t second_chroma_qp_index_offset;
+	int8_t pic_init_qp_minus26;
+	uint8_t num_ref_idx_l0_active_minus1;
+	uint8_t num_ref_idx_l1_active_minus1;
+	uint8_t log2_max_frame_num_minus4;
+	uint8_t pic_order_cnt_type;
+	uint8_t log2_max_pic_order_cnt_lsb_minus4;
+	uint8_t delta_pic_order_always_zero_flag;
+	uint8_t direct_8x8_inference_flag;
+	uint8_t entropy_coding_mode_flag;
+	uint8_t pic_order_present_flag;
+	uint8_t deblocking_filter_control_present_flag;
+	uint8_t redundant_pic_cnt_present_flag;
+	uint8_t scaling_lists_4x4[6][16];
+	uint8_t scaling_lists_8x8[2][64];
+	VdpReferenceFrameH264 referenceFrames[16];
+} VdpPictureInfoH264;
+
+typedef struct
+{
+	VdpVideoSurface forward_reference;
+	VdpVideoSurface backward_reference;
+	int32_t trd[2];
+	int32_t trb[2];
+	uint16_t vop_time_increment_resolution;
+	uint8_t vop_coding_type;
+	uint8_t vop_fcode_forward;
+	uint8_t vop_fcode_backward;
+	uint8_t resync_marker_disable;
+	uint8_t interlaced;
+	uint8_t quant_type;
+	uint8_t quarter_sample;
+	uint8_t short_video_header;
+	uint8_t rounding_control;
+	uint8_t alternate_vertical_scan_flag;
+	uint8_t top_field_first;
+	uint8_t intra_quantizer_matrix[64];
+	uint8_t non_intra_quantizer_matrix[64];
+} VdpPictureInfoMPEG4Part2;
+
+typedef struct
+{
+	uint8_t chroma_format_idc;
+	uint8_t separate_colour_plane_flag;
+	uint32_t pic_width_in_luma_samples;
+	uint32_t pic_height_in_luma_samples;
+	uint8_t bit_depth_luma_minus8;
+	uint8_t bit_depth_chroma_minus8;
+	uint8_t log2_max_pic_order_cnt_lsb_minus4;
+	uint8_t sps_max_dec_pic_buffering_minus1;
+	uint8_t log2_min_luma_coding_block_size_minus3;
+	uint8_t log2_diff_max_min_luma_coding_block_size;
+	uint8_t log2_min_transform_block_size_minus2;
+	uint8_t log2_diff_max_min_transform_block_size;
+	uint8_t max_transform_hierarchy_depth_inter;
+	uint8_t max_transform_hierarchy_depth_intra;
+	uint8_t scaling_list_enabled_flag;
+	uint8_t ScalingList4x4[6][16];
+	uint8_t ScalingList8x8[6][64];
+	uint8_t ScalingList16x16[6][64];
+	uint8_t ScalingList32x32[2][64];
+	uint8_t ScalingListDCCoeff16x16[6];
+	uint8_t ScalingListDCCoeff32x32[2];
+	uint8_t amp_enabled_flag;
+	uint8_t sample_adaptive_offset_enabled_flag;
+	uint8_t pcm_enabled_flag;
+	uint8_t pcm_sample_bit_depth_luma_minus1;
+	uint8_t pcm_sample_bit_depth_chroma_minus1;
+	uint8_t log2_min_pcm_luma_coding_block_size_minus3;
+	uint8_t log2_diff_max_min_pcm_luma_coding_block_size;
+	uint8_t pcm_loop_filter_disabled_flag;
+	uint8_t num_short_term_ref_pic_sets;
+	uint8_t long_term_ref_pics_present_flag;
+	uint8_t num_long_term_ref_pics_sps;
+	uint8_t sps_temporal_mvp_enabled_flag;
+	uint8_t strong_intra_smoothing_enabled_flag;
+	uint8_t dependent_slice_segments_enabled_flag;
+	uint8_t output_flag_present_flag;
+	uint8_t num_extra_slice_header_bits;
+	uint8_t sign_data_hiding_enabled_flag;
+	uint8_t cabac_init_present_flag;
+	uint8_t num_ref_idx_l0_default_active_minus1;
+	uint8_t num_ref_idx_l1_default_active_minus1;
+	int8_t init_qp_minus26;
+	uint8_t constrained_intra_pred_flag;
+	uint8_t transform_skip_enabled_flag;
+	uint8_t cu_qp_delta_enabled_flag;
+	uint8_t diff_cu_qp_delta_depth;
+	int8_t pps_cb_qp_offset;
+	int8_t pps_cr_qp_offset;
+	uint8_t pps_slice_chroma_qp_offsets_present_flag;
+	uint8_t weighted_pred_flag;
+	uint8_t weighted_bipred_flag;
+	uint8_t transquant_bypass_enabled_flag;
+	uint8_t tiles_enabled_flag;
+	uint8_t entropy_coding_sync_enabled_flag;
+	uint8_t num_tile_columns_minus1;
+	uint8_t num_tile_rows_minus1;
+	uint8_t uniform_spacing_flag;
+	uint16_t column_width_minus1[20];
+	uint16_t row_height_minus1[22];
+	uint8_t loop_filter_across_tiles_enabled_flag;
+	uint8_t pps_loop_filter_across_slices_enabled_flag;
+	uint8_t deblocking_filter_control_present_flag;
+	uint8_t deblocking_filter_override_enabled_flag;
+	uint8_t pps_deblocking_filter_disabled_flag;
+	int8_t pps_beta_offset_div2;
+	int8_t pps_tc_offset_div2;
+	uint8_t lists_modification_present_flag;
+	uint8_t log2_parallel_merge_level_minus2;
+	uint8_t slice_segment_header_extension_present_flag;
+	uint8_t IDRPicFlag;
+	uint8_t RAPPicFlag;
+	uint8_t CurrRpsIdx;
+	uint32_t NumPocTotalCurr;
+	uint32_t NumDeltaPocsOfRefRpsIdx;
+	uint32_t NumShortTermPictureSliceHeaderBits;
+	uint32_t NumLongTermPictureSliceHeaderBits;
+	int32_t CurrPicOrderCntVal;
+	VdpVideoSurface RefPics[16];
+	int32_t PicOrderCntVal[16];
+	VdpBool IsLongTerm[16];
+	uint8_t NumPocStCurrBefore;
+	uint8_t NumPocStCurrAfter;
+	uint8_t NumPocLtCurr;
+	uint8_t RefPicSetStCurrBefore[8];
+	uint8_t RefPicSetStCurrAfter[8];
+	uint8_t RefPicSetLtCurr[8];
+} VdpPictureInfoHEVC;
+
+typedef VdpStatus VdpVideoSurfaceCreate(VdpDevice device, VdpChromaType chroma_type, uint32_t width, uint32_t height, VdpVideoSurface *surface);
+typedef VdpStatus VdpVideoSurfaceDestroy(VdpVideoSurface surface);
+typedef VdpStatus VdpVideoSurfaceGetParameters(VdpVideoSurface surface, VdpChromaType *chroma_type, uint32_t *width, uint32_t *height);
+typedef VdpStatus VdpVideoSurfaceGetBitsYCbCr(VdpVideoSurface surface, VdpYCbCrFormat destination_ycbcr_format, void *const *destination_data, uint32_t const *destination_pitches);
+typedef VdpStatus VdpVideoSurfacePutBitsYCbCr(VdpVideoSurface surface, VdpYCbCrFormat source_ycbcr_format, void const *const *source_data, uint32_t const *source_pitches);
+typedef VdpStatus VdpVideoSurfaceQueryCapabilities(VdpDevice device, VdpChromaType surface_chroma_type, VdpBool *is_supported, uint32_t *max_width, uint32_t *max_height);
+typedef VdpStatus VdpVideoSurfaceQueryGetPutBitsYCbCrCapabilities(VdpDevice device, VdpChromaType surface_chroma_type, VdpYCbCrFormat bits_ycbcr_format, VdpBool *is_supported);
+
+typedef char const *VdpGetErrorString();
+typedef VdpStatus VdpBitmapSurfaceCreate();
+typedef VdpStatus VdpBitmapSurfaceGetParameters();
+typedef VdpStatus VdpBitmapSurfacePutBitsNative();
+typedef VdpStatus VdpBitmapSurfaceQueryCapabilities();
+typedef VdpStatus VdpDecoderCreate();
+typedef VdpStatus VdpDecoderGetParameters();
+typedef VdpStatus VdpDecoderQueryCapabilities();
+typedef VdpStatus VdpDecoderRender();
+typedef VdpStatus VdpGenerateCSCMatrix();
+typedef VdpStatus VdpGetApiVersion();
+typedef VdpStatus VdpGetInformationString();
+typedef VdpStatus VdpGetProcAddress();
+typedef VdpStatus VdpOutputSurfaceCreate();
+typedef VdpStatus VdpOutputSurfaceGetBitsNative();
+typedef VdpStatus VdpOutputSurfaceGetParameters();
+typedef VdpStatus VdpOutputSurfacePutBitsIndexed();
+typedef VdpStatus VdpOutputSurfacePutBitsNative();
+typedef VdpStatus VdpOutputSurfacePutBitsYCbCr();
+typedef VdpStatus VdpOutputSurfaceQueryCapabilities();
+typedef VdpStatus VdpOutputSurfaceQueryGetPutBitsNativeCapabilities();
+typedef VdpStatus VdpOutputSurfaceQueryPutBitsIndexedCapabilities();
+typedef VdpStatus VdpOutputSurfaceQueryPutBitsYCbCrCapabilities();
+typedef VdpStatus VdpOutputSurfaceRenderBitmapSurface();
+typedef VdpStatus VdpOutputSurfaceRenderOutputSurface();
+typedef VdpStatus VdpPreemptionCallbackRegister();
+typedef VdpStatus VdpPresentationQueueBlockUntilSurfaceIdle();
+typedef VdpStatus VdpPresentationQueueCreate();
+typedef VdpStatus VdpPresentationQueueDestroy();
+typedef VdpStatus VdpPresentationQueueDisplay();
+typedef VdpStatus VdpPresentationQueueGetBackgroundColor();
+typedef VdpStatus VdpPresentationQueueGetTime();
+typedef VdpStatus VdpPresentationQueueQuerySurfaceStatus();
+typedef VdpStatus VdpPresentationQueueSetBackgroundColor();
+typedef VdpStatus VdpVideoMixerCreate();
+typedef VdpStatus VdpVideoMixerGetAttributeValues();
+typedef VdpStatus VdpVideoMixerGetFeatureEnables();
+typedef VdpStatus VdpVideoMixerGetFeatureSupport();
+typedef VdpStatus VdpVideoMixerGetParameterValues();
+typedef VdpStatus VdpVideoMixerQueryAttributeSupport();
+typedef VdpStatus VdpVideoMixerQueryAttributeValueRange();
+typedef VdpStatus VdpVideoMixerQueryFeatureSupport();
+typedef VdpStatus VdpVideoMixerQueryParameterSupport();
+typedef VdpStatus VdpVideoMixerQueryParameterValueRange();
+typedef VdpStatus VdpVideoMixerRender();
+typedef VdpStatus VdpVideoMixerSetAttributeValues();
+typedef VdpStatus VdpVideoMixerSetFeatureEnables();
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <string.h>
+#include <cedrus/cedrus.h>
+#include <cedrus/cedrus_regs.h>
+#include "ve.h"
+
+#define MAX_VES 4
+
+static mock_ve_t *ves[MAX_VES];
+
+void mock_ve_init(mock_ve_t *ve)
+{
+	int i;
+
+	memset(ve, 0, sizeof(*ve));
+
+	for (i = 0; i < MAX_VES; i++)
+		if (!ves[i])
+		{
+			ves[i] = ve;
+			break;
+		}
+}
+
+void mock_ve_release(mock_ve_t *ve)
+{
+	int i;
+
+	for (i = 0; i < MAX_VES; i++)
+		if (ves[i] == ve)
+			ves[i] = NULL;
+}
+
+static void sram_write(mock_ve_t *ve, uint32_t val)
+{
+	if (ve->sram_addr < MOCK_VE_SRAM_SIZE)
+	{
+		mock_ve_sram(ve, ve->sram_addr) = val;
+		ve->sram_written[ve->sram_addr / 4] = 1;
+	}
+	else
+		ve->sram_overflows++;
+
+	ve->sram_addr += 4;
+	ve->sram_writes++;
+}
+
+int mock_ve_write(uint32_t val, void *addr)
+{
+	int i;
+
+	for (i = 0; i < MAX_VES; i++)
+	{
+		mock_ve_t *ve = ves[i];
+		if (!ve || (uint8_t *)addr < (uint8_t *)ve->regs || (uint8_t *)addr >= (uint8_t *)ve->regs + MOCK_VE_REGS_SIZE)
+			continue;
+
+		uint32_t reg = (uint8_t *)addr - (uint8_t *)ve->regs;
+		ve->regs_written[reg / 4] = 1;
+		ve->writes++;
+
+		switch (reg)
+		{
+		case VE_H264_RAM_WRITE_PTR:
+		case VE_HEVC_SRAM_ADDR:
+			ve->sram_addr = val;
+			break;
+
+		case VE_H264_RAM_WRITE_DATA:
+		case VE_HEVC_SRAM_DATA:
+			sram_write(ve, val);
+			break;
+
+		// status bits are cleared by writing 1
+		case VE_MPEG_STATUS:
+		case VE_H264_STATUS:
+		case VE_HEVC_STATUS:
+			mock_ve_reg(ve, reg) &= ~val;
+			return 1;
+
+		case VE_MPEG_TRIGGER:
+		case VE_H264_TRIGGER:
+		case VE_HEVC_TRIG:
+			if (ve->trigger)
+				ve->trigger(ve, reg, val);
+
+			// decoding jobs finish successfully right away
+			if (reg == VE_MPEG_TRIGGER)
+				mock_ve_reg(ve, VE_MPEG_STATUS) |= 0x1;
+			else if (reg == VE_H264_TRIGGER && val == 0x8)
+				mock_ve_reg(ve, VE_H264_STATUS) |= 0x1;
+			else if (reg == VE_HEVC_TRIG && val == 0x8)
+				mock_ve_reg(ve, VE_HEVC_STATUS) |= 0x1;
+			break;
+		}
+
+		mock_ve_reg(ve, reg) = val;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * A register file and SRAM that behave like the VE as far as the driver
+ * can observe it. Writes through writel() are counted, the SRAM ports
+ * of the H.264 and HEVC engines are emulated and writes to the trigger
+ * registers call a hook, so tests can snapshot the state the VE would
+ * decode a slice with. Every register and SRAM word ever written is
+ * marked, for comparisons against a reference programming.
+ */
+
+#ifndef __MOCK_VE_H__
+#define __MOCK_VE_H__
+
+#include <stdint.h>
+
+#define MOCK_VE_REGS_SIZE 0x800
+#define MOCK_VE_SRAM_SIZE 0x1000
+
+typedef struct mock_ve
+{
+	uint32_t regs[MOCK_VE_REGS_SIZE / 4];
+	uint32_t sram[MOCK_VE_SRAM_SIZE / 4];
+	uint32_t sram_addr;
+	uint8_t regs_written[MOCK_VE_REGS_SIZE / 4];
+	uint8_t sram_written[MOCK_VE_SRAM_SIZE / 4];
+
+	unsigned long writes;
+	unsigned long sram_writes;
+	unsigned long sram_overflows;
+
+	void (*trigger)(struct mock_ve *ve, uint32_t reg, uint32_t val);
+	void *priv;
+} mock_ve_t;
+
+void mock_ve_init(mock_ve_t *ve);
+void mock_ve_release(mock_ve_t *ve);
+
+#define mock_ve_reg(ve, reg) ((ve)->regs[(reg) / 4])
+#define mock_ve_sram(ve, addr) ((ve)->sram[(addr) / 4])
+
+#endif
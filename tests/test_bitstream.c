@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <string.h>
+#include "bitstream.h"
+#include "test.h"
+
+#define MAX_FIELDS 256
+
+typedef struct
+{
+	uint8_t data[4096];
+	unsigned int bitpos;
+} bitwriter_t;
+
+static void put_u(bitwriter_t *w, int num, uint32_t val)
+{
+	int i;
+
+	for (i = num - 1; i >= 0; i--, w->bitpos++)
+		if ((val >> i) & 1)
+			w->data[w->bitpos / 8] |= 0x80 >> (w->bitpos % 8);
+}
+
+static void put_ue(bitwriter_t *w, uint32_t val)
+{
+	uint64_t v = (uint64_t)val + 1;
+	int bits = 64 - __builtin_clzll(v);
+
+	put_u(w, bits - 1, 0);
+	put_u(w, bits, v);
+}
+
+// inserts an emulation prevention byte wherever an escape is needed
+static int escape(uint8_t *dst, const uint8_t *src, int len)
+{
+	int i, n = 0, zeros = 0;
+
+	for (i = 0; i < len; i++)
+	{
+		if (zeros >= 2 && src[i] <= 0x03)
+		{
+			dst[n++] = 0x03;
+			zeros = 0;
+		}
+
+		dst[n++] = src[i];
+		zeros = src[i] == 0x00 ? zeros + 1 : 0;
+	}
+
+	return n;
+}
+
+enum field_type { FIELD_U, FIELD_UE, FIELD_SE };
+
+typedef struct
+{
+	enum field_type type;
+	int num;
+	uint32_t val;
+	unsigned int bitpos;
+} field_t;
+
+static int random_fields(bitwriter_t *w, field_t *fields)
+{
+	int i, count = 1 + test_rand() % MAX_FIELDS;
+
+	memset(w, 0, sizeof(*w));
+
+	for (i = 0; i < count; i++)
+	{
+		field_t *f = &fields[i];
+		uint32_t r = test_rand();
+
+		f->bitpos = w->bitpos;
+		f->type = r % 3;
+
+		// small values and zeros, to get plenty of zero bytes
+		switch (f->type)
+		{
+		case FIELD_U:
+			f->num = 1 + (r >> 2) % 32;
+			f->val = (r >> 8) % 4 ? 0 : test_rand();
+			if (f->num < 32)
+				f->val &= (1u << f->num) - 1;
+			put_u(w, f->num, f->val);
+			break;
+		case FIELD_UE:
+			f->val = test_rand() >> (r >> 2) % 32;
+			if (f->val == 0xffffffff)
+				f->val--;
+			put_ue(w, f->val);
+			break;
+		case FIELD_SE:
+			f->val = (int32_t)(test_rand() >> (1 + (r >> 2) % 31)) * ((r >> 8) & 1 ? 1 : -1);
+			put_ue(w, (int32_t)f->val > 0 ? 2 * f->val - 1 : -2 * (int32_t)f->val);
+			break;
+		}
+	}
+
+	return count;
+}
+
+static int read_field(bitstream_t *bs, const field_t *f)
+{
+	switch (f->type)
+	{
+	case FIELD_U:
+		return bs_get_u(bs, f->num) == f->val;
+	case FIELD_UE:
+		return bs_get_ue(bs) == f->val;
+	case FIELD_SE:
+		return bs_get_se(bs) == (int32_t)f->val;
+	}
+
+	return 0;
+}
+
+static void test_fields(int emulation_prevention)
+{
+	static field_t fields[MAX_FIELDS];
+	static bitwriter_t w;
+	uint8_t escaped[sizeof(w.data) * 3 / 2];
+	int round, i;
+
+	for (round = 0; round < 2000; round++)
+	{
+		int count = random_fields(&w, fields);
+		int bytes = (w.bitpos + 7) / 8;
+		bitstream_t bs;
+
+		if (emulation_prevention)
+		{
+			int len = escape(escaped, w.data, bytes);
+			bs_init(&bs, escaped, len, 1);
+		}
+		else
+			bs_init(&bs, w.data, bytes, 0);
+
+		for (i = 0; i < count; i++)
+		{
+			CHECK_EQ(bs_bits_read(&bs), fields[i].bitpos);
+			CHECK(read_field(&bs, &fields[i]));
+		}
+
+		CHECK_EQ(bs_bits_read(&bs), w.bitpos);
+		CHECK(!bs_overrun(&bs));
+
+		// the padding up to the byte boundary can still be read
+		bs_skip_bits(&bs, bytes * 8 - w.bitpos);
+		CHECK(!bs_overrun(&bs));
+		bs_get_u(&bs, 1);
+		CHECK(bs_overrun(&bs));
+	}
+}
+
+static void test_seek(void)
+{
+	static field_t fields[MAX_FIELDS];
+	static bitwriter_t w;
+	int round;
+
+	for (round = 0; round < 2000; round++)
+	{
+		int count = random_fields(&w, fields);
+		int i = test_rand() % count;
+		bitstream_t bs;
+
+		bs_init(&bs, w.data, (w.bitpos + 7) / 8, 0);
+		bs_skip_bits(&bs, w.bitpos);
+
+		bs_seek(&bs, fields[i].bitpos);
+		CHECK_EQ(bs_bits_read(&bs), fields[i].bitpos);
+		for (; i < count; i++)
+			CHECK(read_field(&bs, &fields[i]));
+		CHECK(!bs_overrun(&bs));
+	}
+}
+
+static void test_emulation_prevention(void)
+{
+	static const uint8_t data[] = { 0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0xff };
+	bitstream_t bs;
+
+	bs_init(&bs, data, sizeof(data), 1);
+	CHECK_EQ(bs_get_u(&bs, 24), 0x000001);
+	CHECK_EQ(bs_get_u(&bs, 32), 0x00000000);
+	CHECK_EQ(bs_get_u(&bs, 8), 0xff);
+	CHECK_EQ(bs_bits_read(&bs), 64);
+	CHECK(!bs_overrun(&bs));
+
+	bs_init(&bs, data, sizeof(data), 0);
+	CHECK_EQ(bs_get_u(&bs, 32), 0x00000301);
+	CHECK_EQ(bs_bits_read(&bs), 32);
+}
+
+static void test_overrun(void)
+{
+	static const uint8_t zeros[8];
+	bitstream_t bs;
+
+	// no stop bit within the data
+	bs_init(&bs, zeros, sizeof(zeros), 0);
+	bs_get_ue(&bs);
+	CHECK(bs_overrun(&bs));
+
+	bs_init(&bs, zeros, 0, 0);
+	CHECK_EQ(bs_get_u(&bs, 1), 0);
+	CHECK(bs_overrun(&bs));
+}
+
+int main(void)
+{
+	test_fields(0);
+	test_fields(1);
+	test_seek();
+	test_emulation_prevention();
+	test_overrun();
+
+	return test_result("bitstream");
+}
@@ -0,0 +1,547 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "../h264.c"
+#include "mock/driver.h"
+#include "bitwriter.h"
+#include "test.h"
+
+/*
+ * The default reference list construction as it was before the lists
+ * were cached per picture: c->ref_pic was sorted in place with qsort()
+ * for every P and B slice.
+ */
+static int qsort_by_poc(const void *p1, const void *p2)
+{
+	return pic_order_cnt(p1) - pic_order_cnt(p2);
+}
+
+static int qsort_by_frame_num(const void *p1, const void *p2)
+{
+	return ((const h264_picture_t *)p1)->frame_idx - ((const h264_picture_t *)p2)->frame_idx;
+}
+
+static void qsort_default_ref_pic_list(h264_picture_t *ref_pic, int ref_count, VdpPictureInfoH264 const *info,
+                                       int slice_type, int cur_field, h264_picture_t *list0, h264_picture_t *list1)
+{
+	int i, ptr0 = 0, ptr1 = 0;
+	h264_picture_t *sorted[2][16];
+
+	if (slice_type == SLICE_TYPE_P)
+	{
+		qsort(ref_pic, ref_count, sizeof(ref_pic[0]), &qsort_by_frame_num);
+
+		for (i = 0; i < ref_count; i++)
+			if (ref_pic[ref_count - 1 - i].frame_idx <= info->frame_num)
+				sorted[0][ptr0++] = &ref_pic[ref_count - 1 - i];
+		for (i = 0; i < ref_count; i++)
+			if (ref_pic[ref_count - 1 - i].frame_idx > info->frame_num)
+				sorted[0][ptr0++] = &ref_pic[ref_count - 1 - i];
+
+		split_ref_fields(list0, sorted[0], ref_count, cur_field);
+	}
+	else
+	{
+		qsort(ref_pic, ref_count, sizeof(ref_pic[0]), &qsort_by_poc);
+
+		int cur_poc;
+		if (cur_field != PIC_FRAME)
+			cur_poc = (uint16_t)info->field_order_cnt[cur_field == PIC_BOTTOM_FIELD];
+		else
+			cur_poc = min((uint16_t)info->field_order_cnt[0], (uint16_t)info->field_order_cnt[1]);
+
+		for (i = 0; i < ref_count; i++)
+		{
+			if (pic_order_cnt(&ref_pic[ref_count - 1 - i]) <= cur_poc)
+				sorted[0][ptr0++] = &ref_pic[ref_count - 1 - i];
+			if (pic_order_cnt(&ref_pic[i]) > cur_poc)
+				sorted[1][ptr1++] = &ref_pic[i];
+		}
+		for (i = 0; i < ref_count; i++)
+		{
+			if (pic_order_cnt(&ref_pic[i]) > cur_poc)
+				sorted[0][ptr0++] = &ref_pic[i];
+			if (pic_order_cnt(&ref_pic[ref_count - 1 - i]) <= cur_poc)
+				sorted[1][ptr1++] = &ref_pic[ref_count - 1 - i];
+		}
+
+		split_ref_fields(list0, sorted[0], ref_count, cur_field);
+		split_ref_fields(list1, sorted[1], ref_count, cur_field);
+	}
+}
+
+static int same_picture(const h264_picture_t *a, const h264_picture_t *b)
+{
+	return a->surface == b->surface && a->field == b->field && a->frame_idx == b->frame_idx &&
+		a->top_pic_order_cnt == b->top_pic_order_cnt && a->bottom_pic_order_cnt == b->bottom_pic_order_cnt;
+}
+
+static int compare_pictures(const void *p1, const void *p2)
+{
+	const h264_picture_t *a = p1, *b = p2;
+
+	if (a->surface != b->surface)
+		return a->surface < b->surface ? -1 : 1;
+
+	return a->field - b->field;
+}
+
+/*
+ * With equal sort keys, which only long-term references can have, the
+ * order of the tied pictures depended on qsort() and on the slices
+ * sorted before. Only the same pictures have to be in the list then.
+ */
+static int same_list(const h264_picture_t *a, const h264_picture_t *b, int ties)
+{
+	h264_picture_t sa[32], sb[32];
+	int i;
+
+	if (!ties)
+	{
+		for (i = 0; i < 32; i++)
+			if (!same_picture(&a[i], &b[i]))
+				return 0;
+
+		return 1;
+	}
+
+	memcpy(sa, a, sizeof(sa));
+	memcpy(sb, b, sizeof(sb));
+	qsort(sa, 32, sizeof(sa[0]), compare_pictures);
+	qsort(sb, 32, sizeof(sb[0]), compare_pictures);
+
+	for (i = 0; i < 32; i++)
+		if (!same_picture(&sa[i], &sb[i]))
+			return 0;
+
+	return 1;
+}
+
+static int has_ties(const h264_picture_t *ref_pic, int ref_count)
+{
+	int i, j;
+
+	for (i = 0; i < ref_count; i++)
+		for (j = i + 1; j < ref_count; j++)
+			if (ref_pic[i].frame_idx == ref_pic[j].frame_idx || pic_order_cnt(&ref_pic[i]) == pic_order_cnt(&ref_pic[j]))
+				return 1;
+
+	return 0;
+}
+
+// short-term references get unique frame numbers and POCs, long-term ones may repeat them
+static int random_dpb(h264_picture_t *ref_pic, VdpPictureInfoH264 *info, int field_pic)
+{
+	static video_surface_ctx_t surfaces[16];
+	int i, count = test_rand() % 17;
+	int base_poc = test_rand() % 256;
+
+	memset(info, 0, sizeof(*info));
+	info->frame_num = test_rand() % 16;
+	info->field_order_cnt[0] = base_poc + 2 * (test_rand() % 20);
+	info->field_order_cnt[1] = info->field_order_cnt[0] + 1;
+
+	for (i = 0; i < count; i++)
+	{
+		int long_term = test_rand() % 4 == 0;
+
+		ref_pic[i].surface = &surfaces[i];
+		ref_pic[i].frame_idx = long_term ? test_rand() % 4 : (info->frame_num + 16 - 1 - i) % 16;
+		ref_pic[i].top_pic_order_cnt = long_term ? base_poc + 2 * (test_rand() % 40) : base_poc + 2 * ((i * 7) % 40);
+		ref_pic[i].bottom_pic_order_cnt = ref_pic[i].top_pic_order_cnt + 1;
+		ref_pic[i].field = field_pic ? 1 + test_rand() % 3 : PIC_FRAME;
+	}
+
+	// the second field of a frame references the first one
+	if (field_pic && count > 0 && test_rand() % 2)
+	{
+		ref_pic[0].frame_idx = info->frame_num;
+		ref_pic[0].top_pic_order_cnt = info->field_order_cnt[0];
+		ref_pic[0].bottom_pic_order_cnt = info->field_order_cnt[1];
+	}
+
+	// the DPB comes in surface order, not in decoding order
+	for (i = count - 1; i > 0; i--)
+	{
+		int j = test_rand() % (i + 1);
+		h264_picture_t tmp = ref_pic[i];
+		ref_pic[i] = ref_pic[j];
+		ref_pic[j] = tmp;
+	}
+
+	return count;
+}
+
+// cached default lists have to match a qsort() rebuild for every slice
+static void test_default_ref_pic_lists(void)
+{
+	static h264_context_t c;
+	h264_picture_t old_ref_pic[16];
+	h264_picture_t list0[32], list1[32];
+	VdpPictureInfoH264 info;
+	int i, s, pictures_with_ties = 0, slices[2] = { 0, 0 }, fields = 0, mismatches = 0;
+
+	for (i = 0; i < 20000; i++)
+	{
+		int field_pic = test_rand() % 2;
+
+		memset(&c, 0, sizeof(c));
+		c.info = &info;
+		c.ref_count = random_dpb(c.ref_pic, &info, field_pic);
+		memcpy(old_ref_pic, c.ref_pic, sizeof(old_ref_pic));
+
+		int ties = has_ties(c.ref_pic, c.ref_count);
+		pictures_with_ties += ties;
+		fields += field_pic;
+
+		c.default_lists_built = 0;
+		for (s = test_rand() % 6; s >= 0; s--)
+		{
+			h264_header_t *h = &c.header;
+
+			h->slice_type = test_rand() % 2 ? SLICE_TYPE_B : SLICE_TYPE_P;
+			h->field_pic_flag = field_pic;
+			h->bottom_field_flag = field_pic && test_rand() % 2;
+			int cur_field = h->field_pic_flag ? (h->bottom_field_flag ? PIC_BOTTOM_FIELD : PIC_TOP_FIELD) : PIC_FRAME;
+
+			// the previous slice's ref_pic_list_modification() changes the lists it got
+			memset(h->RefPicList0, 0xa5, sizeof(h->RefPicList0));
+			memset(h->RefPicList1, 0xa5, sizeof(h->RefPicList1));
+			fill_default_ref_pic_list(&c);
+
+			memset(list0, 0, sizeof(list0));
+			memset(list1, 0, sizeof(list1));
+			qsort_default_ref_pic_list(old_ref_pic, c.ref_count, &info, h->slice_type, cur_field, list0, list1);
+
+			if (!same_list(h->RefPicList0, list0, ties) || (h->slice_type == SLICE_TYPE_B && !same_list(h->RefPicList1, list1, ties)))
+				mismatches++;
+
+			slices[h->slice_type]++;
+		}
+	}
+
+	CHECK_EQ(mismatches, 0);
+	CHECK(pictures_with_ties > 0 && fields > 0 && slices[SLICE_TYPE_P] > 0 && slices[SLICE_TYPE_B] > 0);
+}
+
+// a DPB step: references are dropped, the output takes a free slot
+static void random_frame_list(uint32_t list[18][8], int picture)
+{
+	int i, j, output = -1;
+
+	for (i = 0; i < 18; i++)
+	{
+		if (list[i][3] && test_rand() % 6 == 0)
+			memset(list[i], 0, sizeof(list[i]));
+		else if (list[i][3] && test_rand() % 10 == 0)
+			list[i][2] ^= 0x100;
+		else if (!list[i][3] && output < 0)
+			output = i;
+	}
+
+	if (output < 0)
+		output = test_rand() % 18;
+
+	list[output][0] = 2 * picture;
+	list[output][1] = 2 * picture + 1;
+	list[output][2] = (test_rand() % 3) << 8;
+	for (j = 3; j < 7; j++)
+		list[output][j] = 0x40000000 + (picture % 1024) * 0x100000 + j * 0x1000;
+}
+
+// the SRAM after incremental updates has to match writing every slot
+static void test_frame_list(void)
+{
+	static h264_context_t c, full;
+	static mock_ve_t ve, ref;
+	uint32_t list[18][8];
+	unsigned int generation = 1, offset;
+	int i, mismatches = 0, bumps = 0;
+
+	memset(list, 0, sizeof(list));
+	mock_ve_init(&ve);
+	mock_ve_init(&ref);
+	c.regs = ve.regs;
+	full.regs = ref.regs;
+
+	for (i = 0; i < 2000; i++)
+	{
+		random_frame_list(list, i);
+
+		// VE lost to another user, its SRAM content is gone
+		if (test_rand() % 16 == 0)
+		{
+			memset(ve.sram, 0xa5, sizeof(ve.sram));
+			generation++;
+			bumps++;
+		}
+
+		write_frame_list(&c, list, generation);
+		write_frame_list(&full, list, full.frame_list_generation + 1);
+
+		for (offset = 0; offset < 18 * 0x20; offset += 4)
+			if (mock_ve_sram(&ve, VE_SRAM_H264_FRAMEBUFFER_LIST + offset) != mock_ve_sram(&ref, VE_SRAM_H264_FRAMEBUFFER_LIST + offset))
+				mismatches++;
+	}
+
+	mock_ve_release(&ref);
+	mock_ve_release(&ve);
+
+	CHECK_EQ(mismatches, 0);
+	CHECK_EQ(ve.sram_overflows, 0);
+	CHECK(bumps > 0 && c.frame_list_slots_reused > 0);
+	CHECK(ve.sram_writes < ref.sram_writes / 2);
+}
+
+#define WIDTH 320
+#define HEIGHT 240
+#define SURFACES 2
+
+static VdpDecoder decoder;
+static decoder_ctx_t *decoder_ctx;
+static bitstream_t vld;
+static VdpPictureInfoH264 scaling_info;
+static int scaling_slices, scaling_mismatches;
+
+/*
+ * The VE parses the slice header for the driver, emulate its bit reader
+ * and check the scaling lists the slice is decoded with.
+ */
+static void h264_trigger(mock_ve_t *ve, uint32_t reg, uint32_t val)
+{
+	int i;
+
+	if (reg != VE_H264_TRIGGER)
+		return;
+
+	switch (val & 0xff)
+	{
+	case 0x7:
+		bs_init(&vld, (uint8_t *)cedrus_mem_get_pointer(decoder_ctx->data) + mock_ve_reg(ve, VE_H264_VLD_OFFSET) / 8,
+			mock_ve_reg(ve, VE_H264_VLD_LEN) / 8, 1);
+		break;
+
+	case 0x2:
+		mock_ve_reg(ve, VE_H264_BASIC_BITS) = bs_get_u(&vld, (val >> 8) & 0x3f);
+		break;
+
+	case 0x4:
+		mock_ve_reg(ve, VE_H264_BASIC_BITS) = bs_get_se(&vld);
+		break;
+
+	case 0x5:
+		mock_ve_reg(ve, VE_H264_BASIC_BITS) = bs_get_ue(&vld);
+		break;
+
+	case 0x8:
+		scaling_slices++;
+		if (check_scaling_lists(&((h264_private_t *)decoder_ctx->private)->context))
+		{
+			if (!(mock_ve_reg(ve, VE_H264_QP_PARAM) & (0x1 << 24)))
+				scaling_mismatches++;
+			break;
+		}
+
+		if (mock_ve_reg(ve, VE_H264_QP_PARAM) & (0x1 << 24))
+			scaling_mismatches++;
+
+		for (i = 0; i < 2 * 64; i++)
+			if (((uint8_t *)&mock_ve_sram(ve, VE_SRAM_H264_SCALING_LISTS))[i] != (&scaling_info.scaling_lists_8x8[0][0])[i])
+				scaling_mismatches++;
+
+		for (i = 0; i < 6 * 16; i++)
+			if (((uint8_t *)&mock_ve_sram(ve, VE_SRAM_H264_SCALING_LISTS + 2 * 64))[i] != (&scaling_info.scaling_lists_4x4[0][0])[i])
+				scaling_mismatches++;
+		break;
+	}
+}
+
+// an I slice of a non-reference picture, frame_num and POC type 2
+static int put_i_slice(uint8_t *stream)
+{
+	bitwriter_t bw;
+	int pos = 0;
+
+	bw_init(&bw);
+	bw_put_u(&bw, 0x01, 8);
+	bw_put_ue(&bw, 0);
+	bw_put_ue(&bw, 7);
+	bw_put_ue(&bw, 0);
+	bw_put_u(&bw, 0, 4);
+	bw_put_se(&bw, 0);
+	bw_trailing_bits(&bw);
+	bw_put_u(&bw, 0x80, 8);
+	bw_nal_unit(&bw, stream, &pos);
+
+	return pos;
+}
+
+static void set_scaling_lists(int lists)
+{
+	int i, j;
+
+	// 0 is flat, 1 to 3 are custom lists, 3 only differs from 1 in the 8x8 ones
+	for (i = 0; i < 6; i++)
+		for (j = 0; j < 16; j++)
+			scaling_info.scaling_lists_4x4[i][j] = lists ? 4 + (lists == 3 ? 1 : lists) * 3 + i + j : 16;
+
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < 64; j++)
+			scaling_info.scaling_lists_8x8[i][j] = lists ? 6 + lists * 5 + i + j : 16;
+}
+
+// custom and flat scaling lists alternate, every change has to reach the SRAM
+static void test_scaling_lists(int exclusive)
+{
+	static const int sequence[] = { 1, 0, 1, 1, 2, 0, 2, 1, 3, 0, 3, 0, 2, 2, 1 };
+	VdpDevice device;
+	VdpVideoSurface surfaces[SURFACES];
+	uint8_t stream[256];
+	unsigned int n;
+	int s, len = put_i_slice(stream), last = -1, lost = 0;
+
+	CHECK_EQ(mock_device_create(exclusive, 0, &device), VDP_STATUS_OK);
+	CHECK_EQ(vdp_decoder_create(device, VDP_DECODER_PROFILE_H264_HIGH, WIDTH, HEIGHT, SURFACES, &decoder), VDP_STATUS_OK);
+	decoder_ctx = handle_get(decoder);
+	for (s = 0; s < SURFACES; s++)
+		CHECK_EQ(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, WIDTH, HEIGHT, &surfaces[s]), VDP_STATUS_OK);
+
+	memset(&scaling_info, 0, sizeof(scaling_info));
+	scaling_info.slice_count = 1;
+	scaling_info.frame_mbs_only_flag = 1;
+	scaling_info.pic_order_cnt_type = 2;
+	scaling_info.transform_8x8_mode_flag = 1;
+	for (s = 0; s < 16; s++)
+		scaling_info.referenceFrames[s].surface = VDP_INVALID_HANDLE;
+
+	mock_ve.trigger = h264_trigger;
+	scaling_slices = scaling_mismatches = 0;
+
+	for (n = 0; n < 3 * ARRAY_SIZE(sequence); n++)
+	{
+		int lists = sequence[n % ARRAY_SIZE(sequence)];
+		h264_private_t *decoder_p = decoder_ctx->private;
+		unsigned long uploaded = decoder_p->scaling_lists_uploaded;
+		if (n % 7 == 6)
+		{
+			lost = 1;
+			for (s = 0; s < ARRAY_SIZE(mock_ve.sram); s++)
+				mock_ve.sram[s] = test_rand();
+			mock_ve_foreign_use(device);
+		}
+
+		set_scaling_lists(lists);
+		CHECK_EQ(mock_decoder_render(decoder, surfaces[n % SURFACES], (VdpPictureInfo *)&scaling_info, stream, len), VDP_STATUS_OK);
+
+		// uploaded exactly when the SRAM doesn't hold the lists yet
+		CHECK_EQ(decoder_p->scaling_lists_uploaded - uploaded, lists && (lists != last || lost || !exclusive));
+		if (lists)
+		{
+			last = lists;
+			lost = 0;
+		}
+	}
+
+	mock_ve.trigger = NULL;
+	CHECK_EQ(scaling_slices, 3 * ARRAY_SIZE(sequence));
+	CHECK_EQ(scaling_mismatches, 0);
+
+	sfree(decoder_ctx);
+	handle_destroy(decoder);
+	for (s = 0; s < SURFACES; s++)
+		vdp_video_surface_destroy(surfaces[s]);
+	handle_destroy(device);
+}
+
+/*
+ * Heap allocations of the decoder, counted through the linker's --wrap,
+ * see the Makefile. CMA allocations are counted by the mock driver.
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+static unsigned long heap_allocs;
+
+void *__wrap_malloc(size_t size)
+{
+	__sync_fetch_and_add(&heap_allocs, 1);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	__sync_fetch_and_add(&heap_allocs, 1);
+	return __real_calloc(nmemb, size);
+}
+
+/*
+ * Once every surface was decoded to, pictures don't allocate anything.
+ * With prewarming the first pictures don't allocate CMA buffers either.
+ */
+static void test_allocations(int prewarm)
+{
+	VdpDevice device;
+	VdpVideoSurface surfaces[SURFACES];
+	VdpPictureInfoH264 info;
+	uint8_t stream[256];
+	int n, s, len = put_i_slice(stream);
+
+	CHECK_EQ(mock_device_create(1, prewarm, &device), VDP_STATUS_OK);
+	CHECK_EQ(vdp_decoder_create(device, VDP_DECODER_PROFILE_H264_HIGH, WIDTH, HEIGHT, SURFACES, &decoder), VDP_STATUS_OK);
+	for (s = 0; s < SURFACES; s++)
+		CHECK_EQ(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, WIDTH, HEIGHT, &surfaces[s]), VDP_STATUS_OK);
+
+	memset(&info, 0, sizeof(info));
+	info.slice_count = 1;
+	info.frame_mbs_only_flag = 1;
+	info.pic_order_cnt_type = 2;
+	for (s = 0; s < 16; s++)
+		info.referenceFrames[s].surface = VDP_INVALID_HANDLE;
+
+	unsigned long cma = mock_mem_allocs;
+	for (n = 0; n < SURFACES; n++)
+		CHECK_EQ(mock_decoder_render(decoder, surfaces[n % SURFACES], (VdpPictureInfo *)&info, stream, len), VDP_STATUS_OK);
+
+	// reconstruction and motion vector buffers
+	CHECK_EQ(mock_mem_allocs - cma, prewarm ? 0 : 2 * SURFACES);
+
+	cma = mock_mem_allocs;
+	unsigned long heap = heap_allocs;
+	for (n = 0; n < 10 * SURFACES; n++)
+		CHECK_EQ(mock_decoder_render(decoder, surfaces[n % SURFACES], (VdpPictureInfo *)&info, stream, len), VDP_STATUS_OK);
+
+	CHECK_EQ(mock_mem_allocs - cma, 0);
+	CHECK_EQ(heap_allocs - heap, 0);
+
+	handle_destroy(decoder);
+	for (s = 0; s < SURFACES; s++)
+		vdp_video_surface_destroy(surfaces[s]);
+	handle_destroy(device);
+}
+
+int main(void)
+{
+	test_default_ref_pic_lists();
+	test_frame_list();
+	test_scaling_lists(0);
+	test_scaling_lists(1);
+	test_allocations(0);
+	test_allocations(1);
+
+	return test_result("h264");
+}
@@ -0,0 +1,613 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "../h265.c"
+#include "mock/driver.h"
+#include "bitwriter.h"
+#include "test.h"
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define CTB_COLS (WIDTH / 64)
+#define CTBS (CTB_COLS * HEIGHT / 64)
+#define SLICES 3
+#define SURFACES 4
+
+static VdpDevice device;
+static VdpDecoder decoder;
+static decoder_ctx_t *decoder_ctx;
+static VdpVideoSurface surfaces[SURFACES];
+static VdpPictureInfoHEVC info;
+static uint8_t stream[64 * 1024];
+
+static int slices_checked, mismatches;
+
+static void init_info(int wpp)
+{
+	int i, j;
+
+	memset(&info, 0, sizeof(info));
+
+	info.chroma_format_idc = 1;
+	info.pic_width_in_luma_samples = WIDTH;
+	info.pic_height_in_luma_samples = HEIGHT;
+	info.log2_max_pic_order_cnt_lsb_minus4 = 4;
+	info.log2_min_luma_coding_block_size_minus3 = 0;
+	info.log2_diff_max_min_luma_coding_block_size = 3;
+	info.log2_diff_max_min_transform_block_size = 3;
+	info.max_transform_hierarchy_depth_inter = 2;
+	info.max_transform_hierarchy_depth_intra = 2;
+	info.amp_enabled_flag = 1;
+	info.sample_adaptive_offset_enabled_flag = 1;
+	info.sps_temporal_mvp_enabled_flag = 1;
+	info.strong_intra_smoothing_enabled_flag = 1;
+	info.dependent_slice_segments_enabled_flag = 1;
+	info.init_qp_minus26 = -4;
+	info.cu_qp_delta_enabled_flag = 1;
+	info.pps_loop_filter_across_slices_enabled_flag = 1;
+	info.entropy_coding_sync_enabled_flag = wpp;
+	info.NumShortTermPictureSliceHeaderBits = 2;
+
+	info.scaling_list_enabled_flag = 1;
+	for (i = 0; i < 6; i++)
+	{
+		for (j = 0; j < 16; j++)
+			info.ScalingList4x4[i][j] = 16 + i + j;
+		for (j = 0; j < 64; j++)
+		{
+			info.ScalingList8x8[i][j] = 16 + i + j;
+			info.ScalingList16x16[i][j] = 20 + i + j;
+		}
+		info.ScalingListDCCoeff16x16[i] = 16 + i;
+	}
+	for (i = 0; i < 2; i++)
+	{
+		for (j = 0; j < 64; j++)
+			info.ScalingList32x32[i][j] = 24 + i + j;
+		info.ScalingListDCCoeff32x32[i] = 24 + i;
+	}
+
+	for (i = 0; i < 16; i++)
+		info.RefPics[i] = VDP_INVALID_HANDLE;
+}
+
+// the entry point offsets written are stored in offsets, if given
+static void put_slice(int *pos, int nal_unit_type, int slice_type, int address, int poc, int entry_points, uint32_t *offsets)
+{
+	bitwriter_t bw;
+	int i;
+
+	bw_init(&bw);
+
+	bw_put_u(&bw, 0, 1);
+	bw_put_u(&bw, nal_unit_type, 6);
+	bw_put_u(&bw, 0, 6);
+	bw_put_u(&bw, 1, 3);
+
+	bw_put_u(&bw, address == 0, 1);
+	if (nal_unit_type >= 16 && nal_unit_type <= 23)
+		bw_put_u(&bw, 0, 1);
+	bw_put_ue(&bw, 0);
+	if (address)
+	{
+		bw_put_u(&bw, 0, 1);
+		bw_put_u(&bw, address, ceil_log2(CTBS));
+	}
+
+	bw_put_ue(&bw, slice_type);
+	if (nal_unit_type != 19 && nal_unit_type != 20)
+	{
+		bw_put_u(&bw, poc & 0xff, 8);
+		bw_put_u(&bw, 1, 1);
+		bw_put_u(&bw, 0, info.NumShortTermPictureSliceHeaderBits);
+		bw_put_u(&bw, 1, 1);
+	}
+
+	bw_put_u(&bw, 1, 1);
+	bw_put_u(&bw, address != 0, 1);
+
+	if (slice_type == SLICE_P)
+	{
+		bw_put_u(&bw, 0, 1);
+		bw_put_ue(&bw, test_rand() % 5);
+	}
+
+	bw_put_se(&bw, (int)(test_rand() % 9) - 4);
+	bw_put_u(&bw, 1, 1);
+
+	if (info.tiles_enabled_flag || info.entropy_coding_sync_enabled_flag)
+	{
+		bw_put_ue(&bw, entry_points);
+		if (entry_points)
+			bw_put_ue(&bw, 7);
+		for (i = 0; i < entry_points; i++)
+		{
+			uint32_t offset = 16 + test_rand() % 200;
+			bw_put_u(&bw, offset - 1, 8);
+			if (offsets)
+				offsets[i] = offset;
+		}
+	}
+
+	bw_trailing_bits(&bw);
+
+	// slice data, never looked at by the mock VE
+	for (i = 0; i < 64; i++)
+		bw_put_u(&bw, test_rand() | 0x80, 8);
+
+	bw_nal_unit(&bw, stream, pos);
+}
+
+/*
+ * Called when a slice is started. Programs the full state for the slice
+ * into a second VE, the way the driver did before the sequence and
+ * picture state were hoisted out of the slice loop, and compares what
+ * that wrote with the state the real VE decodes the slice with.
+ */
+static void check_slice(mock_ve_t *ve, uint32_t reg, uint32_t val)
+{
+	if (reg != VE_HEVC_TRIG || val != 0x8)
+		return;
+
+	struct h265_private *p = decoder_ctx->private;
+	ve_shadow_t shadow = decoder_ctx->shadow;
+	typeof(p->scaling_lists) scaling_lists = p->scaling_lists;
+	void *regs = p->regs;
+	unsigned int i;
+
+	static mock_ve_t ref;
+	mock_ve_init(&ref);
+
+	p->regs = ref.regs;
+	ve_shadow_acquire(&decoder_ctx->shadow, ref.regs, 0);
+	p->scaling_lists.uploaded_generation = decoder_ctx->shadow.generation - 1;
+
+	write_sequence_regs(p);
+	write_picture_regs(p);
+	write_slice_regs(p);
+
+	p->regs = regs;
+	decoder_ctx->shadow = shadow;
+	p->scaling_lists = scaling_lists;
+	mock_ve_release(&ref);
+
+	for (i = 0; i < MOCK_VE_REGS_SIZE; i += 4)
+	{
+		if (!ref.regs_written[i / 4] || i == VE_HEVC_SRAM_ADDR || i == VE_HEVC_SRAM_DATA)
+			continue;
+
+		if (ve->regs[i / 4] != ref.regs[i / 4])
+		{
+			fprintf(stderr, "slice %d: register 0x%03x is 0x%08x instead of 0x%08x\n", slices_checked, i, ve->regs[i / 4], ref.regs[i / 4]);
+			mismatches++;
+		}
+	}
+
+	for (i = 0; i < MOCK_VE_SRAM_SIZE; i += 4)
+	{
+		if (ref.sram_written[i / 4] && ve->sram[i / 4] != ref.sram[i / 4])
+		{
+			fprintf(stderr, "slice %d: SRAM 0x%03x is 0x%08x instead of 0x%08x\n", slices_checked, i, ve->sram[i / 4], ref.sram[i / 4]);
+			mismatches++;
+		}
+	}
+
+	slices_checked++;
+}
+
+// another process uses the VE and leaves garbage behind
+static void clobber_ve(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(mock_ve.regs); i++)
+		mock_ve.regs[i] = test_rand();
+	for (i = 0; i < ARRAY_SIZE(mock_ve.sram); i++)
+		mock_ve.sram[i] = test_rand();
+	mock_ve.regs[VE_HEVC_STATUS / 4] = 0;
+}
+
+static void decode_pictures(int count, int exclusive, int wpp)
+{
+	int n, s;
+
+	CHECK_EQ(mock_device_create(exclusive, 0, &device), VDP_STATUS_OK);
+	CHECK_EQ(vdp_decoder_create(device, VDP_DECODER_PROFILE_HEVC_MAIN, WIDTH, HEIGHT, SURFACES, &decoder), VDP_STATUS_OK);
+	decoder_ctx = handle_get(decoder);
+	for (s = 0; s < SURFACES; s++)
+		CHECK_EQ(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, WIDTH, HEIGHT, &surfaces[s]), VDP_STATUS_OK);
+
+	init_info(wpp);
+	mock_ve.trigger = check_slice;
+
+	for (n = 0; n < count; n++)
+	{
+		int pos = 0, nal_unit_type = n ? 1 : 19;
+
+		info.IDRPicFlag = !n;
+		info.RAPPicFlag = !n;
+		info.CurrPicOrderCntVal = n;
+
+		if (n)
+		{
+			info.RefPics[0] = surfaces[(n - 1) % SURFACES];
+			info.PicOrderCntVal[0] = n - 1;
+			info.NumPocStCurrBefore = 1;
+			info.RefPicSetStCurrBefore[0] = 0;
+			info.NumPocTotalCurr = 1;
+		}
+
+		// new scaling lists every few pictures
+		if (n % 3 == 2)
+			info.ScalingList8x8[n % 6][n % 64]++;
+
+		for (s = 0; s < SLICES; s++)
+			put_slice(&pos, nal_unit_type, n ? SLICE_P : SLICE_I, s * CTBS / SLICES, n, wpp ? CTBS / CTB_COLS / SLICES - 1 : 0, NULL);
+
+		if (n % 4 == 3)
+		{
+			clobber_ve();
+			mock_ve_foreign_use(device);
+		}
+
+		struct h265_private *p = decoder_ctx->private;
+		unsigned long uploaded = p->scaling_lists.uploaded;
+
+		CHECK_EQ(mock_decoder_render(decoder, surfaces[n % SURFACES], &info, stream, pos), VDP_STATUS_OK);
+
+		// uploaded once per picture, if they changed or the VE was lost since
+		CHECK_EQ(p->scaling_lists.uploaded - uploaded, n == 0 || n % 3 == 2 || !exclusive || n % 4 == 3);
+	}
+
+	mock_ve.trigger = NULL;
+
+	sfree(decoder_ctx);
+	handle_destroy(decoder);
+	for (s = 0; s < SURFACES; s++)
+		vdp_video_surface_destroy(surfaces[s]);
+	handle_destroy(device);
+}
+
+static int pic_list_checked, pic_list_mismatches;
+
+// the VE has to see the buffers the RefPics handles stand for right now
+static void check_pic_list(mock_ve_t *ve, uint32_t reg, uint32_t val)
+{
+	int i;
+
+	if (reg != VE_HEVC_TRIG || val != 0x8)
+		return;
+
+	for (i = 0; i < 16; i++)
+	{
+		if (info.RefPics[i] == VDP_INVALID_HANDLE)
+			continue;
+
+		smart video_surface_ctx_t *surface = handle_get(info.RefPics[i]);
+		struct h265_video_private *vp = surface->decoder_private;
+		uint32_t luma = cedrus_mem_get_bus_addr(surface->yuv->data);
+
+		if (mock_ve_sram(ve, VE_SRAM_HEVC_PIC_LIST + i * 0x20 + 0x8) != cedrus_mem_get_bus_addr(vp->extra_data) >> 8 ||
+			mock_ve_sram(ve, VE_SRAM_HEVC_PIC_LIST + i * 0x20 + 0x10) != luma >> 8 ||
+			mock_ve_sram(ve, VE_SRAM_HEVC_PIC_LIST + i * 0x20 + 0x14) != (luma + surface->luma_size) >> 8)
+			pic_list_mismatches++;
+
+		pic_list_checked++;
+	}
+}
+
+/*
+ * Reference surfaces are destroyed and created again under the same
+ * handle, or get a new buffer while a frame is still held, between
+ * pictures that reference them.
+ */
+static void test_ref_cache(void)
+{
+	yuv_data_t *held[SURFACES] = { NULL };
+	int n, s;
+
+	CHECK_EQ(mock_device_create(1, 0, &device), VDP_STATUS_OK);
+	CHECK_EQ(vdp_decoder_create(device, VDP_DECODER_PROFILE_HEVC_MAIN, WIDTH, HEIGHT, SURFACES, &decoder), VDP_STATUS_OK);
+	decoder_ctx = handle_get(decoder);
+	for (s = 0; s < SURFACES; s++)
+		CHECK_EQ(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, WIDTH, HEIGHT, &surfaces[s]), VDP_STATUS_OK);
+
+	init_info(0);
+	info.scaling_list_enabled_flag = 0;
+	mock_ve.trigger = check_pic_list;
+
+	for (n = 0; n < 40; n++)
+	{
+		int pos = 0, nal_unit_type = n ? 1 : 19;
+
+		info.IDRPicFlag = !n;
+		info.RAPPicFlag = !n;
+		info.CurrPicOrderCntVal = n;
+
+		for (s = 0; s < 2 && s < n; s++)
+		{
+			info.RefPics[s] = surfaces[(n - 1 - s) % SURFACES];
+			info.PicOrderCntVal[s] = n - 1 - s;
+		}
+		info.NumPocStCurrBefore = min(n, 2);
+		info.RefPicSetStCurrBefore[1] = 1;
+		info.NumPocTotalCurr = min(n, 2);
+
+		// the same handle comes back with another buffer
+		if (n % 5 == 4)
+		{
+			s = (n - 2) % SURFACES;
+			vdp_video_surface_destroy(surfaces[s]);
+			CHECK_EQ(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, WIDTH, HEIGHT, &surfaces[s]), VDP_STATUS_OK);
+			CHECK_EQ(surfaces[s], info.RefPics[1]);
+		}
+
+		// still displayed, so the surface gets a new buffer
+		if (n % 7 == 6)
+		{
+			smart video_surface_ctx_t *vs = handle_get(info.RefPics[1]);
+			s = (n - 2) % SURFACES;
+			if (held[s])
+				yuv_unref(held[s]);
+			held[s] = yuv_ref(vs->yuv);
+			CHECK_EQ(yuv_prepare(vs), VDP_STATUS_OK);
+		}
+
+		for (s = 0; s < SLICES; s++)
+			put_slice(&pos, nal_unit_type, n ? SLICE_P : SLICE_I, s * CTBS / SLICES, n, 0, NULL);
+
+		CHECK_EQ(mock_decoder_render(decoder, surfaces[n % SURFACES], &info, stream, pos), VDP_STATUS_OK);
+	}
+
+	mock_ve.trigger = NULL;
+
+	struct h265_private *p = decoder_ctx->private;
+	CHECK_EQ(pic_list_mismatches, 0);
+	CHECK_EQ(pic_list_checked, (2 * 40 - 3) * SLICES);
+	// RefPics[1] was RefPics[0] of the picture before, unless re-created
+	CHECK_EQ(p->ref_cache.hits, 38 - 8);
+	CHECK_EQ(p->ref_cache.lookups, 1 + 38 + 8);
+
+	for (s = 0; s < SURFACES; s++)
+		if (held[s])
+			yuv_unref(held[s]);
+
+	sfree(decoder_ctx);
+	handle_destroy(decoder);
+	for (s = 0; s < SURFACES; s++)
+		vdp_video_surface_destroy(surfaces[s]);
+	handle_destroy(device);
+}
+
+#define CTB_ROWS ((HEIGHT + 63) / 64)
+#define MAX_SLICES 8
+
+struct substream
+{
+	int x, y, end_x, end_y;
+};
+
+static struct
+{
+	int address;
+	int entry_points;
+	uint32_t offset[CTB_COLS * CTB_ROWS];
+	struct substream substream[CTB_COLS * CTB_ROWS];
+} ep_slice[MAX_SLICES];
+
+static int ep_slices, ep_slices_checked, ep_mismatches;
+
+/*
+ * Splits the slice segments starting at the tile scan addresses in ts
+ * into substreams following 6.5.1 and 9.3.1 of the spec: a substream
+ * starts with every tile and, with WPP, with every CTB row of a tile.
+ */
+static void scan_substreams(const int *ts, int count)
+{
+	int col_bd[CTB_COLS + 1], row_bd[CTB_ROWS + 1], rs_to_ts[CTB_COLS * CTB_ROWS], ts_to_rs[CTB_COLS * CTB_ROWS];
+	int tile_x[CTB_COLS * CTB_ROWS], tile_y[CTB_COLS * CTB_ROWS];
+	int columns = info.tiles_enabled_flag ? info.num_tile_columns_minus1 + 1 : 1;
+	int rows = info.tiles_enabled_flag ? info.num_tile_rows_minus1 + 1 : 1;
+	int i, rs, tx, ty;
+
+	col_bd[0] = 0;
+	for (i = 0; i < columns; i++)
+		col_bd[i + 1] = col_bd[i] + (info.tiles_enabled_flag ? info.column_width_minus1[i] + 1 : CTB_COLS);
+	row_bd[0] = 0;
+	for (i = 0; i < rows; i++)
+		row_bd[i + 1] = row_bd[i] + (info.tiles_enabled_flag ? info.row_height_minus1[i] + 1 : CTB_ROWS);
+
+	for (rs = 0; rs < CTB_COLS * CTB_ROWS; rs++)
+	{
+		int x = rs % CTB_COLS, y = rs / CTB_COLS;
+
+		for (tx = 0; x >= col_bd[tx + 1]; tx++);
+		for (ty = 0; y >= row_bd[ty + 1]; ty++);
+
+		rs_to_ts[rs] = 0;
+		for (i = 0; i < tx; i++)
+			rs_to_ts[rs] += (row_bd[ty + 1] - row_bd[ty]) * (col_bd[i + 1] - col_bd[i]);
+		for (i = 0; i < ty; i++)
+			rs_to_ts[rs] += CTB_COLS * (row_bd[i + 1] - row_bd[i]);
+		rs_to_ts[rs] += (y - row_bd[ty]) * (col_bd[tx + 1] - col_bd[tx]) + x - col_bd[tx];
+
+		ts_to_rs[rs_to_ts[rs]] = rs;
+		tile_x[rs] = tx;
+		tile_y[rs] = ty;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		int t, end = i + 1 < count ? ts[i + 1] : CTB_COLS * CTB_ROWS;
+
+		ep_slice[i].address = ts_to_rs[ts[i]];
+		ep_slice[i].entry_points = 0;
+
+		for (t = ts[i] + 1; t < end; t++)
+		{
+			rs = ts_to_rs[t];
+			tx = tile_x[rs];
+			ty = tile_y[rs];
+
+			if (tx != tile_x[ts_to_rs[t - 1]] || ty != tile_y[ts_to_rs[t - 1]] ||
+				(info.entropy_coding_sync_enabled_flag && rs % CTB_COLS == col_bd[tx]))
+			{
+				struct substream *sub = &ep_slice[i].substream[ep_slice[i].entry_points++];
+				sub->x = rs % CTB_COLS;
+				sub->y = rs / CTB_COLS;
+				sub->end_x = col_bd[tx + 1] - 1;
+				sub->end_y = row_bd[ty + 1] - 1;
+			}
+		}
+	}
+
+	ep_slices = count;
+}
+
+static void check_entry_points(mock_ve_t *ve, uint32_t reg, uint32_t val)
+{
+	if (reg != VE_HEVC_TRIG || val != 0x8)
+		return;
+
+	struct h265_private *p = decoder_ctx->private;
+	int i, s = ep_slices_checked++;
+	int x = ep_slice[s].address % CTB_COLS, y = ep_slice[s].address / CTB_COLS;
+
+	if ((mock_ve_reg(ve, VE_HEVC_SLICE_HDR2) >> 8) != (uint32_t)ep_slice[s].entry_points)
+		ep_mismatches++;
+
+	if (info.tiles_enabled_flag)
+	{
+		int tx, x0, ty, y0;
+
+		for (x0 = 0, tx = 0; x0 + info.column_width_minus1[tx] + 1 <= x; tx++)
+			x0 += info.column_width_minus1[tx] + 1;
+		for (y0 = 0, ty = 0; y0 + info.row_height_minus1[ty] + 1 <= y; ty++)
+			y0 += info.row_height_minus1[ty] + 1;
+
+		if (mock_ve_reg(ve, VE_HEVC_TILE_START_CTB) != (uint32_t)((y0 << 16) | x0) ||
+			mock_ve_reg(ve, VE_HEVC_TILE_END_CTB) != (uint32_t)(((y0 + info.row_height_minus1[ty]) << 16) | (x0 + info.column_width_minus1[tx])))
+			ep_mismatches++;
+	}
+
+	if (!ep_slice[s].entry_points)
+		return;
+
+	if (mock_ve_reg(ve, VE_HEVC_TILE_LIST_ADDR) != cedrus_mem_get_bus_addr(p->entry_points) >> 8 ||
+		p->entry_points_size < ep_slice[s].entry_points * 16)
+	{
+		ep_mismatches++;
+		return;
+	}
+
+	uint32_t *entry_points = cedrus_mem_get_pointer(p->entry_points);
+	for (i = 0; i < ep_slice[s].entry_points; i++)
+	{
+		struct substream *sub = &ep_slice[s].substream[i];
+
+		if (entry_points[i * 4 + 0] != ep_slice[s].offset[i] ||
+			entry_points[i * 4 + 2] != (uint32_t)((sub->y << 16) | sub->x) ||
+			entry_points[i * 4 + 3] != (uint32_t)((sub->end_y << 16) | sub->end_x))
+		{
+			fprintf(stderr, "slice %d entry point %d: %08x %08x instead of %08x %08x\n", s, i,
+				entry_points[i * 4 + 2], entry_points[i * 4 + 3], (sub->y << 16) | sub->x, (sub->end_y << 16) | sub->end_x);
+			ep_mismatches++;
+		}
+	}
+}
+
+static void decode_entry_points(int wpp, int tiles, const int *ts, int count)
+{
+	int pos = 0, s;
+
+	init_info(wpp);
+	info.IDRPicFlag = 1;
+	info.RAPPicFlag = 1;
+
+	if (tiles)
+	{
+		// three columns and two rows of uneven size
+		info.tiles_enabled_flag = 1;
+		info.num_tile_columns_minus1 = 2;
+		info.column_width_minus1[0] = 5;
+		info.column_width_minus1[1] = 7;
+		info.column_width_minus1[2] = 5;
+		info.num_tile_rows_minus1 = 1;
+		info.row_height_minus1[0] = 4;
+		info.row_height_minus1[1] = 6;
+	}
+
+	scan_substreams(ts, count);
+
+	for (s = 0; s < count; s++)
+		put_slice(&pos, 19, SLICE_I, ep_slice[s].address, 0, ep_slice[s].entry_points, ep_slice[s].offset);
+
+	ep_slices_checked = 0;
+	CHECK_EQ(mock_decoder_render(decoder, surfaces[0], &info, stream, pos), VDP_STATUS_OK);
+	CHECK_EQ(ep_slices_checked, count);
+}
+
+static void test_entry_points(void)
+{
+	static const int rows[] = { 0, 20, 100 }, mid_row[] = { 0, 50, 130, 131 };
+	static const int whole_tiles[] = { 0, 70, 100 }, in_tile[] = { 0, 70, 100, 115, 198 };
+	int s;
+
+	CHECK_EQ(mock_device_create(1, 0, &device), VDP_STATUS_OK);
+	CHECK_EQ(vdp_decoder_create(device, VDP_DECODER_PROFILE_HEVC_MAIN, WIDTH, HEIGHT, SURFACES, &decoder), VDP_STATUS_OK);
+	decoder_ctx = handle_get(decoder);
+	CHECK_EQ(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, WIDTH, HEIGHT, &surfaces[0]), VDP_STATUS_OK);
+
+	mock_ve.trigger = check_entry_points;
+
+	decode_entry_points(1, 0, rows, ARRAY_SIZE(rows));
+	decode_entry_points(1, 0, mid_row, ARRAY_SIZE(mid_row));
+	decode_entry_points(0, 1, whole_tiles, ARRAY_SIZE(whole_tiles));
+	decode_entry_points(1, 1, whole_tiles, ARRAY_SIZE(whole_tiles));
+	decode_entry_points(1, 1, in_tile, ARRAY_SIZE(in_tile));
+
+	// a single slice with an entry point for every CTB row of every tile
+	s = 0;
+	decode_entry_points(1, 1, &s, 1);
+	CHECK_EQ(ep_slice[0].entry_points, 3 * 12 - 1);
+
+	mock_ve.trigger = NULL;
+
+	CHECK_EQ(ep_mismatches, 0);
+
+	sfree(decoder_ctx);
+	handle_destroy(decoder);
+	vdp_video_surface_destroy(surfaces[0]);
+	handle_destroy(device);
+}
+
+int main(void)
+{
+	decode_pictures(12, 0, 0);
+	decode_pictures(12, 1, 0);
+	decode_pictures(12, 1, 1);
+
+	CHECK_EQ(slices_checked, 3 * 12 * SLICES);
+	CHECK_EQ(mismatches, 0);
+
+	test_ref_cache();
+	test_entry_points();
+
+	return test_result("h265");
+}
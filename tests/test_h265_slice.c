@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <string.h>
+#include "h265_slice.h"
+#include "bitstream.h"
+#include "h265_gen.h"
+#include "test.h"
+
+static const uint8_t nal_unit_types[] = { 0, 1, 8, 9, 16, 19, 20, 21 };
+
+static struct h265_slice_header s, e;
+
+static int parse(const bitwriter_t *bw, VdpPictureInfoHEVC const *info, int escape)
+{
+	uint8_t nal[8192];
+	bitstream_t bs;
+	int len = 0;
+
+	if (escape)
+		bw_nal_unit(bw, nal, &len);
+	else
+	{
+		memcpy(nal + 3, bw->data, bw_bytes(bw));
+		len = 3 + bw_bytes(bw);
+	}
+
+	bs_init(&bs, nal + 3, len - 3, escape);
+	bs_get_u(&bs, 1);
+	uint8_t nal_unit_type = bs_get_u(&bs, 6);
+	bs_get_u(&bs, 9);
+
+	return h265_slice_header(&s, &bs, info, nal_unit_type);
+}
+
+// random headers have to be parsed to exactly what was generated
+static void test_round_trip(void)
+{
+	int i, j, dependent = 0;
+	bitwriter_t bw;
+	VdpPictureInfoHEVC info;
+
+	memset(&s, 0, sizeof(s));
+	memset(&e, 0, sizeof(e));
+
+	for (i = 0; i < 5000; i++)
+	{
+		gen_info(&info);
+		uint8_t nal_unit_type = nal_unit_types[test_rand() % ARRAY_SIZE(nal_unit_types)];
+		int segments = gen_range(1, 4);
+
+		for (j = 0; j < segments; j++)
+		{
+			bw_init(&bw);
+			gen_slice(&bw, &info, nal_unit_type, j == 0, &e);
+
+			CHECK(parse(&bw, &info, 1));
+			if (memcmp(&s, &e, sizeof(s)) != 0)
+			{
+				fprintf(stderr, "picture %d segment %d parsed differently\n", i, j);
+				test_failures++;
+				s = e;
+			}
+
+			dependent += e.dependent_slice_segment_flag;
+		}
+	}
+
+	CHECK(dependent > 0);
+}
+
+// dependent slice segments keep the header of the independent one
+static void test_dependent(void)
+{
+	bitwriter_t bw;
+	VdpPictureInfoHEVC info;
+
+	memset(&info, 0, sizeof(info));
+	info.pic_width_in_luma_samples = 1280;
+	info.pic_height_in_luma_samples = 720;
+	info.log2_diff_max_min_luma_coding_block_size = 3;
+	info.dependent_slice_segments_enabled_flag = 1;
+	info.entropy_coding_sync_enabled_flag = 1;
+
+	memset(&s, 0, sizeof(s));
+
+	bw_init(&bw);
+	bw_put_u(&bw, 0x2601, 16);
+	bw_put_u(&bw, 1, 1);
+	bw_put_u(&bw, 0, 1);
+	bw_put_ue(&bw, 0);
+	bw_put_ue(&bw, SLICE_I);
+	bw_put_se(&bw, -7);
+	bw_put_ue(&bw, 2);
+	bw_put_ue(&bw, 3);
+	bw_put_u(&bw, 5, 4);
+	bw_put_u(&bw, 9, 4);
+	bw_trailing_bits(&bw);
+	CHECK(parse(&bw, &info, 1));
+	CHECK_EQ(s.slice_qp_delta, -7);
+	CHECK_EQ(s.num_entry_point_offsets, 2);
+
+	bw_init(&bw);
+	bw_put_u(&bw, 0x2601, 16);
+	bw_put_u(&bw, 0, 1);
+	bw_put_u(&bw, 0, 1);
+	bw_put_ue(&bw, 0);
+	bw_put_u(&bw, 1, 1);
+	bw_put_u(&bw, 100, 8);
+	bw_put_ue(&bw, 0);
+	bw_trailing_bits(&bw);
+	CHECK(parse(&bw, &info, 1));
+	CHECK_EQ(s.first_slice_segment_in_pic_flag, 0);
+	CHECK_EQ(s.dependent_slice_segment_flag, 1);
+	CHECK_EQ(s.slice_segment_address, 100);
+	CHECK_EQ(s.slice_type, SLICE_I);
+	CHECK_EQ(s.slice_qp_delta, -7);
+	CHECK_EQ(s.num_entry_point_offsets, 0);
+
+	// the next picture starts with an independent segment again
+	bw_init(&bw);
+	bw_put_u(&bw, 0x0201, 16);
+	bw_put_u(&bw, 1, 1);
+	bw_put_ue(&bw, 0);
+	bw_put_ue(&bw, SLICE_I);
+	bw_put_u(&bw, 0, 4);
+	bw_put_u(&bw, 0, 1);
+	bw_put_se(&bw, 3);
+	bw_put_ue(&bw, 0);
+	bw_trailing_bits(&bw);
+	CHECK(parse(&bw, &info, 1));
+	CHECK_EQ(s.dependent_slice_segment_flag, 0);
+	CHECK_EQ(s.slice_segment_address, 0);
+	CHECK_EQ(s.slice_qp_delta, 3);
+}
+
+static void put_header(bitwriter_t *bw, uint32_t address, uint32_t slice_type)
+{
+	bw_init(bw);
+	bw_put_u(bw, 0x0201, 16);
+	bw_put_u(bw, address == 0, 1);
+	bw_put_ue(bw, 0);
+	if (address)
+		bw_put_u(bw, address, 8);
+	bw_put_ue(bw, slice_type);
+	bw_put_u(bw, 0, 4);
+	bw_put_u(bw, 0, 1);
+}
+
+// headers a conforming stream can't contain are rejected
+static void test_invalid(void)
+{
+	bitwriter_t bw;
+	VdpPictureInfoHEVC info;
+
+	memset(&info, 0, sizeof(info));
+	info.pic_width_in_luma_samples = 1280;
+	info.pic_height_in_luma_samples = 720;
+	info.log2_diff_max_min_luma_coding_block_size = 3;
+	info.entropy_coding_sync_enabled_flag = 1;
+	info.lists_modification_present_flag = 1;
+	info.NumPocTotalCurr = 3;
+
+	// 20x12 CTBs, the address is coded in 8 bits
+	put_header(&bw, 239, SLICE_I);
+	bw_put_se(&bw, 0);
+	bw_put_ue(&bw, 0);
+	bw_trailing_bits(&bw);
+	CHECK(parse(&bw, &info, 1));
+	CHECK_EQ(s.slice_segment_address, 239);
+
+	put_header(&bw, 240, SLICE_I);
+	bw_put_se(&bw, 0);
+	bw_put_ue(&bw, 0);
+	bw_trailing_bits(&bw);
+	CHECK(!parse(&bw, &info, 1));
+
+	put_header(&bw, 255, SLICE_I);
+	bw_put_se(&bw, 0);
+	bw_put_ue(&bw, 0);
+	bw_trailing_bits(&bw);
+	CHECK(!parse(&bw, &info, 1));
+
+	put_header(&bw, 0, 3);
+	bw_put_se(&bw, 0);
+	bw_put_ue(&bw, 0);
+	bw_trailing_bits(&bw);
+	CHECK(!parse(&bw, &info, 1));
+
+	put_header(&bw, 0, SLICE_I);
+	bw_put_se(&bw, 0);
+	bw_put_ue(&bw, MAX_ENTRY_POINTS + 1);
+	bw_trailing_bits(&bw);
+	CHECK(!parse(&bw, &info, 1));
+
+	put_header(&bw, 0, SLICE_I);
+	bw_put_se(&bw, 0);
+	bw_put_ue(&bw, 1);
+	bw_put_ue(&bw, 32);
+	bw_put_u(&bw, 0, 32);
+	bw_put_u(&bw, 0, 1);
+	bw_trailing_bits(&bw);
+	CHECK(!parse(&bw, &info, 1));
+
+	// P slice with one reference, list_entry_l0 has 2 bits
+	put_header(&bw, 0, SLICE_P);
+	bw_put_u(&bw, 1, 1);
+	bw_put_ue(&bw, 0);
+	bw_put_u(&bw, 1, 1);
+	bw_put_u(&bw, 2, 2);
+	bw_put_ue(&bw, 0);
+	bw_put_se(&bw, 0);
+	bw_put_ue(&bw, 0);
+	bw_trailing_bits(&bw);
+	CHECK(parse(&bw, &info, 1));
+	CHECK_EQ(s.list_entry_l0[0], 2);
+
+	put_header(&bw, 0, SLICE_P);
+	bw_put_u(&bw, 1, 1);
+	bw_put_ue(&bw, 0);
+	bw_put_u(&bw, 1, 1);
+	bw_put_u(&bw, 3, 2);
+	bw_put_ue(&bw, 0);
+	bw_put_se(&bw, 0);
+	bw_put_ue(&bw, 0);
+	bw_trailing_bits(&bw);
+	CHECK(!parse(&bw, &info, 1));
+
+	put_header(&bw, 0, SLICE_P);
+	bw_put_u(&bw, 1, 1);
+	bw_put_ue(&bw, 15);
+	bw_trailing_bits(&bw);
+	CHECK(!parse(&bw, &info, 1));
+}
+
+// every header cut short before its last bit is rejected
+static void test_truncated(void)
+{
+	int i, len, failures = 0;
+	bitwriter_t bw;
+	VdpPictureInfoHEVC info;
+
+	for (i = 0; i < 500; i++)
+	{
+		gen_info(&info);
+		memset(&e, 0, sizeof(e));
+		bw_init(&bw);
+		gen_slice(&bw, &info, nal_unit_types[test_rand() % ARRAY_SIZE(nal_unit_types)], 1, &e);
+
+		// trailing bits are not read, the last byte may hold only them
+		for (len = bw_bytes(&bw) - 2; len >= 2; len--)
+		{
+			bw.bits = len * 8;
+			memset(&s, 0, sizeof(s));
+			if (parse(&bw, &info, 0))
+				failures++;
+		}
+	}
+
+	CHECK_EQ(failures, 0);
+}
+
+int main(void)
+{
+	test_round_trip();
+	test_dependent();
+	test_invalid();
+	test_truncated();
+
+	return test_result("h265_slice");
+}
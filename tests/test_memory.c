@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdlib.h>
+#include "memory.h"
+#include "test.h"
+
+/*
+ * A mock CMA allocator with a fixed capacity, so running out of memory
+ * can be tested independently from the budget.
+ */
+struct cedrus_mem
+{
+	size_t size;
+};
+
+static size_t cma_capacity, cma_used;
+static int cma_allocs, cma_frees;
+
+cedrus_mem_t *cedrus_mem_alloc(cedrus_t *dev, size_t size)
+{
+	if (cma_used + size > cma_capacity)
+		return NULL;
+
+	cedrus_mem_t *mem = malloc(sizeof(*mem));
+	mem->size = size;
+	cma_used += size;
+	cma_allocs++;
+	return mem;
+}
+
+void cedrus_mem_free(cedrus_mem_t *mem)
+{
+	cma_used -= mem->size;
+	cma_frees++;
+	free(mem);
+}
+
+// a cache of up to 8 buffers, like the YUV and MV pools
+typedef struct
+{
+	mem_shrinker_t shrinker;
+	mem_account_t *account;
+	cedrus_mem_t *data[8];
+	int count;
+	int calls;
+} cache_t;
+
+static size_t cache_shrink(mem_shrinker_t *shrinker)
+{
+	cache_t *cache = (cache_t *)shrinker;
+	size_t freed = 0;
+
+	cache->calls++;
+	while (cache->count > 0)
+	{
+		cedrus_mem_t *mem = cache->data[--cache->count];
+		freed += mem->size;
+		mem_account_free(cache->account, mem);
+	}
+
+	return freed;
+}
+
+static void cache_init(cache_t *cache, mem_account_t *account)
+{
+	cache->shrinker.shrink = cache_shrink;
+	cache->account = account;
+	cache->count = 0;
+	cache->calls = 0;
+	mem_shrinker_register(account, &cache->shrinker);
+}
+
+static void cache_fill(cache_t *cache, size_t size, int count)
+{
+	while (count--)
+	{
+		cedrus_mem_t *mem = mem_account_alloc(cache->account, size, MEM_CACHED, cache);
+		CHECK(mem != NULL);
+		cache->data[cache->count++] = mem;
+	}
+}
+
+static void check_usage(mem_account_t *account, enum mem_category category, size_t current, size_t peak)
+{
+	size_t c, p;
+
+	mem_account_usage(account, category, &c, &p);
+	CHECK_EQ(c, current);
+	CHECK_EQ(p, peak);
+}
+
+static void test_accounting(void)
+{
+	mem_account_t account;
+	cedrus_mem_t *mem[64];
+	size_t sizes[64], current[MEM_CATEGORIES] = { 0 }, total = 0, total_peak = 0;
+	enum mem_category categories[64];
+	int i;
+
+	cma_capacity = (size_t)-1;
+	mem_account_init(&account, NULL, 0);
+
+	// allocate and free in random order, the totals must follow
+	for (i = 0; i < 64; i++)
+	{
+		sizes[i] = (test_rand() % 256 + 1) * 4096;
+		categories[i] = test_rand() % MEM_CATEGORIES;
+		mem[i] = mem_account_alloc(&account, sizes[i], categories[i], &mem[i]);
+		CHECK(mem[i] != NULL);
+		current[categories[i]] += sizes[i];
+		total += sizes[i];
+	}
+	total_peak = total;
+
+	for (i = 0; i < MEM_CATEGORIES; i++)
+		check_usage(&account, i, current[i], current[i]);
+	check_usage(&account, MEM_CATEGORIES, total, total_peak);
+
+	for (i = 0; i < 64; i += 2)
+	{
+		mem_account_free(&account, mem[i]);
+		current[categories[i]] -= sizes[i];
+		total -= sizes[i];
+	}
+
+	size_t c;
+	mem_account_usage(&account, MEM_CATEGORIES, &c, NULL);
+	CHECK_EQ(c, total);
+
+	// retagging moves the bytes, the total stays
+	mem_account_retag(&account, mem[1], MEM_CACHED, &account);
+	current[categories[1]] -= sizes[1];
+	current[MEM_CACHED] += sizes[1];
+	for (i = 0; i < MEM_CATEGORIES; i++)
+	{
+		mem_account_usage(&account, i, &c, NULL);
+		CHECK_EQ(c, current[i]);
+	}
+	check_usage(&account, MEM_CATEGORIES, total, total_peak);
+
+	mem_account_retag(&account, mem[1], MEM_YUV, mem[1]);
+	current[MEM_CACHED] -= sizes[1];
+	current[MEM_YUV] += sizes[1];
+	mem_account_usage(&account, MEM_CACHED, &c, NULL);
+	CHECK_EQ(c, current[MEM_CACHED]);
+
+	for (i = 1; i < 64; i += 2)
+		mem_account_free(&account, mem[i]);
+
+	check_usage(&account, MEM_CATEGORIES, 0, total_peak);
+	CHECK_EQ(account.failures, 0);
+	CHECK_EQ(cma_allocs, cma_frees);
+	mem_account_release(&account);
+}
+
+static void test_budget(void)
+{
+	mem_account_t account;
+	cache_t yuv, mv;
+
+	cma_capacity = (size_t)-1;
+	mem_account_init(&account, NULL, 10 * 4096);
+	cache_init(&yuv, &account);
+	cache_init(&mv, &account);
+
+	cache_fill(&yuv, 4096, 4);
+	cache_fill(&mv, 2 * 4096, 2);
+	cedrus_mem_t *a = mem_account_alloc(&account, 2 * 4096, MEM_VBV, NULL);
+	CHECK(a != NULL);
+
+	// the budget is full, the caches must be shed, most recently registered first
+	cedrus_mem_t *b = mem_account_alloc(&account, 3 * 4096, MEM_YUV, NULL);
+	CHECK(b != NULL);
+	CHECK_EQ(mv.calls, 1);
+	CHECK_EQ(mv.count, 0);
+	CHECK_EQ(yuv.calls, 0);
+	CHECK_EQ(yuv.count, 4);
+
+	cedrus_mem_t *c = mem_account_alloc(&account, 4 * 4096, MEM_YUV, NULL);
+	CHECK(c != NULL);
+	CHECK_EQ(yuv.calls, 1);
+	CHECK_EQ(yuv.count, 0);
+
+	// nothing left to shed
+	CHECK(mem_account_alloc(&account, 2 * 4096, MEM_YUV, NULL) == NULL);
+	CHECK_EQ(account.failures, 1);
+	CHECK_EQ(mv.calls, 3);
+	CHECK_EQ(yuv.calls, 2);
+	check_usage(&account, MEM_CATEGORIES, 9 * 4096, 10 * 4096);
+
+	mem_account_free(&account, a);
+	mem_account_free(&account, b);
+	mem_account_free(&account, c);
+	mem_shrinker_unregister(&account, &mv.shrinker);
+	mem_shrinker_unregister(&account, &yuv.shrinker);
+
+	// unregistered caches are left alone
+	cache_fill(&yuv, 4096, 8);
+	CHECK(mem_account_alloc(&account, 4 * 4096, MEM_YUV, NULL) == NULL);
+	CHECK_EQ(yuv.calls, 2);
+	CHECK_EQ(yuv.count, 8);
+	cache_shrink(&yuv.shrinker);
+
+	CHECK_EQ(cma_allocs, cma_frees);
+	mem_account_release(&account);
+}
+
+static void test_cma_exhausted(void)
+{
+	mem_account_t account;
+	cache_t yuv;
+
+	// no budget, but the CMA pool itself runs out
+	cma_capacity = 8 * 4096;
+	mem_account_init(&account, NULL, 0);
+	cache_init(&yuv, &account);
+
+	cache_fill(&yuv, 4096, 6);
+	cedrus_mem_t *a = mem_account_alloc(&account, 4 * 4096, MEM_REC, NULL);
+	CHECK(a != NULL);
+	CHECK_EQ(yuv.calls, 1);
+	check_usage(&account, MEM_CATEGORIES, 4 * 4096, 6 * 4096);
+	check_usage(&account, MEM_CACHED, 0, 6 * 4096);
+
+	CHECK(mem_account_alloc(&account, 5 * 4096, MEM_REC, NULL) == NULL);
+	CHECK_EQ(account.failures, 1);
+	check_usage(&account, MEM_CATEGORIES, 4 * 4096, 6 * 4096);
+
+	mem_account_free(&account, a);
+	mem_shrinker_unregister(&account, &yuv.shrinker);
+	CHECK_EQ(cma_used, 0);
+	mem_account_release(&account);
+}
+
+int main(void)
+{
+	test_accounting();
+	test_budget();
+	test_cma_exhausted();
+
+	return test_result("memory");
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "../mpeg4.c"
+#include "mock/driver.h"
+#include "bitwriter.h"
+#include "test.h"
+
+static void test_resync_marker_length(void)
+{
+	VdpPictureInfoMPEG4Part2 info = { 0 };
+	int fcode;
+
+	CHECK_EQ(resync_marker_length(&info, VOP_I), 17);
+
+	for (fcode = 1; fcode <= 7; fcode++)
+	{
+		info.vop_fcode_forward = fcode;
+		info.vop_fcode_backward = 1;
+		CHECK_EQ(resync_marker_length(&info, VOP_P), 16 + fcode);
+		CHECK_EQ(resync_marker_length(&info, VOP_S), 16 + fcode);
+
+		// at least 17 zeros for B-VOPs, from either fcode
+		CHECK_EQ(resync_marker_length(&info, VOP_B), max(18, 16 + fcode));
+		info.vop_fcode_forward = 1;
+		info.vop_fcode_backward = fcode;
+		CHECK_EQ(resync_marker_length(&info, VOP_B), max(18, 16 + fcode));
+	}
+}
+
+// macroblock data that never contains two zero bytes in a row
+static void put_mb_data(bitwriter_t *bw, int bytes)
+{
+	while (bytes--)
+		bw_put_u(bw, test_rand() | 0x01, 8);
+}
+
+static void test_find_resync_marker(void)
+{
+	int length, pos;
+
+	for (length = 17; length <= 23; length++)
+	{
+		bitwriter_t bw;
+		int markers[4];
+
+		bw_init(&bw);
+		put_mb_data(&bw, 10);
+		for (pos = 0; pos < 4; pos++)
+		{
+			markers[pos] = bw_bytes(&bw);
+			bw_put_u(&bw, 1, length);
+			bw_put_u(&bw, test_rand(), 24 - length);
+			put_mb_data(&bw, 1 + test_rand() % 20);
+		}
+
+		// a marker one bit shorter, as in a P-VOP with a smaller fcode
+		int shorter = bw_bytes(&bw);
+		bw_put_u(&bw, 1, length - 1);
+		bw_put_u(&bw, 0xffffffff, 25 - length);
+		put_mb_data(&bw, 5);
+
+		// a start code ends the VOP
+		int startcode = bw_bytes(&bw);
+		bw_put_u(&bw, 0x000001b6, 32);
+		put_mb_data(&bw, 5);
+
+		pos = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			pos = find_resync_marker(bw.data, pos, bw_bytes(&bw), length);
+			CHECK_EQ(pos, markers[i]);
+			pos++;
+		}
+
+		CHECK_EQ(find_resync_marker(bw.data, pos, bw_bytes(&bw), length), -1);
+		CHECK_EQ(find_resync_marker(bw.data, pos, bw_bytes(&bw), length - 1), length > 17 ? shorter : -1);
+		CHECK_EQ(find_resync_marker(bw.data, startcode, bw_bytes(&bw), length), -1);
+
+		// a marker has to fit before the end
+		CHECK_EQ(find_resync_marker(bw.data, markers[3], markers[3] + 2, length), -1);
+		CHECK_EQ(find_resync_marker(bw.data, markers[3], markers[3] + 3, length), markers[3]);
+	}
+}
+
+struct packet_header
+{
+	int mb_count;
+	int resolution;
+	int hec;
+	int vop_coding_type;
+	int modulo_time_base;
+};
+
+static void put_packet_header(bitwriter_t *bw, const struct packet_header *h, int marker_length, int mb, int quant)
+{
+	int mb_bits = 0;
+
+	while ((1 << mb_bits) < h->mb_count)
+		mb_bits++;
+
+	bw_put_u(bw, 1, marker_length);
+	bw_put_u(bw, mb, max(mb_bits, 1));
+	bw_put_u(bw, quant, 5);
+	bw_put_u(bw, h->hec, 1);
+
+	if (h->hec)
+	{
+		int time_bits = 1;
+
+		while ((1 << time_bits) < h->resolution)
+			time_bits++;
+
+		bw_put_u(bw, (1 << (h->modulo_time_base + 1)) - 2, h->modulo_time_base + 1);
+		bw_put_u(bw, 1, 1);
+		bw_put_u(bw, h->resolution - 1, time_bits);
+		bw_put_u(bw, 1, 1);
+		bw_put_u(bw, h->vop_coding_type, 2);
+		bw_put_u(bw, 3, 3);
+		if (h->vop_coding_type != VOP_I)
+			bw_put_u(bw, 2, 3);
+		if (h->vop_coding_type == VOP_B)
+			bw_put_u(bw, 1, 3);
+	}
+}
+
+static void test_video_packet_header(void)
+{
+	static const int mb_counts[] = { 1, 2, 3, 99, 256, 396, 1620, 8160 };
+	static const int resolutions[] = { 1, 2, 25, 30, 32, 1000, 1024, 30000, 65535 };
+	unsigned int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(mb_counts); i++)
+	{
+		for (j = 0; j < ARRAY_SIZE(resolutions) * 4; j++)
+		{
+			struct packet_header h = {
+				.mb_count = mb_counts[i],
+				.resolution = resolutions[j / 4],
+				.hec = j % 4 != 0,
+				.vop_coding_type = j % 4 - 1,
+				.modulo_time_base = test_rand() % 3,
+			};
+			VdpPictureInfoMPEG4Part2 info = {
+				.vop_time_increment_resolution = h.resolution,
+				.vop_fcode_forward = 1 + test_rand() % 7,
+				.vop_fcode_backward = 1 + test_rand() % 7,
+			};
+			int marker_length = resync_marker_length(&info, h.hec ? h.vop_coding_type : VOP_B);
+			int mb = h.mb_count > 1 ? 1 + test_rand() % (h.mb_count - 1) : 0;
+			int quant = 1 + test_rand() % 31;
+			video_packet p = { 0 };
+			bitwriter_t bw;
+			bitstream_t bs;
+
+			bw_init(&bw);
+			put_packet_header(&bw, &h, marker_length, mb, quant);
+			unsigned int bits = bw.bits;
+			put_mb_data(&bw, 4);
+
+			bs_init(&bs, bw.data, bw_bytes(&bw), 0);
+			CHECK_EQ(decode_video_packet_header(&bs, &info, marker_length, h.mb_count, &p), mb > 0);
+			CHECK_EQ(p.mb, mb);
+			CHECK_EQ(p.quant, quant);
+			CHECK_EQ(p.bitpos, bits);
+
+			// the first macroblock of the VOP can't start a packet
+			bw_init(&bw);
+			put_packet_header(&bw, &h, marker_length, 0, quant);
+			put_mb_data(&bw, 4);
+			bs_init(&bs, bw.data, bw_bytes(&bw), 0);
+			CHECK_EQ(decode_video_packet_header(&bs, &info, marker_length, h.mb_count, &p), 0);
+
+			// neither can a macroblock past the end
+			if (h.mb_count > 2)
+			{
+				bw_init(&bw);
+				put_packet_header(&bw, &h, marker_length, h.mb_count, quant);
+				put_mb_data(&bw, 4);
+				bs_init(&bs, bw.data, bw_bytes(&bw), 0);
+				CHECK_EQ(decode_video_packet_header(&bs, &info, marker_length, h.mb_count, &p), 0);
+			}
+
+			// truncated in the middle of the header
+			bw_init(&bw);
+			put_packet_header(&bw, &h, marker_length, mb, quant);
+			bs_init(&bs, bw.data, bw.bits / 8 - 1, 0);
+			CHECK_EQ(decode_video_packet_header(&bs, &info, marker_length, h.mb_count, &p), 0);
+		}
+	}
+}
+
+int main(void)
+{
+	test_resync_marker_length();
+	test_find_resync_marker();
+	test_video_packet_header();
+
+	return test_result("mpeg4");
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "startcode.h"
+#include "test.h"
+
+static int scalar_find_startcode(const uint8_t *data, int len, int start)
+{
+	int pos;
+
+	for (pos = start; pos + 2 < len; pos++)
+		if (data[pos] == 0x00 && data[pos + 1] == 0x00 && data[pos + 2] == 0x01)
+			return pos;
+
+	return -1;
+}
+
+// mostly zeros and ones, so that start codes and near misses are frequent
+static void fill_random(uint8_t *data, int len, int density)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+	{
+		uint32_t r = test_rand();
+		if (r % density == 0)
+			data[i] = (r >> 8) & 1;
+		else
+			data[i] = 0x02 + (r >> 8) % 0xfe;
+	}
+}
+
+static void test_differential(void)
+{
+	uint8_t data[300];
+	int round, len, start;
+
+	for (round = 0; round < 2000; round++)
+	{
+		len = test_rand() % sizeof(data);
+		fill_random(data, len, 1 + round % 16);
+
+		for (start = 0; start <= len; start++)
+			CHECK_EQ(find_startcode(data, len, start), scalar_find_startcode(data, len, start));
+	}
+}
+
+static void test_buffer_end(void)
+{
+	uint8_t data[64];
+	int len;
+
+	// a start code right at the end of buffers of every length
+	for (len = 3; len <= (int)sizeof(data); len++)
+	{
+		memset(data, 0xff, sizeof(data));
+		data[len - 3] = 0x00;
+		data[len - 2] = 0x00;
+		data[len - 1] = 0x01;
+
+		CHECK_EQ(find_startcode(data, len, 0), len - 3);
+		// the start code is cut off
+		CHECK_EQ(find_startcode(data, len - 1, 0), -1);
+	}
+
+	CHECK_EQ(find_startcode(data, 0, 0), -1);
+	CHECK_EQ(find_startcode(data, sizeof(data), -1), -1);
+}
+
+static void test_nal_units_annexb(void)
+{
+	uint8_t data[4096];
+	int offsets[64], expected[4096];
+	int round;
+
+	for (round = 0; round < 500; round++)
+	{
+		int len = test_rand() % sizeof(data);
+		int count = 0, pos = 0, n, i;
+
+		fill_random(data, len, 2 + round % 64);
+
+		while ((pos = scalar_find_startcode(data, len, pos)) != -1)
+		{
+			expected[count++] = pos + 3;
+			pos += 3;
+		}
+
+		n = find_nal_units(data, len, 0, offsets, ARRAY_SIZE(offsets));
+		CHECK_EQ(n, count);
+		for (i = 0; i < count && i < (int)ARRAY_SIZE(offsets); i++)
+			CHECK_EQ(offsets[i], expected[i]);
+	}
+}
+
+// writes a NAL unit of size bytes with a length prefix, returns the new end
+static int put_nal_unit(uint8_t *data, int pos, int nal_length_size, uint32_t size)
+{
+	int i;
+
+	for (i = nal_length_size - 1; i >= 0; i--)
+		data[pos + nal_length_size - 1 - i] = size >> (i * 8);
+
+	memset(data + pos + nal_length_size, 0x00, size);
+
+	return pos + nal_length_size + size;
+}
+
+static void test_nal_units_length_prefixed(void)
+{
+	static const int nal_length_sizes[] = { 1, 2, 4 };
+	uint8_t data[4096];
+	int offsets[16];
+	int next;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(nal_length_sizes); i++)
+	{
+		int n = nal_length_sizes[i];
+		int len = 0, count;
+
+		next = 0;
+
+		// zero bytes in the payload must not be taken for start codes
+		len = put_nal_unit(data, len, n, 5);
+		len = put_nal_unit(data, len, n, 200);
+		len = put_nal_unit(data, len, n, 1);
+
+		CHECK_EQ(find_nal_unit(data, len, &next, n), n);
+		CHECK_EQ(next, n + 5);
+		CHECK_EQ(find_nal_unit(data, len, &next, n), 2 * n + 5);
+		CHECK_EQ(next, 2 * n + 205);
+		CHECK_EQ(find_nal_unit(data, len, &next, n), 3 * n + 205);
+		CHECK_EQ(next, len);
+		CHECK_EQ(find_nal_unit(data, len, &next, n), -1);
+
+		count = find_nal_units(data, len, n, offsets, ARRAY_SIZE(offsets));
+		CHECK_EQ(count, 3);
+		CHECK_EQ(offsets[2], 3 * n + 205);
+
+		// the length prefix itself is cut off
+		next = 0;
+		CHECK_EQ(find_nal_unit(data, n - 1, &next, n), -1);
+		next = n + 5;
+		CHECK_EQ(find_nal_unit(data, n + 5 + n - 1, &next, n), -1);
+
+		// the length points past the end of the buffer
+		next = 0;
+		CHECK_EQ(find_nal_unit(data, n + 4, &next, n), -1);
+		CHECK_EQ(next, 0);
+		CHECK_EQ(find_nal_units(data, len - 1, n, offsets, ARRAY_SIZE(offsets)), 2);
+
+		// an empty NAL unit ends the scan
+		len = put_nal_unit(data, 0, n, 0);
+		next = 0;
+		CHECK_EQ(find_nal_unit(data, len, &next, n), -1);
+	}
+
+	// a 4 byte length that would overflow int arithmetic
+	memset(data, 0xff, 8);
+	next = 0;
+	CHECK_EQ(find_nal_unit(data, 8, &next, 4), -1);
+}
+
+int main(void)
+{
+	test_differential();
+	test_buffer_end();
+	test_nal_units_annexb();
+	test_nal_units_length_prefixed();
+
+	return test_result("startcode");
+}
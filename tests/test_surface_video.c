@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <pthread.h>
+#include "mock/driver.h"
+#include "test.h"
+
+// the scaled surface has to match the downscaled size exactly
+static void test_scaled_output_size(void)
+{
+	VdpDevice device;
+	VdpVideoSurface surface, scaled;
+	static const struct { uint32_t width, height, scale; VdpStatus ret; } sizes[] = {
+		{ 960, 540, 1, VDP_STATUS_OK },
+		{ 480, 270, 2, VDP_STATUS_OK },
+		{ 240, 135, 3, VDP_STATUS_OK },
+		{ 961, 540, 1, VDP_STATUS_INVALID_SIZE },
+		{ 960, 541, 1, VDP_STATUS_INVALID_SIZE },
+		{ 959, 540, 1, VDP_STATUS_INVALID_SIZE },
+		{ 1920, 1080, 1, VDP_STATUS_INVALID_SIZE },
+		{ 480, 270, 1, VDP_STATUS_INVALID_SIZE },
+	};
+	unsigned int i;
+
+	CHECK_EQ(mock_device_create(0, 0, &device), VDP_STATUS_OK);
+	CHECK_EQ(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, 1920, 1080, &surface), VDP_STATUS_OK);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++)
+	{
+		CHECK_EQ(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, sizes[i].width, sizes[i].height, &scaled), VDP_STATUS_OK);
+		CHECK_EQ(vdp_video_surface_set_scaled_output_sunxi(surface, scaled, sizes[i].scale), sizes[i].ret);
+
+		smart video_surface_ctx_t *vs = handle_get(surface);
+		CHECK_EQ(vs->scale, sizes[i].ret == VDP_STATUS_OK ? sizes[i].scale : 0);
+		CHECK_EQ(vs->scaled != NULL, sizes[i].ret == VDP_STATUS_OK);
+
+		CHECK_EQ(vdp_video_surface_set_scaled_output_sunxi(surface, VDP_INVALID_HANDLE, 0), VDP_STATUS_OK);
+		vdp_video_surface_destroy(scaled);
+	}
+
+	// odd sizes round up
+	vdp_video_surface_destroy(surface);
+	CHECK_EQ(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, 1366, 767, &surface), VDP_STATUS_OK);
+	CHECK_EQ(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, 171, 96, &scaled), VDP_STATUS_OK);
+	CHECK_EQ(vdp_video_surface_set_scaled_output_sunxi(surface, scaled, 3), VDP_STATUS_OK);
+	CHECK_EQ(vdp_video_surface_set_scaled_output_sunxi(surface, VDP_INVALID_HANDLE, 0), VDP_STATUS_OK);
+	vdp_video_surface_destroy(scaled);
+
+	vdp_video_surface_destroy(surface);
+	handle_destroy(device);
+}
+
+#define SOAK_SURFACES 8
+#define SOAK_HOLDS 12
+
+static const uint32_t soak_sizes[][2] = { { 1920, 1080 }, { 1280, 720 }, { 720, 576 } };
+
+static int yuv_live(yuv_data_t **live, int count, yuv_data_t *yuv)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (live[i] == yuv)
+			return count;
+
+	live[count] = yuv;
+	return count + 1;
+}
+
+// the pool and the CMA accounting have to agree with what is in use
+static int check_pool(device_ctx_t *dev, VdpVideoSurface *surfaces, yuv_data_t **holds)
+{
+	yuv_data_t *live[SOAK_SURFACES + SOAK_HOLDS];
+	size_t yuv_current, cached_current, peak, live_size = 0, pooled_size = 0;
+	int i, count = 0, ok = 1;
+
+	for (i = 0; i < SOAK_SURFACES; i++)
+		if (surfaces[i] != VDP_INVALID_HANDLE)
+		{
+			smart video_surface_ctx_t *vs = handle_get(surfaces[i]);
+			count = yuv_live(live, count, vs->yuv);
+		}
+
+	for (i = 0; i < SOAK_HOLDS; i++)
+		if (holds[i])
+			count = yuv_live(live, count, holds[i]);
+
+	for (i = 0; i < count; i++)
+		live_size += live[i]->size;
+
+	for (i = 0; i < dev->yuv_pool.count; i++)
+		pooled_size += dev->yuv_pool.size[i];
+
+	mem_account_usage(&dev->mem, MEM_YUV, &yuv_current, &peak);
+	mem_account_usage(&dev->mem, MEM_CACHED, &cached_current, &peak);
+
+	ok &= dev->yuv_pool.count <= dev->yuv_pool.cap;
+	ok &= yuv_current == live_size;
+	ok &= cached_current == pooled_size;
+	ok &= mock_mem_allocs - mock_mem_frees == (unsigned long)(count + dev->yuv_pool.count);
+	ok &= !dev->mem.budget || dev->mem.total <= dev->mem.budget;
+
+	return ok;
+}
+
+/*
+ * Surfaces are created, decoded to, held by an output surface or the
+ * display and destroyed in random order. Half way a CMA budget forces
+ * the pool to be trimmed.
+ */
+static void test_yuv_pool_soak(void)
+{
+	VdpDevice device;
+	VdpVideoSurface surfaces[SOAK_SURFACES];
+	yuv_data_t *holds[SOAK_HOLDS];
+	int i, n, errors = 0, refused = 0;
+	unsigned long allocs = mock_mem_allocs, frees = mock_mem_frees;
+
+	CHECK_EQ(mock_device_create(0, 0, &device), VDP_STATUS_OK);
+	device_ctx_t *dev = handle_get(device);
+
+	for (i = 0; i < SOAK_SURFACES; i++)
+		surfaces[i] = VDP_INVALID_HANDLE;
+	memset(holds, 0, sizeof(holds));
+
+	for (n = 0; n < 200000; n++)
+	{
+		int s = test_rand() % SOAK_SURFACES, h = test_rand() % SOAK_HOLDS;
+
+		if (n == 100000)
+			dev->mem.budget = dev->mem.total + 4 * 1920 * 1088 * 3 / 2;
+
+		if (surfaces[s] == VDP_INVALID_HANDLE)
+		{
+			const uint32_t *size = soak_sizes[test_rand() % ARRAY_SIZE(soak_sizes)];
+			if (vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, size[0], size[1], &surfaces[s]) != VDP_STATUS_OK)
+			{
+				surfaces[s] = VDP_INVALID_HANDLE;
+				refused++;
+			}
+		}
+		else
+		{
+			smart video_surface_ctx_t *vs = handle_get(surfaces[s]);
+
+			switch (test_rand() % 4)
+			{
+			case 0:
+				vdp_video_surface_destroy(surfaces[s]);
+				surfaces[s] = VDP_INVALID_HANDLE;
+				break;
+
+			case 1:
+				if (holds[h])
+					yuv_unref(holds[h]);
+				holds[h] = yuv_ref(vs->yuv);
+				break;
+
+			default:
+				// a new picture is decoded into the surface
+				if (yuv_prepare(vs) != VDP_STATUS_OK)
+				{
+					refused++;
+					// the previous holder keeps the old buffer
+					vdp_video_surface_destroy(surfaces[s]);
+					surfaces[s] = VDP_INVALID_HANDLE;
+				}
+				break;
+			}
+		}
+
+		if (test_rand() % 3 == 0 && holds[h])
+		{
+			yuv_unref(holds[h]);
+			holds[h] = NULL;
+		}
+
+		if (!check_pool(dev, surfaces, holds))
+			errors++;
+	}
+
+	CHECK_EQ(errors, 0);
+	CHECK(dev->yuv_pool.hits > dev->yuv_pool.misses);
+	CHECK(dev->yuv_pool.trimmed > 0);
+	CHECK(refused > 0);
+
+	for (i = 0; i < SOAK_HOLDS; i++)
+		if (holds[i])
+			yuv_unref(holds[i]);
+	for (i = 0; i < SOAK_SURFACES; i++)
+		if (surfaces[i] != VDP_INVALID_HANDLE)
+			vdp_video_surface_destroy(surfaces[i]);
+
+	CHECK_EQ(mock_mem_allocs - allocs - (mock_mem_frees - frees), dev->yuv_pool.count);
+	sfree(dev);
+	handle_destroy(device);
+
+	// nothing is left behind once the device is gone
+	CHECK_EQ(mock_mem_allocs - allocs, mock_mem_frees - frees);
+}
+
+static VdpDevice thread_device;
+
+static void *soak_thread(void *arg)
+{
+	VdpVideoSurface surface = VDP_INVALID_HANDLE;
+	unsigned int seed = (uintptr_t)arg;
+	int n;
+
+	for (n = 0; n < 20000; n++)
+	{
+		seed = seed * 1103515245 + 12345;
+
+		if (surface == VDP_INVALID_HANDLE)
+		{
+			const uint32_t *size = soak_sizes[(seed >> 16) % ARRAY_SIZE(soak_sizes)];
+			vdp_video_surface_create(thread_device, VDP_CHROMA_TYPE_420, size[0], size[1], &surface);
+		}
+		else if ((seed >> 16) % 3 == 0)
+		{
+			vdp_video_surface_destroy(surface);
+			surface = VDP_INVALID_HANDLE;
+		}
+		else
+		{
+			smart video_surface_ctx_t *vs = handle_get(surface);
+			yuv_data_t *held = yuv_ref(vs->yuv);
+			yuv_prepare(vs);
+			yuv_unref(held);
+		}
+	}
+
+	if (surface != VDP_INVALID_HANDLE)
+		vdp_video_surface_destroy(surface);
+
+	return NULL;
+}
+
+// decoders of several threads share the pool of a device
+static void test_yuv_pool_threads(void)
+{
+	pthread_t threads[4];
+	unsigned long allocs = mock_mem_allocs, frees = mock_mem_frees;
+	unsigned int i;
+
+	CHECK_EQ(mock_device_create(0, 0, &thread_device), VDP_STATUS_OK);
+
+	for (i = 0; i < ARRAY_SIZE(threads); i++)
+		pthread_create(&threads[i], NULL, soak_thread, (void *)(uintptr_t)(i + 1));
+	for (i = 0; i < ARRAY_SIZE(threads); i++)
+		pthread_join(threads[i], NULL);
+
+	handle_destroy(thread_device);
+
+	CHECK_EQ(mock_mem_allocs - allocs, mock_mem_frees - frees);
+}
+
+int main(void)
+{
+	test_scaled_output_size();
+	test_yuv_pool_soak();
+	test_yuv_pool_threads();
+
+	return test_result("surface_video");
+}
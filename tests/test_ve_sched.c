@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <string.h>
+#include "ve_sched.h"
+#include "test.h"
+
+/*
+ * Simulates clients that always have the next picture ready, on a
+ * virtual clock, by driving the steps of ve_sched_get() and
+ * ve_sched_put() directly.
+ */
+typedef struct
+{
+	ve_sched_client_t client;
+	uint64_t job_ns;
+	uint64_t ve_time;
+	uint64_t max_wait;
+	int grants;
+} sim_client_t;
+
+static void simulate(sim_client_t *clients, int count, int rounds)
+{
+	ve_sched_t sched;
+	uint64_t now = 0;
+	int i;
+
+	memset(&sched, 0, sizeof(sched));
+	for (i = 0; i < count; i++)
+		ve_sched_queue(&sched, &clients[i].client, now);
+
+	while (rounds--)
+	{
+		ve_sched_client_t *next = ve_sched_pick(&sched);
+		sim_client_t *c = (sim_client_t *)next;
+
+		CHECK(next != NULL);
+		if (!next)
+			return;
+
+		if (now - next->queued > c->max_wait)
+			c->max_wait = now - next->queued;
+
+		ve_sched_grant(&sched, next);
+		CHECK(sched.running == next);
+		now += c->job_ns;
+		c->ve_time += c->job_ns;
+		c->grants++;
+		ve_sched_charge(&sched, next, c->job_ns, now);
+		ve_sched_queue(&sched, next, now);
+	}
+}
+
+static void test_fair_share(void)
+{
+	sim_client_t c[3];
+
+	// VE time proportional to priority + 1
+	memset(c, 0, sizeof(c));
+	c[0].client.priority = 0;
+	c[0].job_ns = 3000000;
+	c[1].client.priority = 1;
+	c[1].job_ns = 5000000;
+	c[2].client.priority = 3;
+	c[2].job_ns = 2000000;
+	simulate(c, 3, 3000);
+
+	uint64_t unit = c[0].ve_time;
+	CHECK(c[1].ve_time > unit * 19 / 10 && c[1].ve_time < unit * 21 / 10);
+	CHECK(c[2].ve_time > unit * 39 / 10 && c[2].ve_time < unit * 41 / 10);
+}
+
+static void test_earliest_deadline_first(void)
+{
+	ve_sched_t sched;
+	ve_sched_client_t c[4], *w, *next;
+	uint64_t now = 0;
+	int i;
+
+	memset(&sched, 0, sizeof(sched));
+	memset(c, 0, sizeof(c));
+	for (i = 0; i < 4; i++)
+	{
+		c[i].deadline_us = 10000 * (i + 1);
+		ve_sched_queue(&sched, &c[i], now);
+	}
+
+	// without fair share clients, deadlines are strictly served in order
+	for (i = 0; i < 1000; i++)
+	{
+		next = ve_sched_pick(&sched);
+		for (w = sched.waiting; w; w = w->next)
+			CHECK(next->deadline <= w->deadline);
+
+		ve_sched_grant(&sched, next);
+		now += 1000000 + test_rand() % 4000000;
+		ve_sched_charge(&sched, next, 1000000, now);
+		ve_sched_queue(&sched, next, now);
+	}
+}
+
+static void test_deadline_burst(void)
+{
+	sim_client_t c[3];
+
+	// two deadline clients that could keep the VE busy forever
+	memset(c, 0, sizeof(c));
+	c[0].client.deadline_us = 20000;
+	c[0].job_ns = 2000000;
+	c[1].client.deadline_us = 30000;
+	c[1].job_ns = 2000000;
+	c[2].job_ns = 2000000;
+	simulate(c, 3, 1000);
+
+	CHECK(c[2].grants >= 1000 / (VE_SCHED_DEADLINE_BURST + 1));
+	CHECK(c[2].max_wait <= VE_SCHED_DEADLINE_BURST * 2000000ULL);
+	CHECK(c[0].grants + c[1].grants >= 1000 * VE_SCHED_DEADLINE_BURST / (VE_SCHED_DEADLINE_BURST + 1));
+}
+
+static void test_deadline_lag(void)
+{
+	sim_client_t c[3];
+
+	// long deadline pictures hit the lag limit before the burst limit
+	memset(c, 0, sizeof(c));
+	c[0].client.deadline_us = 200000;
+	c[0].job_ns = 60000000;
+	c[1].client.deadline_us = 300000;
+	c[1].job_ns = 60000000;
+	c[2].client.priority = 15;
+	c[2].job_ns = 1000000;
+	simulate(c, 3, 1000);
+
+	CHECK(c[2].grants > 0);
+	CHECK(c[2].max_wait < VE_SCHED_MAX_LAG_NS + 60000000ULL);
+}
+
+static void test_no_fair_waiting(void)
+{
+	ve_sched_t sched;
+	ve_sched_client_t d, f;
+	int i;
+
+	memset(&sched, 0, sizeof(sched));
+	memset(&d, 0, sizeof(d));
+	memset(&f, 0, sizeof(f));
+	d.deadline_us = 10000;
+
+	// deadline grants without a fair share client waiting don't count
+	for (i = 0; i < 2 * VE_SCHED_DEADLINE_BURST; i++)
+	{
+		ve_sched_queue(&sched, &d, i);
+		CHECK(ve_sched_pick(&sched) == &d);
+		ve_sched_grant(&sched, &d);
+		ve_sched_charge(&sched, &d, 1, i);
+	}
+	CHECK_EQ(sched.deadline_streak, 0);
+
+	ve_sched_queue(&sched, &f, i);
+	ve_sched_queue(&sched, &d, i);
+	CHECK(ve_sched_pick(&sched) == &d);
+}
+
+int main(void)
+{
+	test_fair_share();
+	test_earliest_deadline_first();
+	test_deadline_burst();
+	test_deadline_lag();
+	test_no_fair_waiting();
+
+	return test_result("ve_sched");
+}
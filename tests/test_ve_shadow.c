@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <string.h>
+#include "ve_shadow.h"
+#include "test.h"
+
+#define CLIENTS 2
+#define JOB_REGS 24
+#define USED_REGS 64
+
+/*
+ * Replays random register traces of several VE users against a mock
+ * register file, once through the shadow and once with plain writes.
+ * When a job is triggered, every register it set must hold the same
+ * value in both, no matter what happened to the VE in between.
+ */
+static uint32_t regs[VE_SHADOW_REGS], plain[VE_SHADOW_REGS];
+static ve_shadow_t shadow[CLIENTS];
+static uint32_t config[CLIENTS][USED_REGS];
+static int owner = -1;
+
+// another process using the VE, unnoticed by the in-process owner tracking
+static void clobber(void)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+	{
+		int reg = test_rand() % USED_REGS;
+		uint32_t val = test_rand() % 2 ? test_rand() : 0;
+
+		regs[reg] = val;
+		plain[reg] = val;
+	}
+}
+
+static int run_job(int client, int exclusive)
+{
+	int written[JOB_REGS];
+	uint32_t values[JOB_REGS];
+	int i, mismatches = 0;
+
+	ve_shadow_acquire(&shadow[client], regs, exclusive && owner == client);
+	owner = client;
+
+	// like a decoder, mostly the same values as for the last picture
+	for (i = 0; i < JOB_REGS; i++)
+	{
+		int reg = test_rand() % USED_REGS;
+		if (test_rand() % 8 == 0)
+			config[client][reg] = test_rand();
+
+		written[i] = reg * 4;
+		values[i] = config[client][reg];
+
+		shadow_writel(&shadow[client], values[i], written[i]);
+		writel(values[i], (uint8_t *)plain + written[i]);
+	}
+
+	// trigger
+	for (i = 0; i < JOB_REGS; i++)
+		if (regs[written[i] / 4] != plain[written[i] / 4])
+			mismatches++;
+
+	return mismatches;
+}
+
+static int replay(int exclusive, int clobbers)
+{
+	int round, mismatches = 0;
+
+	memset(regs, 0, sizeof(regs));
+	memset(plain, 0, sizeof(plain));
+	memset(shadow, 0, sizeof(shadow));
+	memset(config, 0, sizeof(config));
+	owner = -1;
+
+	for (round = 0; round < 10000; round++)
+	{
+		if (clobbers && test_rand() % 8 == 0)
+			clobber();
+
+		mismatches += run_job(test_rand() % CLIENTS, exclusive);
+	}
+
+	return mismatches;
+}
+
+static void test_traces(void)
+{
+	unsigned long writes = 0, elided = 0;
+	int i;
+
+	// by default nothing is assumed about the registers at acquisition
+	CHECK_EQ(replay(0, 1), 0);
+	CHECK_EQ(replay(0, 0), 0);
+
+	// exclusive use, only other in-process users in between
+	CHECK_EQ(replay(1, 0), 0);
+	for (i = 0; i < CLIENTS; i++)
+	{
+		writes += shadow[i].writes;
+		elided += shadow[i].elided;
+	}
+	CHECK(elided > writes / 4);
+
+	// the comparison catches stale shadows, if VDPAU_VE_EXCLUSIVE is set wrongly
+	CHECK(replay(1, 1) > 0);
+}
+
+static void test_generation(void)
+{
+	ve_shadow_t s;
+	unsigned int generation;
+
+	memset(&s, 0, sizeof(s));
+	ve_shadow_acquire(&s, regs, 1);
+	generation = s.generation;
+	shadow_writel(&s, 1, 0x10);
+
+	// SRAM caches compare the generation, it has to change with every drop
+	ve_shadow_acquire(&s, regs, 1);
+	CHECK_EQ(s.generation, generation);
+	ve_shadow_acquire(&s, regs, 0);
+	CHECK(s.generation != generation);
+
+	shadow_writel(&s, 1, 0x10);
+	CHECK_EQ(s.elided, 0);
+	shadow_writel(&s, 1, 0x10);
+	CHECK_EQ(s.elided, 1);
+}
+
+int main(void)
+{
+	test_traces();
+	test_generation();
+
+	return test_result("ve_shadow");
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <pthread.h>
+#include <time.h>
+#include "ve_wait.h"
+#include "test.h"
+
+/*
+ * A mock VE that sets a status bit and raises its interrupt a given
+ * time after a job was started, or never.
+ */
+static volatile uint32_t status;
+static volatile int irq_pending;
+static int irq_collected, blocking_waits;
+
+int cedrus_ve_wait(cedrus_t *dev, int timeout)
+{
+	if (!__sync_bool_compare_and_swap(&irq_pending, 1, 0))
+	{
+		// the real one would block for timeout seconds
+		blocking_waits++;
+		return 0;
+	}
+
+	irq_collected++;
+	return 1;
+}
+
+static uint64_t get_time(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (uint64_t)tp.tv_sec * 1000000000ULL + (uint64_t)tp.tv_nsec;
+}
+
+static void *ve_thread(void *arg)
+{
+	uint64_t duration = *(uint64_t *)arg;
+	struct timespec tp = { .tv_sec = duration / 1000000000ULL, .tv_nsec = duration % 1000000000ULL };
+
+	nanosleep(&tp, NULL);
+	irq_pending = 1;
+	status |= 0x1;
+
+	return NULL;
+}
+
+// runs a job taking duration ns, 0 for one that hangs, returns the time waited
+static uint64_t run_job(ve_wait_t *wait, uint64_t duration, uint32_t mbs, int *done)
+{
+	pthread_t thread;
+	uint64_t start;
+
+	status = 0;
+	irq_pending = 0;
+	irq_collected = 0;
+	blocking_waits = 0;
+
+	start = get_time();
+	if (duration)
+		pthread_create(&thread, NULL, ve_thread, &duration);
+
+	*done = ve_wait(wait, NULL, (void *)&status, 0x7, mbs);
+	uint64_t waited = get_time() - start;
+
+	if (duration)
+		pthread_join(thread, NULL);
+
+	return waited;
+}
+
+static void test_short_job(void)
+{
+	ve_wait_t wait;
+	int done;
+
+	ve_wait_init(&wait);
+	run_job(&wait, 20000, 10, &done);
+
+	CHECK(done);
+	CHECK_EQ(irq_collected, 1);
+	CHECK_EQ(blocking_waits, 0);
+	CHECK_EQ(wait.timeouts, 0);
+}
+
+static void test_long_job(void)
+{
+	ve_wait_t wait;
+	int done, i;
+
+	ve_wait_init(&wait);
+	// 5 ms for 1000 macroblocks, more than the first guess
+	for (i = 0; i < 20; i++)
+	{
+		uint64_t waited = run_job(&wait, 5000000, 1000, &done);
+
+		CHECK(done);
+		CHECK(waited >= 5000000);
+		CHECK(waited < 100000000);
+		CHECK_EQ(irq_collected, 1);
+		CHECK_EQ(blocking_waits, 0);
+	}
+
+	CHECK_EQ(wait.timeouts, 0);
+	// the estimate converged to the real rate, plus the polling delay
+	CHECK(wait.ns_per_mb >= 4500 && wait.ns_per_mb < 10000);
+}
+
+static void test_hanging_job(void)
+{
+	ve_wait_t wait;
+	int done;
+
+	ve_wait_init(&wait);
+	wait.ns_per_mb = 10000;
+
+	// expected 10 ms, so the timeout is 80 ms instead of a whole second
+	uint64_t waited = run_job(&wait, 0, 1000, &done);
+
+	CHECK(!done);
+	CHECK(waited >= 80000000);
+	CHECK(waited < 500000000);
+	CHECK_EQ(wait.timeouts, 1);
+	CHECK_EQ(irq_collected, 0);
+	CHECK_EQ(blocking_waits, 0);
+	// the next job gets more time
+	CHECK(wait.ns_per_mb > 10000);
+
+	// tiny jobs still get a reasonable timeout
+	ve_wait_init(&wait);
+	waited = run_job(&wait, 0, 1, &done);
+
+	CHECK(!done);
+	CHECK(waited >= 20000000);
+	CHECK(waited < 500000000);
+}
+
+int main(void)
+{
+	test_short_job();
+	test_long_job();
+	test_hanging_job();
+
+	return test_result("ve_wait");
+}
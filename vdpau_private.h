@@ -20,7 +20,6 @@
 #ifndef __VDPAU_PRIVATE_H__
 #define __VDPAU_PRIVATE_H__
 
-#define DEBUG
 #define MAX_HANDLES 64
 #define VBV_SIZE (1 * 1024 * 1024)
 #define MAX_SURFACE_BUFFER (3)
@@ -36,12 +35,36 @@
 #include "sunxi_disp.h"
 #include "pixman.h"
 #include "queue.h"
+#include "debug.h"
+#include "memory.h"
+#include "ve_sched.h"
+#include "ve_shadow.h"
+#include "ve_wait.h"
 #ifdef USE_INTEROP
 #include "nv_interop.h"
 #endif
 
 #define INTERNAL_YCBCR_FORMAT (VdpYCbCrFormat)0xffff
 
+// scale-down (1/2^n) field of VE_*_SDROT_CTRL, horizontal and vertical
+#define SDROT_CTRL_SCALE(n)	((((n) & 0x3) << 10) | (((n) & 0x3) << 8))
+// rotation field of VE_*_SDROT_CTRL, in clockwise quarter turns
+#define SDROT_CTRL_ROTATE(r)	((r) & 0x3)
+
+#define YUV_POOL_MAX 48
+
+typedef struct
+{
+	mem_shrinker_t shrinker;
+	mem_account_t *mem;
+	pthread_mutex_t mutex;
+	cedrus_mem_t *data[YUV_POOL_MAX];
+	int size[YUV_POOL_MAX];
+	int count;
+	int cap;
+	unsigned long hits, misses, trimmed;
+} yuv_pool_t;
+
 typedef struct
 {
 	cedrus_t *cedrus;
@@ -53,12 +76,22 @@ typedef struct
 	int g2d_fd;
 	int osd_enabled;
 	int g2d_enabled;
+	int prewarm_enabled;
+	int ve_exclusive;
+	uint32_t rotation;
+	uint32_t surface_generation;
 	struct sunxi_disp *disp;
+	void *ve_owner;
+	ve_sched_t ve_sched;
+	yuv_pool_t yuv_pool;
+	mem_account_t mem;
 } device_ctx_t;
 
 typedef struct
 {
 	int ref_count;
+	int size;
+	device_ctx_t *device;
 	cedrus_mem_t *data;
 } yuv_data_t;
 
@@ -69,10 +102,15 @@ typedef struct video_surface_ctx_struct
 	VdpChromaType chroma_type;
 	VdpYCbCrFormat source_format;
 	yuv_data_t *yuv;
+	uint32_t yuv_generation;
 	int luma_size, chroma_size;
 	int first_frame_flag;
 	int video_deinterlace, video_field;
 	cedrus_mem_t *rec;
+	int rec_separate;
+	struct video_surface_ctx_struct *scaled;
+	uint32_t scale;
+	uint32_t rotation;
 	void *decoder_private;
 	void (*decoder_private_free)(struct video_surface_ctx_struct *surface);
 #ifdef USE_INTEROP
@@ -90,6 +128,27 @@ typedef struct decoder_ctx_struct
 	VdpStatus (*decode)(struct decoder_ctx_struct *decoder, VdpPictureInfo const *info, const int len, video_surface_ctx_t *output);
 	void *private;
 	void (*private_free)(struct decoder_ctx_struct *decoder);
+	ve_shadow_t shadow;
+	int prewarm_frames;
+	ve_sched_client_t sched;
+	uint64_t ve_start;
+	uint64_t ve_time;
+	enum cedrus_engine ve_engine;
+	uint32_t ve_flags;
+	ve_wait_t ve_wait;
+	uint32_t skip_policy;
+	uint64_t frame_period;
+	uint64_t ve_load;
+	int shedding;
+	uint32_t pictures_skipped;
+	uint32_t pictures_decoded;
+	uint32_t rotation;
+	uint32_t nal_length_size;
+	uint32_t deblocking_mode;
+	uint64_t deblocking_frame_period;
+	uint32_t deblocking_level;
+	uint32_t deblocking_in_effect;
+	int deblocking_trend;
 } decoder_ctx_t;
 
 typedef struct
@@ -216,17 +275,12 @@ typedef struct task
 #define ceil_log2(n) ((n) <= 1 ? 0 : 32 - __builtin_clz((n) - 1))
 
 #define ALIGN(x, a) (((x) + ((typeof(x))(a) - 1)) & ~((typeof(x))(a) - 1))
-#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
 
+// size of the picture in yuv->data, swapped if the VE rotated it by 90 or 270 degrees
+#define display_width(vs) ((vs)->rotation & 1 ? (vs)->height : (vs)->width)
+#define display_height(vs) ((vs)->rotation & 1 ? (vs)->width : (vs)->height)
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
 
-#ifdef DEBUG
-#include <stdio.h>
-#define VDPAU_DBG(format, ...) fprintf(stderr, "[VDPAU SUNXI] " format "\n", ##__VA_ARGS__)
-#define VDPAU_DBG_ONCE(format, ...) do { static uint8_t __once; if (!__once) { fprintf(stderr, "[VDPAU SUNXI] " format "\n", ##__VA_ARGS__); __once = 1; } } while(0)
-#else
-#define VDPAU_DBG(format, ...)
-#define VDPAU_DBG_ONCE(format, ...)
-#endif
 
 #define EXPORT __attribute__ ((visibility ("default")))
 
@@ -235,10 +289,25 @@ VdpStatus new_decoder_h264(decoder_ctx_t *decoder);
 VdpStatus new_decoder_mpeg4(decoder_ctx_t *decoder);
 VdpStatus new_decoder_h265(decoder_ctx_t *decoder);
 
+void *decoder_ve_get(decoder_ctx_t *decoder, enum cedrus_engine engine, uint32_t flags);
+void decoder_ve_put(decoder_ctx_t *decoder);
+VdpStatus decoder_ve_wait(decoder_ctx_t *decoder, void *status_reg, uint32_t status_mask, uint32_t mbs);
+int decoder_skip_picture(decoder_ctx_t *decoder, int is_reference);
+int decoder_bypass_deblocking(decoder_ctx_t *decoder, int is_reference);
+
 void yuv_unref(yuv_data_t *yuv);
 yuv_data_t *yuv_ref(yuv_data_t *yuv);
+VdpStatus video_surface_size(uint32_t width, uint32_t height, VdpChromaType chroma_type, uint32_t rotation, int *luma_size, int *chroma_size);
 VdpStatus yuv_prepare(video_surface_ctx_t *video_surface);
 VdpStatus rec_prepare(video_surface_ctx_t *video_surface);
+VdpStatus sdrot_prepare(decoder_ctx_t *decoder, video_surface_ctx_t *video_surface, video_surface_ctx_t **target, uint32_t *ctrl);
+void yuv_pool_init(device_ctx_t *device);
+int yuv_pool_prewarm(device_ctx_t *device, int size, int count);
+void yuv_pool_release(device_ctx_t *device);
+
+cedrus_mem_t *device_mem_alloc(device_ctx_t *device, size_t size, enum mem_category category, const void *owner);
+void device_mem_free(device_ctx_t *device, cedrus_mem_t *mem);
+void device_mem_retag(device_ctx_t *device, cedrus_mem_t *mem, enum mem_category category, const void *owner);
 
 typedef uint32_t VdpHandle;
 
@@ -267,6 +336,7 @@ VdpPresentationQueueBlockUntilSurfaceIdle vdp_presentation_queue_block_until_sur
 VdpPresentationQueueQuerySurfaceStatus vdp_presentation_queue_query_surface_status;
 
 VdpVideoSurfaceCreate vdp_video_surface_create;
+VdpVideoSurfaceDestroy vdp_video_surface_destroy;
 VdpVideoSurfaceGetParameters vdp_video_surface_get_parameters;
 VdpVideoSurfaceGetBitsYCbCr vdp_video_surface_get_bits_y_cb_cr;
 VdpVideoSurfacePutBitsYCbCr vdp_video_surface_put_bits_y_cb_cr;
@@ -304,6 +374,15 @@ VdpGenerateCSCMatrix vdp_generate_csc_matrix;
 VdpDecoderCreate vdp_decoder_create;
 VdpDecoderGetParameters vdp_decoder_get_parameters;
 VdpDecoderRender vdp_decoder_render;
+VdpStatus vdp_video_surface_set_scaled_output_sunxi(VdpVideoSurface surface, VdpVideoSurface scaled_surface, uint32_t scale);
+VdpStatus vdp_decoder_set_rotation_sunxi(VdpDecoder decoder, uint32_t degrees);
+VdpStatus vdp_decoder_set_nal_length_size_sunxi(VdpDecoder decoder, uint32_t nal_length_size);
+VdpStatus vdp_device_get_memory_usage_sunxi(VdpDevice device, uint32_t category, uint64_t *current, uint64_t *peak);
+VdpStatus vdp_decoder_set_scheduling_sunxi(VdpDecoder decoder, uint32_t priority, uint32_t deadline_us);
+VdpStatus vdp_decoder_set_skip_policy_sunxi(VdpDecoder decoder, uint32_t policy, uint32_t frame_period_us);
+VdpStatus vdp_decoder_get_skip_count_sunxi(VdpDecoder decoder, uint32_t *skipped, uint32_t *decoded);
+VdpStatus vdp_decoder_set_deblocking_mode_sunxi(VdpDecoder decoder, uint32_t mode, uint32_t frame_period_us);
+VdpStatus vdp_decoder_get_deblocking_mode_sunxi(VdpDecoder decoder, uint32_t *mode);
 VdpDecoderQueryCapabilities vdp_decoder_query_capabilities;
 
 VdpBitmapSurfaceCreate vdp_bitmap_surface_create;
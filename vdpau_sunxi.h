@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __VDPAU_SUNXI_H__
+#define __VDPAU_SUNXI_H__
+
+#include <stdint.h>
+#include <vdpau/vdpau.h>
+
+/*
+ * Private libvdpau-sunxi extensions, available through
+ * VdpGetProcAddress with the function ids below.
+ */
+
+#define VDP_FUNC_ID_DECODER_SET_SCHEDULING_SUNXI	(VdpFuncId)(VDP_FUNC_ID_BASE_DRIVER + 0)
+#define VDP_FUNC_ID_DECODER_SET_SKIP_POLICY_SUNXI	(VdpFuncId)(VDP_FUNC_ID_BASE_DRIVER + 1)
+#define VDP_FUNC_ID_DECODER_GET_SKIP_COUNT_SUNXI	(VdpFuncId)(VDP_FUNC_ID_BASE_DRIVER + 2)
+#define VDP_FUNC_ID_DECODER_SET_DEBLOCKING_MODE_SUNXI	(VdpFuncId)(VDP_FUNC_ID_BASE_DRIVER + 3)
+#define VDP_FUNC_ID_DECODER_GET_DEBLOCKING_MODE_SUNXI	(VdpFuncId)(VDP_FUNC_ID_BASE_DRIVER + 4)
+#define VDP_FUNC_ID_VIDEO_SURFACE_SET_SCALED_OUTPUT_SUNXI	(VdpFuncId)(VDP_FUNC_ID_BASE_DRIVER + 5)
+#define VDP_FUNC_ID_DECODER_SET_ROTATION_SUNXI	(VdpFuncId)(VDP_FUNC_ID_BASE_DRIVER + 6)
+#define VDP_FUNC_ID_DECODER_SET_NAL_LENGTH_SIZE_SUNXI	(VdpFuncId)(VDP_FUNC_ID_BASE_DRIVER + 7)
+#define VDP_FUNC_ID_DEVICE_GET_MEMORY_USAGE_SUNXI	(VdpFuncId)(VDP_FUNC_ID_BASE_DRIVER + 8)
+
+/*
+ * Set how the video engine is shared between decoders of one device.
+ * priority ranges from 0 to 15, a decoder gets VE time proportional to
+ * priority + 1. If deadline_us is not 0, every picture is expected to
+ * be decoded within deadline_us microseconds after it was submitted,
+ * such pictures are served before all others, earliest deadline first.
+ * Decoders without deadline still get the VE after 4 such pictures in
+ * a row, or once they waited 100 ms.
+ */
+typedef VdpStatus VdpDecoderSetSchedulingSunxi(VdpDecoder decoder,
+                                               uint32_t priority,
+                                               uint32_t deadline_us);
+
+typedef uint32_t VdpDecoderSkipPolicySunxi;
+
+// decode every picture (default)
+#define VDP_DECODER_SKIP_POLICY_NONE_SUNXI		(VdpDecoderSkipPolicySunxi)0
+// never decode non-reference pictures
+#define VDP_DECODER_SKIP_POLICY_NON_REFERENCE_SUNXI	(VdpDecoderSkipPolicySunxi)1
+// skip non-reference pictures while the VE can't keep up with frame_period_us
+#define VDP_DECODER_SKIP_POLICY_AUTO_SUNXI		(VdpDecoderSkipPolicySunxi)2
+
+/*
+ * Let VdpDecoderRender skip non-reference pictures. A skipped picture
+ * returns VDP_STATUS_OK and leaves the target surface with its previous
+ * contents. frame_period_us is only used by the AUTO policy.
+ */
+typedef VdpStatus VdpDecoderSetSkipPolicySunxi(VdpDecoder decoder,
+                                               VdpDecoderSkipPolicySunxi policy,
+                                               uint32_t frame_period_us);
+
+typedef VdpStatus VdpDecoderGetSkipCountSunxi(VdpDecoder decoder,
+                                              uint32_t *skipped,
+                                              uint32_t *decoded);
+
+typedef uint32_t VdpDecoderDeblockingModeSunxi;
+
+// deblock as signalled in the bitstream (default)
+#define VDP_DECODER_DEBLOCKING_MODE_FULL_SUNXI		(VdpDecoderDeblockingModeSunxi)0
+// don't deblock non-reference pictures
+#define VDP_DECODER_DEBLOCKING_MODE_NON_REFERENCE_SUNXI	(VdpDecoderDeblockingModeSunxi)1
+// don't deblock any picture
+#define VDP_DECODER_DEBLOCKING_MODE_NONE_SUNXI		(VdpDecoderDeblockingModeSunxi)2
+// step through the modes above while the VE can't keep up with frame_period_us
+#define VDP_DECODER_DEBLOCKING_MODE_AUTO_SUNXI		(VdpDecoderDeblockingModeSunxi)3
+
+/*
+ * Allow H.264 and HEVC decoders to bypass the deblocking filter to save
+ * VE time. Bypassing it on reference pictures causes visible drift
+ * until the next IDR picture. frame_period_us is only used by the AUTO
+ * mode.
+ */
+typedef VdpStatus VdpDecoderSetDeblockingModeSunxi(VdpDecoder decoder,
+                                                   VdpDecoderDeblockingModeSunxi mode,
+                                                   uint32_t frame_period_us);
+
+// returns the mode that was in effect for the last decoded picture
+typedef VdpStatus VdpDecoderGetDeblockingModeSunxi(VdpDecoder decoder,
+                                                   VdpDecoderDeblockingModeSunxi *mode);
+
+/*
+ * Let the VE write a 1/2 (scale 1), 1/4 (scale 2) or 1/8 (scale 3)
+ * downscaled copy of every picture decoded into surface to
+ * scaled_surface, which must be a 4:2:0 surface of exactly that size,
+ * rounded up. scale 0 detaches the scaled surface again. Supported by
+ * the MPEG-1/2, MPEG-4 and H.264 decoders.
+ *
+ * While a scaled surface is attached, surface itself only keeps the
+ * reference picture on VE versions 0x1680 and newer, its displayable
+ * copy is not updated.
+ */
+typedef VdpStatus VdpVideoSurfaceSetScaledOutputSunxi(VdpVideoSurface surface,
+                                                      VdpVideoSurface scaled_surface,
+                                                      uint32_t scale);
+
+/*
+ * Let the VE rotate every picture the decoder outputs clockwise by
+ * 0, 90, 180 or 270 degrees. Surfaces decoded with 90 or 270 degree
+ * rotation are presented with swapped width and height. Supported by
+ * the MPEG-1/2, MPEG-4 and H.264 decoders.
+ */
+typedef VdpStatus VdpDecoderSetRotationSunxi(VdpDecoder decoder,
+                                             uint32_t degrees);
+
+/*
+ * Declare the bitstream buffers passed to VdpDecoderRender as length
+ * prefixed NAL units, as stored in MP4 (avcC/hvcC) and Matroska, with
+ * a big endian length of nal_length_size (1, 2 or 4) bytes in front of
+ * every NAL unit. 0 selects Annex B start codes again (default). Only
+ * used by the H.264 and HEVC decoders.
+ */
+typedef VdpStatus VdpDecoderSetNalLengthSizeSunxi(VdpDecoder decoder,
+                                                  uint32_t nal_length_size);
+
+typedef uint32_t VdpMemoryCategorySunxi;
+
+#define VDP_MEMORY_CATEGORY_BITSTREAM_SUNXI		(VdpMemoryCategorySunxi)0
+#define VDP_MEMORY_CATEGORY_VIDEO_SUNXI			(VdpMemoryCategorySunxi)1
+#define VDP_MEMORY_CATEGORY_RECONSTRUCTION_SUNXI	(VdpMemoryCategorySunxi)2
+#define VDP_MEMORY_CATEGORY_MOTION_VECTORS_SUNXI	(VdpMemoryCategorySunxi)3
+#define VDP_MEMORY_CATEGORY_CODEC_SUNXI			(VdpMemoryCategorySunxi)4
+#define VDP_MEMORY_CATEGORY_RGBA_SUNXI			(VdpMemoryCategorySunxi)5
+#define VDP_MEMORY_CATEGORY_INTEROP_SUNXI		(VdpMemoryCategorySunxi)6
+// buffers kept in the driver's caches for reuse
+#define VDP_MEMORY_CATEGORY_CACHED_SUNXI		(VdpMemoryCategorySunxi)7
+// sum of all categories above
+#define VDP_MEMORY_CATEGORY_TOTAL_SUNXI			(VdpMemoryCategorySunxi)0xffffffff
+
+/*
+ * Return how many bytes of CMA memory the device currently uses for
+ * the given category, and the most it used since it was created.
+ */
+typedef VdpStatus VdpDeviceGetMemoryUsageSunxi(VdpDevice device,
+                                               VdpMemoryCategorySunxi category,
+                                               uint64_t *current,
+                                               uint64_t *peak);
+
+#endif
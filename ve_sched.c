@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <time.h>
+#include "ve_sched.h"
+
+static uint64_t get_time(void)
+{
+	struct timespec tp;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tp) == -1)
+		return 0;
+
+	return (uint64_t)tp.tv_sec * 1000000000ULL + (uint64_t)tp.tv_nsec;
+}
+
+void ve_sched_init(ve_sched_t *sched)
+{
+	pthread_mutex_init(&sched->mutex, NULL);
+	pthread_cond_init(&sched->cond, NULL);
+	sched->running = NULL;
+	sched->waiting = NULL;
+	sched->min_vruntime = 0;
+	sched->clock = get_time();
+	sched->deadline_streak = 0;
+}
+
+void ve_sched_release(ve_sched_t *sched)
+{
+	pthread_cond_destroy(&sched->cond);
+	pthread_mutex_destroy(&sched->mutex);
+}
+
+void ve_sched_set(ve_sched_t *sched, ve_sched_client_t *client, uint32_t priority, uint32_t deadline_us)
+{
+	pthread_mutex_lock(&sched->mutex);
+	client->priority = priority;
+	client->deadline_us = deadline_us;
+	pthread_mutex_unlock(&sched->mutex);
+}
+
+void ve_sched_queue(ve_sched_t *sched, ve_sched_client_t *client, uint64_t now)
+{
+	client->deadline = client->deadline_us ? now + client->deadline_us * 1000ULL : 0;
+	client->queued = now;
+	// don't let a client that was idle for a while monopolize the VE
+	if (client->vruntime < sched->min_vruntime)
+		client->vruntime = sched->min_vruntime;
+
+	client->next = sched->waiting;
+	sched->waiting = client;
+}
+
+/*
+ * Pick the waiting client that gets the VE next. Pictures with a
+ * deadline hint go first, earliest deadline first, all others share
+ * the VE by the time they used weighted with their priority. So that
+ * deadline clients can't starve the others, the fair share client with
+ * the least VE time goes first after VE_SCHED_DEADLINE_BURST deadline
+ * pictures, or once a fair share client waited VE_SCHED_MAX_LAG_NS.
+ */
+ve_sched_client_t *ve_sched_pick(ve_sched_t *sched)
+{
+	ve_sched_client_t *c, *edf = NULL, *fair = NULL;
+	uint64_t oldest = UINT64_MAX;
+
+	for (c = sched->waiting; c; c = c->next)
+	{
+		if (c->deadline)
+		{
+			if (!edf || c->deadline < edf->deadline)
+				edf = c;
+		}
+		else
+		{
+			if (!fair || c->vruntime <= fair->vruntime)
+				fair = c;
+			if (c->queued < oldest)
+				oldest = c->queued;
+		}
+	}
+
+	if (!edf)
+		return fair;
+
+	if (fair && (sched->deadline_streak >= VE_SCHED_DEADLINE_BURST ||
+	             (sched->clock > oldest && sched->clock - oldest >= VE_SCHED_MAX_LAG_NS)))
+		return fair;
+
+	return edf;
+}
+
+void ve_sched_grant(ve_sched_t *sched, ve_sched_client_t *client)
+{
+	ve_sched_client_t **c;
+	int fair_waiting = 0;
+
+	for (c = &sched->waiting; *c != client; c = &(*c)->next)
+		;
+	*c = client->next;
+
+	for (c = &sched->waiting; *c; c = &(*c)->next)
+		if (!(*c)->deadline)
+			fair_waiting = 1;
+
+	if (client->deadline && fair_waiting)
+		sched->deadline_streak++;
+	else
+		sched->deadline_streak = 0;
+
+	sched->running = client;
+	sched->min_vruntime = client->vruntime;
+}
+
+void ve_sched_charge(ve_sched_t *sched, ve_sched_client_t *client, uint64_t ve_time, uint64_t now)
+{
+	client->vruntime += ve_time / (client->priority + 1);
+	sched->running = NULL;
+	sched->clock = now;
+}
+
+void ve_sched_get(ve_sched_t *sched, ve_sched_client_t *client)
+{
+	pthread_mutex_lock(&sched->mutex);
+
+	ve_sched_queue(sched, client, get_time());
+
+	while (sched->running || ve_sched_pick(sched) != client)
+		pthread_cond_wait(&sched->cond, &sched->mutex);
+
+	ve_sched_grant(sched, client);
+
+	pthread_mutex_unlock(&sched->mutex);
+}
+
+void ve_sched_put(ve_sched_t *sched, ve_sched_client_t *client, uint64_t ve_time)
+{
+	pthread_mutex_lock(&sched->mutex);
+	ve_sched_charge(sched, client, ve_time, get_time());
+	pthread_cond_broadcast(&sched->cond);
+	pthread_mutex_unlock(&sched->mutex);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __VE_SCHED_H__
+#define __VE_SCHED_H__
+
+#include <pthread.h>
+#include <stdint.h>
+
+// deadline pictures served in a row before a waiting fair share client gets a turn
+#define VE_SCHED_DEADLINE_BURST 4
+// longest a fair share client waits while deadline pictures are served
+#define VE_SCHED_MAX_LAG_NS 100000000ULL
+
+typedef struct ve_sched_client
+{
+	uint32_t priority;
+	uint32_t deadline_us;
+	uint64_t vruntime;
+	uint64_t deadline;
+	uint64_t queued;
+	struct ve_sched_client *next;
+} ve_sched_client_t;
+
+/*
+ * Shares the VE between the decoders of one device. clock is the time
+ * the VE was last released, so all waiting clients agree on the pick.
+ */
+typedef struct
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	ve_sched_client_t *running;
+	ve_sched_client_t *waiting;
+	uint64_t min_vruntime;
+	uint64_t clock;
+	unsigned int deadline_streak;
+} ve_sched_t;
+
+void ve_sched_init(ve_sched_t *sched);
+void ve_sched_release(ve_sched_t *sched);
+void ve_sched_set(ve_sched_t *sched, ve_sched_client_t *client, uint32_t priority, uint32_t deadline_us);
+// blocks until client may use the VE
+void ve_sched_get(ve_sched_t *sched, ve_sched_client_t *client);
+// client used the VE for ve_time ns
+void ve_sched_put(ve_sched_t *sched, ve_sched_client_t *client, uint64_t ve_time);
+
+// the steps of ve_sched_get() and ve_sched_put(), sched->mutex must be held
+void ve_sched_queue(ve_sched_t *sched, ve_sched_client_t *client, uint64_t now);
+ve_sched_client_t *ve_sched_pick(ve_sched_t *sched);
+void ve_sched_grant(ve_sched_t *sched, ve_sched_client_t *client);
+void ve_sched_charge(ve_sched_t *sched, ve_sched_client_t *client, uint64_t ve_time, uint64_t now);
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __VE_SHADOW_H__
+#define __VE_SHADOW_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <cedrus/cedrus.h>
+
+#define VE_SHADOW_REGS (0x800 / 4)
+
+/*
+ * Remembers what was last written to the VE config registers, so that
+ * unchanged values don't have to be written again. Only use it for
+ * plain config registers, never for triggers, status or SRAM ports.
+ *
+ * Without VDPAU_VE_EXCLUSIVE every acquisition invalidates the shadow,
+ * so nothing is carried over between pictures, neither registers nor
+ * the SRAM contents cached by generation. Use of the VE by another
+ * process can't be detected, exclusive mode relies on there being none.
+ */
+typedef struct
+{
+	void *regs;
+	uint32_t value[VE_SHADOW_REGS];
+	uint32_t valid[VE_SHADOW_REGS / 32];
+	unsigned long writes;
+	unsigned long elided;
+	unsigned int generation;
+} ve_shadow_t;
+
+/*
+ * Codecs caching SRAM contents compare the generation they uploaded
+ * with against the current one, it changes on every invalidation.
+ */
+static inline void ve_shadow_invalidate(ve_shadow_t *shadow)
+{
+	memset(shadow->valid, 0, sizeof(shadow->valid));
+	shadow->generation++;
+}
+
+/*
+ * Has to be called after every acquisition of the VE. The registers
+ * only still hold the shadowed values if the caller knows that nobody
+ * else used the VE since it released it, else the shadow is dropped.
+ */
+static inline void ve_shadow_acquire(ve_shadow_t *shadow, void *regs, int exclusive)
+{
+	if (!exclusive)
+		ve_shadow_invalidate(shadow);
+
+	shadow->regs = regs;
+}
+
+static inline void shadow_writel(ve_shadow_t *shadow, uint32_t val, uint32_t reg)
+{
+	unsigned int i = reg / 4;
+
+	shadow->writes++;
+
+	if (i < VE_SHADOW_REGS)
+	{
+		if ((shadow->valid[i / 32] & (1u << (i % 32))) && shadow->value[i] == val)
+		{
+			shadow->elided++;
+			return;
+		}
+
+		shadow->value[i] = val;
+		shadow->valid[i / 32] |= (1u << (i % 32));
+	}
+
+	writel(val, shadow->regs + reg);
+}
+
+#endif
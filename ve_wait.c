@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <time.h>
+#include "ve_wait.h"
+
+// jobs expected to take less are polled busily at first
+#define VE_SPIN_NS 100000
+// shortest sleep between two polls of the status register
+#define VE_POLL_NS 20000
+#define VE_TIMEOUT_FACTOR 8
+#define VE_MIN_TIMEOUT_NS 20000000ULL
+// first guess of the decode rate, refined after every job
+#define VE_DEFAULT_NS_PER_MB 2000
+#define VE_MAX_NS_PER_MB 1000000
+
+static uint64_t get_time(void)
+{
+	struct timespec tp;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tp) == -1)
+		return 0;
+
+	return (uint64_t)tp.tv_sec * 1000000000ULL + (uint64_t)tp.tv_nsec;
+}
+
+static void sleep_until(uint64_t t)
+{
+	struct timespec tp = { .tv_sec = t / 1000000000ULL, .tv_nsec = t % 1000000000ULL };
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tp, NULL) != 0)
+		;
+}
+
+void ve_wait_init(ve_wait_t *wait)
+{
+	wait->ns_per_mb = VE_DEFAULT_NS_PER_MB;
+	wait->timeouts = 0;
+}
+
+/*
+ * The kernel only takes whole seconds as timeout for the interrupt, far
+ * longer than a job takes. So the status register is polled instead:
+ * short jobs busily, long ones after sleeping through most of their
+ * expected time and then in steps of a sixteenth of it. The timeout is
+ * VE_TIMEOUT_FACTOR times the expected time.
+ */
+int ve_wait(ve_wait_t *wait, cedrus_t *cedrus, void *status_reg, uint32_t status_mask, uint32_t mbs)
+{
+	uint64_t start = get_time(), now;
+	uint64_t expected = (uint64_t)mbs * wait->ns_per_mb;
+	uint64_t deadline = start + (expected * VE_TIMEOUT_FACTOR > VE_MIN_TIMEOUT_NS ? expected * VE_TIMEOUT_FACTOR : VE_MIN_TIMEOUT_NS);
+	uint64_t wakeup = start + expected * 3 / 4;
+	uint64_t step = expected / 16 > VE_POLL_NS ? expected / 16 : VE_POLL_NS;
+
+	while (!(readl(status_reg) & status_mask))
+	{
+		now = get_time();
+		if (now >= deadline)
+		{
+			// the guess may have been far too low, don't time out on every job
+			if (wait->ns_per_mb < VE_DEFAULT_NS_PER_MB)
+				wait->ns_per_mb = VE_DEFAULT_NS_PER_MB;
+			else if (wait->ns_per_mb < VE_MAX_NS_PER_MB)
+				wait->ns_per_mb *= 2;
+			wait->timeouts++;
+			return 0;
+		}
+
+		if (expected < VE_SPIN_NS && now - start < VE_SPIN_NS)
+			continue;
+
+		if (now + step > wakeup)
+			wakeup = now + step;
+		sleep_until(wakeup < deadline ? wakeup : deadline);
+	}
+
+	// collect the interrupt, else the next wait of another VE user returns early
+	cedrus_ve_wait(cedrus, 1);
+
+	if (mbs)
+		wait->ns_per_mb = (wait->ns_per_mb * 7 + (get_time() - start) / mbs) / 8;
+
+	return 1;
+}
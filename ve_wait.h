@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2016 libvdpau-sunxi contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __VE_WAIT_H__
+#define __VE_WAIT_H__
+
+#include <stdint.h>
+#include <cedrus/cedrus.h>
+
+/*
+ * Tracks how fast the VE decodes, to derive the timeout of the next
+ * job from its size.
+ */
+typedef struct
+{
+	uint32_t ns_per_mb;
+	uint32_t timeouts;
+} ve_wait_t;
+
+void ve_wait_init(ve_wait_t *wait);
+
+/*
+ * Waits until one of the status_mask bits in status_reg got set after
+ * a job of mbs macroblocks was started. Returns 0 if that didn't happen
+ * within the timeout.
+ */
+int ve_wait(ve_wait_t *wait, cedrus_t *cedrus, void *status_reg, uint32_t status_mask, uint32_t mbs);
+
+#endif
@@ -155,6 +155,38 @@ VdpStatus vdp_video_mixer_create(VdpDevice device,
 	return handle_create(mixer, mix);
 }
 
+/*
+ * Map a rectangle given in the coordinates of the decoded picture into
+ * the display copy, which SDROT rotated clockwise by vs->rotation.
+ */
+static void rotate_rect(VdpRect *dst, const VdpRect *src, const video_surface_ctx_t *vs)
+{
+	switch (vs->rotation & 3)
+	{
+	case 1:
+		dst->x0 = vs->height - src->y1;
+		dst->x1 = vs->height - src->y0;
+		dst->y0 = src->x0;
+		dst->y1 = src->x1;
+		break;
+	case 2:
+		dst->x0 = vs->width - src->x1;
+		dst->x1 = vs->width - src->x0;
+		dst->y0 = vs->height - src->y1;
+		dst->y1 = vs->height - src->y0;
+		break;
+	case 3:
+		dst->x0 = src->y0;
+		dst->x1 = src->y1;
+		dst->y0 = vs->width - src->x1;
+		dst->y1 = vs->width - src->x0;
+		break;
+	default:
+		*dst = *src;
+		break;
+	}
+}
+
 VdpStatus vdp_video_mixer_render(VdpVideoMixer mixer,
                                  VdpOutputSurface background_surface,
                                  VdpRect const *background_source_rect,
@@ -200,13 +232,13 @@ VdpStatus vdp_video_mixer_render(VdpVideoMixer mixer,
 
 	if (video_source_rect)
 	{
-		os->video_src_rect = *video_source_rect;
+		rotate_rect(&os->video_src_rect, video_source_rect, os->vs);
 	}
 	else
 	{
 		os->video_src_rect.x0 = os->video_src_rect.y0 = 0;
-		os->video_src_rect.x1 = os->vs->width;
-		os->video_src_rect.y1 = os->vs->height;
+		os->video_src_rect.x1 = display_width(os->vs);
+		os->video_src_rect.y1 = display_height(os->vs);
 	}
 	if (destination_video_rect)
 	{